@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+@file run_bench.py
+@brief TinyMLDelta — sweep the host benchmark over patch shapes and profiles.
+@author Felix Galindo
+@license Apache-2.0
+
+Builds tmd_bench once per TMD_SCRATCH_SZ (make -C bench SCRATCH=N),
+generates synthetic base/target pairs, diffs them with the patch generator
+and times every patch under every scratch size and flash timing profile.
+
+Shapes (one base/target pair each):
+
+    size     image length in bytes (--sizes)
+    chunks   number of changed spans, spread evenly (--chunks)
+    kind     raw: spans get fresh random bytes (RAW-heavy patch)
+             rle: spans are zeroed, like pruned weights (RLE-heavy patch)
+
+Profiles use the patch generator's DEFAULT_PROFILE keys; --flash-profile
+adds JSON files in the same format as patchgen --flash-profile.
+
+Usage:
+    python3 bench/run_bench.py [--sizes 65536,262144] [--chunks 4,64,512]
+                               [--scratch 1024,4096] [--async]
+                               [--csv out.csv]
+"""
+
+import argparse
+import csv
+import io
+import json
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+CLI = os.path.join(HERE, "..", "cli")
+# Smallest TMD_SCRATCH_SZ with room for two merge windows next to the
+# TMD_FEAT_ASYNC_WRITE context (ASYNC_MIN_SCRATCH in the Makefile).
+ASYNC_MIN_SCRATCH = 1024
+PATCHGEN = os.path.join(CLI, "tinymldelta_patchgen.py")
+sys.path.insert(0, CLI)
+from tinymldelta_patchgen import DEFAULT_PROFILE  # noqa: E402
+
+#: Built-in device profiles (DEFAULT_PROFILE keys; missing keys default).
+PROFILES = {
+    # Generic 4 KiB sector SPI NOR, the patch generator's default.
+    "spi-nor": dict(DEFAULT_PROFILE),
+    # MCU internal flash: 2 KiB pages, ~22 ms page erase, 8-byte program
+    # units at ~80 us, fast reads.
+    "internal": dict(DEFAULT_PROFILE, sector_size=2048, erase_us=22000.0,
+                     prog_us_per_byte=10.0, read_us_per_byte=0.01),
+    # No flash cost: device time is the CPU model alone.
+    "ram": dict(DEFAULT_PROFILE, erase_us=0.0, prog_us_per_byte=0.0,
+                read_us_per_byte=0.0),
+}
+
+#: Profile key -> tmd_bench option.
+PROFILE_ARGS = {
+    "sector_size": "--sector-size",
+    "erase_us": "--erase-us",
+    "prog_us_per_byte": "--prog-us",
+    "read_us_per_byte": "--read-us",
+    "chunk_us": "--chunk-us",
+    "decode_us_per_byte": "--decode-us",
+}
+
+
+def make_pair(size: int, chunks: int, kind: str, change: float, seed: int):
+    """Synthetic (base, target) with @p chunks changed spans covering about
+    @p change of the image. Spans are spaced evenly, at least half a
+    spacing apart, so the generator keeps them as separate chunks."""
+    rng = random.Random(seed)
+    base = rng.randbytes(size)
+    target = bytearray(base)
+    spacing = size // chunks
+    span = max(1, min(int(size * change) // chunks, spacing // 2))
+    for i in range(chunks):
+        off = i * spacing + rng.randrange(spacing - span + 1)
+        if kind == "raw":
+            target[off:off + span] = rng.randbytes(span)
+        else:
+            target[off:off + span] = bytes(span)
+    return base, bytes(target)
+
+
+def build(scratch: int, cc: str, async_write: bool = False) -> str:
+    cmd = ["make", "-s", "-C", HERE, f"SCRATCH={scratch}",
+           f"ASYNC={int(async_write)}"]
+    if cc:
+        cmd.append(f"CC={cc}")
+    subprocess.run(cmd, check=True)
+    suffix = "a" if async_write else ""
+    return os.path.join(HERE, "build", f"s{scratch}{suffix}", "tmd_bench")
+
+
+def profile_args(prof) -> list:
+    out = []
+    for key, opt in PROFILE_ARGS.items():
+        out += [opt, str(prof[key])]
+    return out
+
+
+def parse_list(s: str) -> list:
+    return [int(x, 0) for x in s.split(",") if x]
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description="TinyMLDelta host benchmark sweep.")
+    ap.add_argument("--sizes", default="65536,262144",
+                    help="image sizes in bytes (max 1 MiB, the bench slot)")
+    ap.add_argument("--chunks", default="4,64,512",
+                    help="changed spans per image")
+    ap.add_argument("--kinds", default="raw,rle", help="raw and/or rle")
+    ap.add_argument("--change", type=float, default=0.1,
+                    help="share of the image changed (default 0.1)")
+    ap.add_argument("--scratch", default="1024,4096",
+                    help="TMD_SCRATCH_SZ values, one build each")
+    ap.add_argument("--profiles", default=",".join(PROFILES),
+                    help="built-in profiles to run")
+    ap.add_argument("--flash-profile", action="append", default=[],
+                    metavar="JSON", help="extra profile file (patchgen format)")
+    ap.add_argument("-n", "--iters", type=int, default=20,
+                    help="applies per measurement")
+    ap.add_argument("--frame", type=int, default=0,
+                    help="tmd_stream_feed() size (default: whole patch)")
+    ap.add_argument("--pg-args", default="",
+                    help="extra patch generator options, e.g. '--lz4'")
+    ap.add_argument("--async", dest="async_write", action="store_true",
+                    help="also build and run each scratch size of at least "
+                         f"{ASYNC_MIN_SCRATCH} with TMD_FEAT_ASYNC_WRITE")
+    ap.add_argument("--cc", default="", help="compiler for the bench builds")
+    ap.add_argument("--csv", metavar="OUT", help="write every row to OUT")
+    args = ap.parse_args()
+
+    profiles = {}
+    for name in [p for p in args.profiles.split(",") if p]:
+        if name not in PROFILES:
+            ap.error(f"unknown profile {name!r} (have {', '.join(PROFILES)})")
+        profiles[name] = PROFILES[name]
+    for path in args.flash_profile:
+        with open(path, "r") as f:
+            profiles[os.path.splitext(os.path.basename(path))[0]] = dict(
+                DEFAULT_PROFILE, **json.load(f))
+
+    benches = {}
+    for s in parse_list(args.scratch):
+        benches[str(s)] = build(s, args.cc)
+        if args.async_write and s < ASYNC_MIN_SCRATCH:
+            print(f"skipping async build of scratch {s} "
+                  f"(< {ASYNC_MIN_SCRATCH})", file=sys.stderr)
+        elif args.async_write:
+            benches[f"{s}a"] = build(s, args.cc, async_write=True)
+    header = None
+    rows = []
+    with tempfile.TemporaryDirectory(prefix="tmd_bench_") as tmp:
+        for size in parse_list(args.sizes):
+            for chunks in parse_list(args.chunks):
+                for kind in [k for k in args.kinds.split(",") if k]:
+                    case = f"{kind}-{size // 1024}k-c{chunks}"
+                    base, target = make_pair(size, chunks, kind, args.change,
+                                             seed=size ^ chunks)
+                    paths = [os.path.join(tmp, f"{case}.{ext}")
+                             for ext in ("base", "target", "tmd")]
+                    for path, data in zip(paths, (base, target)):
+                        with open(path, "wb") as f:
+                            f.write(data)
+                    subprocess.run([sys.executable, PATCHGEN] +
+                                   args.pg_args.split() + paths,
+                                   check=True, stdout=subprocess.DEVNULL)
+                    for scratch, exe in benches.items():
+                        for pname, prof in profiles.items():
+                            out = subprocess.run(
+                                [exe, "--csv", "--label", case,
+                                 "-n", str(args.iters),
+                                 "--frame", str(args.frame)] +
+                                profile_args(prof) +
+                                [paths[0], paths[2], paths[1]],
+                                check=True, stdout=subprocess.PIPE,
+                                text=True).stdout
+                            if header is None:
+                                header = ["profile"] + subprocess.run(
+                                    [exe, "--csv-header"], check=True,
+                                    stdout=subprocess.PIPE,
+                                    text=True).stdout.strip().split(",")
+                            row = [pname] + next(csv.reader(io.StringIO(out)))
+                            rows.append(dict(zip(header, row)))
+                            r = rows[-1]
+                            print(f"{case:<18} s{scratch:<6} {pname:<9} "
+                                  f"patch={r['patch_bytes']:>7} B "
+                                  f"chunks={r['chunks']:>4} "
+                                  f"wall={float(r['wall_us_med']):>9.1f} us "
+                                  f"device={float(r['device_model_us']) / 1000:>9.1f} ms",
+                                  flush=True)
+
+    if args.csv and header:
+        with open(args.csv, "w", newline="") as f:
+            w = csv.DictWriter(f, fieldnames=header)
+            w.writeheader()
+            w.writerows(rows)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,283 @@
+/**
+ * @file tmd_bench.c
+ * @brief TinyMLDelta host benchmark: time repeated applies of one patch.
+ *
+ * Every iteration resets the RAM flash (tmd_bench_flash.c) to a fresh
+ * device with the base image in slot A, then applies the patch through the
+ * streaming API. Reported are:
+ *
+ *   - host wall time of the apply (min / median over the iterations) and
+ *     the core's per-phase split (TMD_FEAT_STATS);
+ *   - the flash traffic it caused and, under a device timing profile,
+ *     the modelled device time: flash (erase + program + read) plus CPU
+ *     (per chunk + per target byte written). A TMD_FEAT_ASYNC_WRITE build
+ *     (make ASYNC=1) models ideal overlap instead: the larger of the two.
+ *
+ * The first iteration is checked against the expected target image when
+ * one is given. One binary covers one TMD_SCRATCH_SZ; run_bench.py builds
+ * several and sweeps patch shapes and profiles.
+ *
+ * Usage:
+ *      ./tmd_bench [options] base.bin patch.tmd [target.bin]
+ *
+ * Author: Felix Galindo
+ * License: Apache-2.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tinymldelta.h"
+#include "tinymldelta_internal.h"
+#include "tmd_bench_flash.h"
+
+/** Wall-time samples kept for the median. */
+#define BENCH_MAX_ITERS 1000
+
+typedef struct {
+  int iters;                    /* applies to time */
+  size_t frame;                 /* feed size, 0 = whole patch in one call */
+  int mapped;                   /* publish flash_map */
+  int csv;                      /* one CSV row instead of the report */
+  const char* label;            /* CSV case name */
+  tmd_bench_profile_t prof;
+} bench_opts_t;
+
+static const char* const k_csv_header =
+    "label,scratch,async,frame,mapped,patch_bytes,target_bytes,chunks,iters,"
+    "wall_us_min,wall_us_med,parse_us,copy_us,decode_us,crc_us,write_us,"
+    "journal_us,bytes_read,bytes_written,bytes_erased,writes,erases,"
+    "flash_model_us,cpu_model_us,device_model_us";
+
+/**
+ * @brief Read a whole file into a malloc'ed buffer.
+ */
+static uint8_t* read_file(const char* path, size_t* len) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return NULL;
+  }
+  uint8_t* buf = NULL;
+  long n = -1;
+  if (fseek(f, 0, SEEK_END) == 0)
+    n = ftell(f);
+  if (n >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+    buf = (uint8_t*)malloc((size_t)n ? (size_t)n : 1u);
+    if (buf && fread(buf, 1, (size_t)n, f) != (size_t)n) {
+      free(buf);
+      buf = NULL;
+    }
+  }
+  fclose(f);
+  if (!buf)
+    fprintf(stderr, "Failed to read %s\n", path);
+  *len = (size_t)(n > 0 ? n : 0);
+  return buf;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief One apply of @p patch through tmd_stream_feed() in @p frame-sized
+ *        pieces (all at once if 0).
+ */
+static tmd_status_t apply_once(tmd_stream_t* ctx, const uint8_t* patch,
+                               size_t len, size_t frame) {
+  tmd_status_t st = tmd_stream_init(ctx);
+  size_t step = frame ? frame : len;
+  for (size_t off = 0; st == TMD_STATUS_OK && off < len; off += step)
+    st = tmd_stream_feed(ctx, patch + off, len - off < step ? len - off : step);
+  if (st == TMD_STATUS_OK)
+    st = tmd_stream_finish(ctx);
+  return st;
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [options] base.bin patch.tmd [target.bin]\n"
+          "  -n N               applies to time (default 20)\n"
+          "  --frame N          feed N bytes per tmd_stream_feed() (default: all)\n"
+          "  --no-map           leave flash_map NULL (reads via flash_read)\n"
+          "  --sector-size N    profile erase unit (default 4096)\n"
+          "  --erase-us X       profile sector erase time\n"
+          "  --prog-us X        profile program time per byte\n"
+          "  --read-us X        profile read time per byte\n"
+          "  --chunk-us X       profile CPU time per chunk\n"
+          "  --decode-us X      profile CPU time per byte written\n"
+          "  --csv              print one CSV row (--label NAME sets its name)\n"
+          "  --csv-header       print the CSV header and exit\n",
+          argv0);
+}
+
+/**
+ * @brief Parse the command line; returns the index of the first path or -1.
+ */
+static int parse_args(int argc, char** argv, bench_opts_t* o) {
+  int i = 1;
+  for (; i < argc && strncmp(argv[i], "-", 1) == 0; ++i) {
+    const char* a = argv[i];
+    const char* v = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (strcmp(a, "--no-map") == 0) {
+      o->mapped = 0;
+    } else if (strcmp(a, "--csv") == 0) {
+      o->csv = 1;
+    } else if (strcmp(a, "--csv-header") == 0) {
+      printf("%s\n", k_csv_header);
+      exit(0);
+    } else if (v == NULL) {
+      return -1;
+    } else {
+      ++i;
+      if (strcmp(a, "-n") == 0)
+        o->iters = atoi(v);
+      else if (strcmp(a, "--frame") == 0)
+        o->frame = (size_t)strtoul(v, NULL, 0);
+      else if (strcmp(a, "--label") == 0)
+        o->label = v;
+      else if (strcmp(a, "--sector-size") == 0)
+        o->prof.sector_size = (uint32_t)strtoul(v, NULL, 0);
+      else if (strcmp(a, "--erase-us") == 0)
+        o->prof.erase_us = atof(v);
+      else if (strcmp(a, "--prog-us") == 0)
+        o->prof.prog_us_per_byte = atof(v);
+      else if (strcmp(a, "--read-us") == 0)
+        o->prof.read_us_per_byte = atof(v);
+      else if (strcmp(a, "--chunk-us") == 0)
+        o->prof.chunk_us = atof(v);
+      else if (strcmp(a, "--decode-us") == 0)
+        o->prof.decode_us_per_byte = atof(v);
+      else
+        return -1;
+    }
+  }
+  if (o->iters < 1 || o->iters > BENCH_MAX_ITERS || o->prof.sector_size == 0)
+    return -1;
+  return (argc - i == 2 || argc - i == 3) ? i : -1;
+}
+
+int main(int argc, char** argv) {
+  /* Defaults: patchgen's DEFAULT_PROFILE (4 KiB SPI NOR, ~20 MB/s decode). */
+  bench_opts_t o = {
+    .iters = 20, .frame = 0, .mapped = 1, .csv = 0, .label = "-",
+    .prof = { 4096u, 45000.0, 2.7, 0.02, 20.0, 0.05 },
+  };
+  int p = parse_args(argc, argv, &o);
+  if (p < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  size_t base_len = 0, patch_len = 0, target_len = 0;
+  uint8_t* base = read_file(argv[p], &base_len);
+  uint8_t* patch = read_file(argv[p + 1], &patch_len);
+  uint8_t* target = (argc - p == 3) ? read_file(argv[p + 2], &target_len) : NULL;
+  if (!base || !patch || (argc - p == 3 && !target))
+    return 1;
+  if (base_len > TMD_BENCH_SLOT_BYTES) {
+    fprintf(stderr, "Base image exceeds the %u-byte bench slot\n",
+            (unsigned)TMD_BENCH_SLOT_BYTES);
+    return 1;
+  }
+  uint32_t chunks = 0;
+  if (patch_len >= sizeof(tmd_hdr_t)) {
+    tmd_hdr_t h;
+    memcpy(&h, patch, sizeof(h));
+    chunks = h.chunks_n;
+  }
+
+  static uint64_t wall[BENCH_MAX_ITERS];
+  tmd_stream_t ctx;
+  tmd_stats_t cs;
+  tmd_bench_flash_stats_t fs;
+  for (int it = 0; it < o.iters; ++it) {
+    tmd_bench_flash_reset(base, (uint32_t)base_len, o.mapped);
+    uint64_t t0 = now_ns();
+    tmd_status_t st = apply_once(&ctx, patch, patch_len, o.frame);
+    wall[it] = now_ns() - t0;
+    if (st != TMD_STATUS_OK) {
+      fprintf(stderr, "Patch apply failed with status %d\n", (int)st);
+      return 2;
+    }
+    if (it == 0 && target &&
+        (tmd_bench_flash_active() != 1 || target_len > TMD_BENCH_SLOT_BYTES ||
+         memcmp(tmd_bench_flash_slot(1), target, target_len) != 0)) {
+      fprintf(stderr, "Slot B does not match %s\n", argv[p + 2]);
+      return 3;
+    }
+  }
+  /* Counters are identical across iterations; keep the last run's. */
+  memset(&cs, 0, sizeof(cs));
+  tmd_stream_stats(&ctx, &cs);
+  tmd_bench_flash_stats(&fs);
+
+  qsort(wall, (size_t)o.iters, sizeof(wall[0]), cmp_u64);
+  double wmin = (double)wall[0] / 1000.0;
+  double wmed = (double)wall[o.iters / 2] / 1000.0;
+  double flash_us = tmd_bench_flash_model_us(&o.prof, &fs, cs.bytes_read);
+  double cpu_us = (double)chunks * o.prof.chunk_us +
+                  (double)fs.write_bytes * o.prof.decode_us_per_byte;
+#if TMD_FEAT_ASYNC_WRITE
+  double dev_us = (flash_us > cpu_us) ? flash_us : cpu_us;
+#else
+  double dev_us = flash_us + cpu_us;
+#endif
+
+  if (o.csv) {
+    printf("%s,%u,%d,%lu,%d,%lu,%lu,%lu,%d,%.1f,%.1f,%lu,%lu,%lu,%lu,%lu,%lu,"
+           "%lu,%llu,%llu,%lu,%lu,%.0f,%.0f,%.0f\n",
+           o.label, (unsigned)TMD_SCRATCH_SZ, TMD_FEAT_ASYNC_WRITE,
+           (unsigned long)o.frame, o.mapped,
+           (unsigned long)patch_len, (unsigned long)target_len,
+           (unsigned long)chunks, o.iters, wmin, wmed,
+           (unsigned long)cs.phase_us[TMD_PHASE_PARSE],
+           (unsigned long)cs.phase_us[TMD_PHASE_COPY],
+           (unsigned long)cs.phase_us[TMD_PHASE_DECODE],
+           (unsigned long)cs.phase_us[TMD_PHASE_CRC],
+           (unsigned long)cs.phase_us[TMD_PHASE_WRITE],
+           (unsigned long)cs.phase_us[TMD_PHASE_JOURNAL],
+           (unsigned long)cs.bytes_read, (unsigned long long)fs.write_bytes,
+           (unsigned long long)fs.erase_bytes, (unsigned long)fs.writes,
+           (unsigned long)fs.erases, flash_us, cpu_us, dev_us);
+  } else {
+    printf("Patch %lu bytes, %lu chunks, scratch %u, frame %lu, %s, %d runs\n",
+           (unsigned long)patch_len, (unsigned long)chunks,
+           (unsigned)TMD_SCRATCH_SZ, (unsigned long)o.frame,
+           o.mapped ? "mapped" : "flash_read", o.iters);
+    printf("Host wall: min %.1f us, median %.1f us\n", wmin, wmed);
+    printf("Host phases (us): parse=%lu copy=%lu decode=%lu crc=%lu "
+           "write=%lu journal=%lu\n",
+           (unsigned long)cs.phase_us[TMD_PHASE_PARSE],
+           (unsigned long)cs.phase_us[TMD_PHASE_COPY],
+           (unsigned long)cs.phase_us[TMD_PHASE_DECODE],
+           (unsigned long)cs.phase_us[TMD_PHASE_CRC],
+           (unsigned long)cs.phase_us[TMD_PHASE_WRITE],
+           (unsigned long)cs.phase_us[TMD_PHASE_JOURNAL]);
+    printf("Flash: read %lu bytes, wrote %llu bytes in %lu ops, "
+           "erased %llu bytes in %lu ops\n",
+           (unsigned long)cs.bytes_read, (unsigned long long)fs.write_bytes,
+           (unsigned long)fs.writes, (unsigned long long)fs.erase_bytes,
+           (unsigned long)fs.erases);
+    printf("Device model: flash %.1f ms %s cpu %.1f ms = %.1f ms\n",
+           flash_us / 1000.0, TMD_FEAT_ASYNC_WRITE ? "||" : "+",
+           cpu_us / 1000.0, dev_us / 1000.0);
+  }
+  free(base);
+  free(patch);
+  free(target);
+  return 0;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file tmd_bench_flash.c
+ * @brief TinyMLDelta ports implementation on RAM for the host benchmark.
+ *
+ * Flash is a static array; erase and program are memset/memcpy and only
+ * count what a real part would spend (see tmd_bench_flash_model_us()), so
+ * wall time measures the core alone. The active slot is a variable and the
+ * core keeps its journal log in the meta region, as on the POSIX port.
+ *
+ * With TMD_FEAT_ASYNC_WRITE an erase/program started by flash_*_async()
+ * is carried out by the next flash_poll(), so the build times the core's
+ * double-buffered path.
+ *
+ * Author: Felix Galindo
+ * License: Apache-2.0
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "tinymldelta_ports.h"
+#include "tmd_bench_flash.h"
+
+/* -------------------------------------------------------------------------- */
+/* State                                                                      */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t g_flash[TMD_BENCH_FLASH_BYTES];
+static uint8_t g_active = 0;
+static tmd_bench_flash_stats_t g_stats;
+
+static tmd_ports_t g_ports;
+
+#if TMD_FEAT_ASYNC_WRITE
+/* Operation started by flash_*_async(), carried out by bench_flash_poll(). */
+static struct {
+  uint8_t     pending;
+  uint32_t    addr;
+  uint32_t    len;
+  const void* src; /* NULL: erase */
+  int         result;
+} g_op;
+#endif
+
+static const tmd_layout_t g_layout = {
+  .slotA = { .addr = 0u, .size = TMD_BENCH_SLOT_BYTES },
+  .slotB = { .addr = TMD_BENCH_SLOT_BYTES, .size = TMD_BENCH_SLOT_BYTES },
+  .meta_addr = 2u * TMD_BENCH_SLOT_BYTES,
+  .meta_size = TMD_BENCH_META_BYTES,
+  .in_place  = false,
+};
+
+/**
+ * @brief Check that [addr, addr + len) lies inside the flash array.
+ */
+static bool flash_in_range(uint32_t addr, uint32_t len) {
+  return addr <= sizeof(g_flash) && len <= sizeof(g_flash) - addr;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Flash operations                                                           */
+/* -------------------------------------------------------------------------- */
+
+static bool bench_flash_erase(uint32_t addr, uint32_t len) {
+  if (!flash_in_range(addr, len)) {
+    return false;
+  }
+  memset(g_flash + addr, 0xFF, len);
+  g_stats.erases++;
+  g_stats.erase_bytes += len;
+  return true;
+}
+
+static bool bench_flash_write(uint32_t addr, const void* src, uint32_t len) {
+  if (!flash_in_range(addr, len)) {
+    return false;
+  }
+  memcpy(g_flash + addr, src, len);
+  g_stats.writes++;
+  g_stats.write_bytes += len;
+  return true;
+}
+
+static bool bench_flash_read(uint32_t addr, void* dst, uint32_t len) {
+  if (!flash_in_range(addr, len)) {
+    return false;
+  }
+  memcpy(dst, g_flash + addr, len);
+  g_stats.reads++;
+  return true;
+}
+
+#if TMD_FEAT_ASYNC_WRITE
+static bool bench_flash_start(uint32_t addr, const void* src, uint32_t len) {
+  if (g_op.pending) {
+    return false;
+  }
+  g_op.pending = 1;
+  g_op.addr = addr;
+  g_op.len = len;
+  g_op.src = src;
+  return true;
+}
+
+static bool bench_flash_erase_async(uint32_t addr, uint32_t len) {
+  return bench_flash_start(addr, NULL, len);
+}
+
+static bool bench_flash_write_async(uint32_t addr, const void* src,
+                                    uint32_t len) {
+  return src != NULL && bench_flash_start(addr, src, len);
+}
+
+static int bench_flash_poll(void) {
+  if (g_op.pending) {
+    bool ok = g_op.src ? bench_flash_write(g_op.addr, g_op.src, g_op.len)
+                       : bench_flash_erase(g_op.addr, g_op.len);
+    g_op.pending = 0;
+    g_op.result = ok ? TMD_FLASH_IDLE : TMD_FLASH_ERROR;
+  }
+  return g_op.result;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Slot selection, clock                                                      */
+/* -------------------------------------------------------------------------- */
+
+static uint8_t bench_get_active_slot(void) {
+  return g_active;
+}
+
+static bool bench_set_active_slot(uint8_t idx) {
+  g_active = idx ? 1u : 0u;
+  return true;
+}
+
+#if TMD_FEAT_STATS
+static uint32_t bench_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u);
+}
+#endif
+
+#if TMD_FEAT_LOG
+#include <stdarg.h>
+
+static void bench_log(const char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* TinyMLDelta ports + layout accessors                                       */
+/* -------------------------------------------------------------------------- */
+
+static tmd_ports_t g_ports = {
+  .flash_erase = bench_flash_erase,
+  .flash_write = bench_flash_write,
+  .flash_read  = bench_flash_read,
+  .flash_map   = NULL, /* set by tmd_bench_flash_reset() */
+  .caps        = TMD_PORT_CAP_WRITE_FROM_PATCH | TMD_PORT_CAP_READ_WHILE_WRITE,
+#if TMD_FEAT_ASYNC_WRITE
+  .flash_erase_async = bench_flash_erase_async,
+  .flash_write_async = bench_flash_write_async,
+  .flash_poll        = bench_flash_poll,
+#endif
+  .get_active_slot = bench_get_active_slot,
+  .set_active_slot = bench_set_active_slot,
+#if TMD_FEAT_STATS
+  .now_us = bench_now_us,
+#endif
+#if TMD_FEAT_LOG
+  .log = bench_log,
+#endif
+};
+
+const tmd_ports_t* tmd_ports(void) {
+  return &g_ports;
+}
+
+const tmd_layout_t* tmd_layout(void) {
+  return &g_layout;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Bench helpers                                                              */
+/* -------------------------------------------------------------------------- */
+
+int tmd_bench_flash_reset(const uint8_t* base, uint32_t len, int mapped) {
+  if (len > TMD_BENCH_SLOT_BYTES) {
+    return -1;
+  }
+  memset(g_flash, 0xFF, sizeof(g_flash));
+  memcpy(g_flash + g_layout.slotA.addr, base, len);
+  g_active = 0;
+  g_ports.flash_map = mapped ? g_flash : NULL;
+  memset(&g_stats, 0, sizeof(g_stats));
+#if TMD_FEAT_ASYNC_WRITE
+  memset(&g_op, 0, sizeof(g_op));
+#endif
+  return 0;
+}
+
+void tmd_bench_flash_stats(tmd_bench_flash_stats_t* out) {
+  *out = g_stats;
+}
+
+uint8_t tmd_bench_flash_active(void) {
+  return g_active;
+}
+
+const uint8_t* tmd_bench_flash_slot(uint8_t idx) {
+  return g_flash + (idx ? g_layout.slotB.addr : g_layout.slotA.addr);
+}
+
+double tmd_bench_flash_model_us(const tmd_bench_profile_t* p,
+                                const tmd_bench_flash_stats_t* fs,
+                                uint64_t read_bytes) {
+  return (double)fs->erase_bytes / p->sector_size * p->erase_us +
+         (double)fs->write_bytes * p->prog_us_per_byte +
+         (double)read_bytes * p->read_us_per_byte;
+}
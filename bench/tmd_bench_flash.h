@@ -0,0 +1,86 @@
+#ifndef TMD_BENCH_FLASH_H_
+#define TMD_BENCH_FLASH_H_
+/**
+ * @file tmd_bench_flash.h
+ * @brief TinyMLDelta benchmark port — RAM-backed flash with a timing model.
+ *
+ * Author: Felix Galindo
+ * License: Apache-2.0
+ */
+
+#include <stdint.h>
+#include "tinymldelta_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bench flash map: two 1 MiB slots followed by a two-sector journal log. */
+#define TMD_BENCH_SLOT_BYTES  (1024u * 1024u)
+#define TMD_BENCH_META_BYTES  (2u * TMD_SECTOR_SZ)
+#define TMD_BENCH_FLASH_BYTES (2u * TMD_BENCH_SLOT_BYTES + TMD_BENCH_META_BYTES)
+
+/**
+ * Device timing profile. Keys and units match the patch generator's
+ * DEFAULT_PROFILE (cli/tinymldelta_patchgen.py), so one profile.json
+ * describes a part for both the planner and the bench.
+ */
+typedef struct {
+  uint32_t sector_size;       /**< Erase unit the erase time applies to. */
+  double erase_us;            /**< One sector erase. */
+  double prog_us_per_byte;    /**< Page program time / page size. */
+  double read_us_per_byte;    /**< Flash read. */
+  double chunk_us;            /**< Per-chunk parse + CRC setup. */
+  double decode_us_per_byte;  /**< Decode + CRC per target byte written. */
+} tmd_bench_profile_t;
+
+/** Flash operation counters (since the last tmd_bench_flash_reset()). */
+typedef struct {
+  uint32_t erases;        /**< flash_erase() calls */
+  uint32_t writes;        /**< flash_write() calls */
+  uint32_t reads;         /**< flash_read() calls (0 while mapped) */
+  uint64_t erase_bytes;   /**< Bytes erased */
+  uint64_t write_bytes;   /**< Bytes programmed */
+} tmd_bench_flash_stats_t;
+
+/**
+ * @brief Reset flash to a fresh device: @p base in slot A, everything else
+ *        erased, slot A active, counters cleared.
+ *
+ * @param mapped Publish the image as tmd_ports_t::flash_map (XIP-style
+ *               reads) or leave it NULL so every read goes through
+ *               flash_read().
+ * @return 0 on success, -1 if @p len exceeds a slot.
+ */
+int tmd_bench_flash_reset(const uint8_t* base, uint32_t len, int mapped);
+
+/**
+ * @brief Copy the flash operation counters into @p out.
+ */
+void tmd_bench_flash_stats(tmd_bench_flash_stats_t* out);
+
+/**
+ * @brief Slot currently marked active (0 = A, 1 = B).
+ */
+uint8_t tmd_bench_flash_active(void);
+
+/**
+ * @brief Contents of slot @p idx (TMD_BENCH_SLOT_BYTES bytes).
+ */
+const uint8_t* tmd_bench_flash_slot(uint8_t idx);
+
+/**
+ * @brief Modelled device time in microseconds of the flash traffic in
+ *        @p fs plus @p read_bytes of reads, under profile @p p.
+ *
+ * Erase time is prorated by erased bytes / sector_size.
+ */
+double tmd_bench_flash_model_us(const tmd_bench_profile_t* p,
+                                const tmd_bench_flash_stats_t* fs,
+                                uint64_t read_bytes);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TMD_BENCH_FLASH_H_ */
@@ -12,6 +12,9 @@ pip install --upgrade pip setuptools wheel
 echo "Installing TinyMLDelta CLI requirements..."
 pip install -r requirements.txt
 
+echo "Building optional native diff core (cli/native)..."
+make -C native || echo "Native diff core not built; PatchGen will use pure Python."
+
 echo ""
 echo "======================================="
 echo "TinyMLDelta CLI environment is ready!"
@@ -0,0 +1,72 @@
+#ifndef TMD_DIFF_H_
+#define TMD_DIFF_H_
+/**
+ * @file tmd_diff.h
+ * @brief TinyMLDelta — Native diff core for the patch generator.
+ *
+ * Host-side helpers that replace the per-byte Python loops in
+ * tinymldelta_patchgen.py:
+ *
+ *   • tmd_diff_runs()  — byte ranges where target differs from base,
+ *                         merged across small gaps (== find_diffs()).
+ *   • tmd_rle_encode() — the runtime's [count][byte] RLE (== rle_encode()).
+ *
+ * Built as libtmddiff.so (loaded by patchgen through ctypes) and as the
+ * stand-alone tmd_diff CLI. Plain C11, no runtime dependencies.
+ *
+ * Author:  Felix Galindo
+ * License: Apache-2.0
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** One differing range of the target image. */
+typedef struct {
+  uint64_t off; /**< Offset of the first byte. */
+  uint64_t len; /**< Number of bytes. */
+} tmd_run_t;
+
+/**
+ * @brief Find the ranges where @p target differs from @p base.
+ *
+ * Ranges closer than or exactly @p merge_gap bytes apart are merged, and
+ * any target bytes past the end of the base form a final range, exactly as
+ * find_diffs() in tinymldelta_patchgen.py does.
+ *
+ * @param base      Base image.
+ * @param base_len  Base length in bytes.
+ * @param target    Target image.
+ * @param tgt_len   Target length in bytes.
+ * @param merge_gap Largest gap of equal bytes merged into one range.
+ * @param out       Output ranges (may be NULL if @p cap is 0).
+ * @param cap       Capacity of @p out in entries.
+ *
+ * @return Number of ranges found. If larger than @p cap, only the first
+ *         @p cap were stored and the call should be repeated with a larger
+ *         buffer.
+ */
+size_t tmd_diff_runs(const uint8_t* base, size_t base_len,
+                     const uint8_t* target, size_t tgt_len,
+                     uint64_t merge_gap, tmd_run_t* out, size_t cap);
+
+/**
+ * @brief RLE-encode @p n bytes as [count][byte] pairs (count 0 => 256).
+ *
+ * @param in  Input bytes.
+ * @param n   Input length.
+ * @param out Output buffer, at least 2 * @p n bytes.
+ *
+ * @return Encoded length in bytes.
+ */
+size_t tmd_rle_encode(const uint8_t* in, size_t n, uint8_t* out);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TMD_DIFF_H_ */
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+@file tinymldelta_native.py
+@brief TinyMLDelta — ctypes binding for the native diff core (cli/native).
+@author Felix Galindo
+@license Apache-2.0
+
+Loads libtmddiff.so, built with `make -C cli/native`, and exposes drop-in
+versions of the patch generator's hot loops. If the library is missing,
+`available()` is False and callers keep using the pure-Python code.
+
+The library path can be overridden with the TMD_NATIVE_LIB environment
+variable; TMD_NATIVE_LIB=off disables the native path.
+"""
+
+import ctypes
+import os
+from typing import List, Optional, Tuple
+
+
+class _Run(ctypes.Structure):
+    _fields_ = [("off", ctypes.c_uint64), ("len", ctypes.c_uint64)]
+
+
+def _load() -> Optional[ctypes.CDLL]:
+    path = os.environ.get("TMD_NATIVE_LIB")
+    if path == "off":
+        return None
+    if not path:
+        here = os.path.dirname(os.path.abspath(__file__))
+        path = os.path.join(here, "native", "libtmddiff.so")
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    lib.tmd_diff_runs.restype = ctypes.c_size_t
+    lib.tmd_diff_runs.argtypes = [
+        ctypes.c_char_p, ctypes.c_size_t,
+        ctypes.c_char_p, ctypes.c_size_t,
+        ctypes.c_uint64, ctypes.POINTER(_Run), ctypes.c_size_t,
+    ]
+    lib.tmd_rle_encode.restype = ctypes.c_size_t
+    lib.tmd_rle_encode.argtypes = [
+        ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p,
+    ]
+    return lib
+
+
+_lib = _load()
+
+
+def available() -> bool:
+    """True if libtmddiff.so was found and loaded."""
+    return _lib is not None
+
+
+def diff_runs(base: bytes, target: bytes, merge_gap: int) -> List[Tuple[int, int]]:
+    """(offset, length) ranges where target differs from base (find_diffs())."""
+    cap = 4096
+    while True:
+        out = (_Run * cap)()
+        n = _lib.tmd_diff_runs(base, len(base), target, len(target),
+                               merge_gap, out, cap)
+        if n <= cap:
+            return [(out[i].off, out[i].len) for i in range(n)]
+        cap = n
+
+
+def rle_encode(data: bytes) -> bytes:
+    """Native twin of tinymldelta_patchgen.rle_encode()."""
+    out = ctypes.create_string_buffer(2 * len(data) or 1)
+    n = _lib.tmd_rle_encode(bytes(data), len(data), out)
+    return out.raw[:n]
@@ -24,7 +24,8 @@ Where:
         * I/O hash
 
   - Each chunk describes a byte run to overwrite at a given offset, with
-    optional RLE compression and per-chunk CRC32.
+    optional RLE or LZ4 (--lz4) compression and per-chunk CRC32. With
+    --copy, runs that exist elsewhere in the base become COPY chunks.
 
 Usage (basic):
     python3 tinymldelta_patchgen.py base.tflite target.tflite patch.tmd
@@ -33,6 +34,25 @@ Usage (with auto-metadata from target TFLite):
     python3 tinymldelta_patchgen.py base.tflite target.tflite patch.tmd \\
         --auto-meta --arena-factor 1.4
 
+Chunk planning (default: greedy --merge-gap / --min-chunk heuristics):
+    --plan dp --objective bytes|time|mix [--mix-weight W]
+    --flash-profile profile.json   # device timing, see DEFAULT_PROFILE
+
+Fleet bundle (one target, many field bases, parallel):
+    python3 tinymldelta_patchgen.py --bundle out/ target.tflite \\
+        base_v1.tflite base_v2.tflite ... [-j 8]
+    # out/<base digest>.tmd + out/manifest.json (base digest -> patch)
+
+Squash a patch chain into one patch (devices several releases behind):
+    python3 tinymldelta_patchgen.py --squash v1_to_v4.tmd v1.tflite \\
+        v1_to_v2.tmd v2_to_v3.tmd v3_to_v4.tmd [--lz4 --copy ...]
+
+Benchmark a corpus (encoders x planners -> CSV or JSON by extension):
+    python3 tinymldelta_patchgen.py --bench report.csv \\
+        base1.tflite target1.tflite base2.tflite target2.tflite ...
+    [--bench-encoders raw,rle,lz4,copy,delta,tflite,all]
+    [--bench-plans greedy,dp-bytes,dp-time,dp-mix]
+
 Manual metadata overrides (take precedence over auto-meta):
     --req-arena BYTES
     --tflm-abi VERSION
@@ -41,8 +61,17 @@ Manual metadata overrides (take precedence over auto-meta):
 """
 
 import argparse
+import csv
+import hashlib
+import json
+import os
+import sqlite3
 import struct
+import time
+import tracemalloc
 import zlib
+from array import array
+from concurrent.futures import ProcessPoolExecutor
 from typing import Optional
 
 # Try to import optional TFLite-aware metadata helper.
@@ -52,6 +81,20 @@ try:
 except Exception:
     compute_from_tflite = None  # type: ignore
 
+# Optional FlatBuffer reader for --tflite structure-aware diffs.
+try:
+    from tinymldelta_tflite import buffer_regions  # type: ignore
+except Exception:
+    buffer_regions = None  # type: ignore
+
+# Optional native diff core (make -C cli/native); pure Python otherwise.
+try:
+    import tinymldelta_native as native  # type: ignore
+    if not native.available():
+        native = None
+except Exception:
+    native = None
+
 # --------------------------------------------------------------------------- #
 #                           Wire-format constants                             #
 # --------------------------------------------------------------------------- #
@@ -65,10 +108,19 @@ CHUNK_FMT = "<IHBb"  # off,len,enc,has_crc
 # Digest algorithms (must match runtime enum)
 ALGO_NONE = 0
 ALGO_CRC32 = 1
+ALGO_SHA256 = 2
 
 # Chunk encoding types (must match runtime enum)
 ENC_RAW = 0
 ENC_RLE = 1  # [count][byte], count 0 => 256
+ENC_LZ4 = 2  # LZ4 block; matches may reach into the target before the chunk
+ENC_COPY = 3  # <u32 src_off><u32 count>: bytes from the source slot
+ENC_F_XOR = 0x10  # | RAW/RLE: <u32 src_off> + body, target = src ^ body
+ENC_F_SUB = 0x20  # | RAW/RLE: <u32 src_off> + body, target = src + body
+
+# Header flags (must match TMD_HDR_F_* in tinymldelta_internal.h)
+HDR_F_ALIGNED = 0x0001  # data chunks laid out on program units / sectors
+HDR_F_IN_PLACE = 0x0002  # no source reads behind the sector being written
 
 # Metadata TLV tags (must match tinymldelta_internal.h)
 TMD_META_REQ_ARENA_BYTES = 0x01
@@ -98,6 +150,8 @@ def rle_encode(data: bytes) -> bytes:
         RLE-encoded bytes. May be longer than the input; the caller is
         responsible for choosing between raw vs RLE.
     """
+    if native is not None:
+        return native.rle_encode(data)
     out = bytearray()
     i = 0
     n = len(data)
@@ -113,6 +167,137 @@ def rle_encode(data: bytes) -> bytes:
     return bytes(out)
 
 
+def delta_encode(raw: bytes, src: bytes, src_off: int):
+    """Smallest XOR / SUB delta chunk of @p raw against the source bytes.
+
+    Fine-tuned int8 weights mostly move by +-1..3 steps, which a byte diff
+    resends in full. The residual against the old bytes is zero wherever a
+    weight kept its value and small elsewhere, so its RLE form is short.
+
+    Args:
+        raw:     Target bytes of the chunk.
+        src:     Base bytes the runtime combines them with (same length).
+        src_off: Base offset of @p src.
+
+    Returns:
+        (enc, payload) of the best XOR/SUB x RAW/RLE combination.
+    """
+    head = struct.pack("<I", src_off)
+    xor = bytes(t ^ b for t, b in zip(raw, src))
+    sub = bytes((t - b) & 0xFF for t, b in zip(raw, src))
+    best = None
+    for op, res in ((ENC_F_XOR, xor), (ENC_F_SUB, sub)):
+        for enc, body in ((ENC_RAW, res), (ENC_RLE, rle_encode(res))):
+            if best is None or len(body) + 4 < len(best[1]):
+                best = (op | enc, head + body)
+    return best
+
+
+# --------------------------------------------------------------------------- #
+#                          LZ4 compression helpers                            #
+# --------------------------------------------------------------------------- #
+
+LZ4_MIN_MATCH = 4
+LZ4_MAX_DIST = 65535
+LZ4_LAST_LITERALS = 5   # block must end with at least 5 literals
+LZ4_MFLIMIT = 12        # no match may start in the last 12 bytes
+
+
+class Lz4Encoder:
+    """Greedy hash-chain LZ4 block encoder over one target image.
+
+    Chunks are encoded in ascending offset order. When the runtime decodes a
+    chunk, the target image before the chunk offset is already in the
+    destination slot (earlier chunks plus the unchanged bytes between them),
+    so matches may reference any of it within the 64 KiB LZ4 window. The
+    encoder therefore indexes the target as it goes instead of just the
+    chunk being compressed, but only the last window before each chunk: the
+    hash heads and the chain ring are fixed-size int arrays, so memory does
+    not grow with the image.
+    """
+
+    HASH_LOG = 16
+    RING = 1 << 16  # > LZ4_MAX_DIST: chain links older than this are dead
+
+    def __init__(self, target: bytes, max_chain: int = 32):
+        self.buf = target
+        self.max_chain = max_chain
+        self.head = array("i", [-1]) * (1 << self.HASH_LOG)
+        self.prev = array("i", [-1]) * self.RING
+        self.indexed = 0
+
+    def _hash(self, pos: int) -> int:
+        v = struct.unpack_from("<I", self.buf, pos)[0]
+        return ((v * 2654435761) & 0xFFFFFFFF) >> (32 - self.HASH_LOG)
+
+    def _index_upto(self, end: int) -> None:
+        # Positions more than a window before @p end can never be matched.
+        start = max(self.indexed, end - LZ4_MAX_DIST)
+        head, prev, mask = self.head, self.prev, self.RING - 1
+        for p in range(start, min(end, len(self.buf) - 3)):
+            h = self._hash(p)
+            prev[p & mask] = head[h]
+            head[h] = p
+        self.indexed = max(self.indexed, end)
+
+    def _best_match(self, pos: int, limit: int):
+        buf = self.buf
+        cand = self.head[self._hash(pos)]
+        best_len, best_off = 0, 0
+        chain = self.max_chain
+        mask = self.RING - 1
+        while cand >= 0 and pos - cand <= LZ4_MAX_DIST and chain > 0:
+            n = 0
+            while pos + n < limit and buf[cand + n] == buf[pos + n]:
+                n += 1
+            if n > best_len:
+                best_len, best_off = n, pos - cand
+            cand = self.prev[cand & mask]
+            chain -= 1
+        return best_len, best_off
+
+    @staticmethod
+    def _emit_len(out: bytearray, n: int) -> None:
+        while n >= 255:
+            out.append(255)
+            n -= 255
+        out.append(n)
+
+    def encode(self, off: int, length: int) -> bytes:
+        """Encode target[off:off+length] as one LZ4 block."""
+        buf = self.buf
+        end = off + length
+        match_limit = end - LZ4_LAST_LITERALS
+        self._index_upto(off)
+        out = bytearray()
+        anchor = pos = off
+        while pos + LZ4_MFLIMIT <= end:
+            mlen, dist = self._best_match(pos, match_limit)
+            if mlen < LZ4_MIN_MATCH:
+                self._index_upto(pos + 1)
+                pos += 1
+                continue
+            lit = pos - anchor
+            ml = mlen - LZ4_MIN_MATCH
+            out.append((min(lit, 15) << 4) | min(ml, 15))
+            if lit >= 15:
+                self._emit_len(out, lit - 15)
+            out += buf[anchor:pos]
+            out += struct.pack("<H", dist)
+            if ml >= 15:
+                self._emit_len(out, ml - 15)
+            pos += mlen
+            self._index_upto(pos)
+            anchor = pos
+        lit = end - anchor
+        out.append(min(lit, 15) << 4)
+        if lit >= 15:
+            self._emit_len(out, lit - 15)
+        out += buf[anchor:end]
+        self._index_upto(end)
+        return bytes(out)
+
+
 # --------------------------------------------------------------------------- #
 #                          Diff / coalescing helpers                          #
 # --------------------------------------------------------------------------- #
@@ -133,6 +318,10 @@ def find_diffs(base: bytes, target: bytes, merge_gap: int = 16):
     Returns:
         List of (offset, bytes) pairs describing the new data to write.
     """
+    if native is not None:
+        return [(off, target[off:off + n])
+                for off, n in native.diff_runs(base, target, merge_gap)]
+
     diffs = []
     i = 0
     n = min(len(base), len(target))
@@ -167,6 +356,446 @@ def find_diffs(base: bytes, target: bytes, merge_gap: int = 16):
     return [(off, bytes(data)) for off, data in merged]
 
 
+COPY_KEY = 16     # bytes hashed per base position
+COPY_STRIDE = 8   # base positions indexed every COPY_STRIDE bytes
+
+
+def find_copies(base: bytes, target: bytes, diffs, min_copy: int = 32):
+    """Split diff runs into literal pieces and copies from the base.
+
+    A FlatBuffer re-layout that shifts a buffer makes every byte after the
+    shift differ position by position, although the data itself is still in
+    the base. Each diff run is scanned for target runs of at least
+    @p min_copy bytes that also appear somewhere in the base; those become
+    COPY chunks and only the rest is sent as data.
+
+    The base is indexed by COPY_KEY-byte keys every COPY_STRIDE bytes, so a
+    hit is extended backwards (by up to the stride) and forwards. The offset
+    of the previous copy is tried first, which makes long shifted regions
+    cheap to follow.
+
+    Args:
+        base:     Original byte array (the source slot).
+        target:   Desired byte array.
+        diffs:    (offset, bytes) pairs from find_diffs().
+        min_copy: Shortest run worth a COPY chunk (header + 8 payload bytes).
+
+    Returns:
+        List of (offset, bytes, src) triples; src is the base offset for a
+        copy and None for literal data.
+    """
+    index = {}
+    for p in range(0, len(base) - COPY_KEY + 1, COPY_STRIDE):
+        index.setdefault(base[p:p + COPY_KEY], p)
+
+    out = []
+    shift = None
+    for off, data in diffs:
+        end = off + len(data)
+        lit = pos = off
+        while pos + min_copy <= end:
+            src = None
+            if (shift is not None and 0 <= pos + shift
+                    and base[pos + shift:pos + shift + COPY_KEY]
+                    == target[pos:pos + COPY_KEY]):
+                src = pos + shift
+            else:
+                src = index.get(target[pos:pos + COPY_KEY])
+            if src is None:
+                pos += 1
+                continue
+            start = pos
+            while start > lit and src > 0 and base[src - 1] == target[start - 1]:
+                start -= 1
+                src -= 1
+            n = 0
+            while (start + n < end and src + n < len(base)
+                   and base[src + n] == target[start + n]):
+                n += 1
+            if n < min_copy:
+                pos += 1
+                continue
+            if start > lit:
+                out.append((lit, target[lit:start], None))
+            out.append((start, target[start:start + n], src))
+            shift = src - start
+            lit = pos = start + n
+        if lit < end:
+            out.append((lit, target[lit:end], None))
+    return out
+
+
+# --------------------------------------------------------------------------- #
+#                          Cost-model chunk planner                           #
+# --------------------------------------------------------------------------- #
+
+#: Largest chunk payload: tmd_chunk_hdr_t.len is a u16. RAW chunks decode
+#: 1:1; RLE chunks stream and may decode to far more (see _split_long()).
+MAX_CHUNK_DATA = 0xFFFF
+
+#: Device timing profile used by the "time" and "mix" objectives. Override
+#: any key with --flash-profile profile.json. Values are for a generic 4 KiB
+#: sector SPI NOR part and an MCU decoding at ~20 MB/s.
+DEFAULT_PROFILE = {
+    "sector_size": 4096,         # erase sector in bytes (TMD_SECTOR_SZ)
+    "erase_us": 45000.0,         # one sector erase
+    "prog_us_per_byte": 2.7,     # page program time / page size
+    "read_us_per_byte": 0.02,    # flash read
+    "chunk_us": 20.0,            # per-chunk parse + CRC setup on the device
+    "decode_us_per_byte": 0.05,  # RAW/RLE decode + CRC per decoded byte
+    "stale_ratio": 1.0,          # share of untouched sectors that differ in
+                                 # the inactive slot and must be rewritten
+}
+
+
+def _rle_reach(data: bytes, pos: int, budget: int) -> int:
+    """End of the longest data[pos:end] whose RLE form fits in @p budget bytes."""
+    n = len(data)
+    used = 0
+    while pos < n and used + 2 <= budget:
+        val = data[pos]
+        run = 1
+        while pos + run < n and run < 256 and data[pos + run] == val:
+            run += 1
+        pos += run
+        used += 2
+    return pos
+
+
+def _split_long(pieces, limit: int = MAX_CHUNK_DATA):
+    """Split (offset, bytes) pieces so every chunk fits the u16 length field.
+
+    The runtime decodes RLE as a stream, so a chunk's decoded size is not
+    bounded; only its encoded payload is. Runs that compress are therefore
+    cut where their RLE form reaches @p limit (a zeroed 1 MiB block is one
+    chunk of 8 KiB), everything else every @p limit raw bytes.
+    """
+    out = []
+    for off, data in pieces:
+        if len(data) <= limit:
+            out.append((off, data))
+            continue
+        pos = 0
+        while pos < len(data):
+            # 2 bytes of slack: a cut may split one run into two pairs.
+            end = _rle_reach(data, pos, limit - 2)
+            if end - pos <= limit:
+                end = min(len(data), pos + limit)
+            out.append((off + pos, data[pos:end]))
+            pos = end
+    return out
+
+
+def _enc_len(data: bytes) -> int:
+    """Wire size of @p data as the cheaper of RAW and RLE."""
+    return min(len(data), len(rle_encode(data)))
+
+
+def estimate_plan(pieces, image_len: int, chunk_overhead: int, profile):
+    """Estimate wire bytes and device apply time (us) of a chunk plan.
+
+    The runtime merges source and chunk bytes per sector: a sector hit by a
+    chunk is erased and programmed once; any other sector is compared with
+    the source and only rewritten if the inactive slot holds stale data.
+    """
+    sec = profile["sector_size"]
+    rewrite = profile["erase_us"] + profile["prog_us_per_byte"] * sec
+    untouched = (2 * profile["read_us_per_byte"] * sec
+                 + profile["stale_ratio"] * rewrite)
+
+    wire = struct.calcsize(HDR_FMT)
+    us = 0.0
+    touched = set()
+    for off, data in pieces:
+        wire += chunk_overhead + _enc_len(data)
+        us += profile["chunk_us"] + profile["decode_us_per_byte"] * len(data)
+        if data:
+            touched.update(range(off // sec, (off + len(data) - 1) // sec + 1))
+    sectors = (image_len + sec - 1) // sec
+    us += len(touched) * rewrite + (sectors - len(touched)) * untouched
+    return wire, us
+
+
+def plan_chunks(base: bytes, target: bytes, chunk_overhead: int,
+                objective: str = "bytes", mix_weight: float = 1.0,
+                profile=None, max_span: int = 256):
+    """Choose which diff runs share a chunk by dynamic programming.
+
+    Every exact diff run (find_diffs() with merge_gap=0) must be covered.
+    A chunk spanning runs i..j also carries the unchanged target bytes
+    between them. The planner minimizes, over all ways to cut the runs into
+    consecutive chunks:
+
+        bytes: chunk_overhead + min(RAW, RLE) payload per chunk
+        time:  estimated device apply time (see estimate_plan())
+        mix:   bytes + mix_weight * time in milliseconds
+
+    RLE sizes are summed per run and per gap, which slightly overestimates
+    RLE runs that continue across a boundary. Chunks never exceed
+    MAX_CHUNK_DATA encoded bytes, and at most @p max_span runs are merged.
+
+    Returns:
+        List of (offset, bytes) chunks, like find_diffs().
+    """
+    prof = dict(DEFAULT_PROFILE, **(profile or {}))
+    runs = _split_long(find_diffs(base, target, merge_gap=0))
+    k = len(runs)
+    if k == 0:
+        return []
+
+    sec = prof["sector_size"]
+    rewrite = prof["erase_us"] + prof["prog_us_per_byte"] * sec
+    untouched = 2 * prof["read_us_per_byte"] * sec + prof["stale_ratio"] * rewrite
+    w_bytes = 0.0 if objective == "time" else 1.0
+    w_time = {"bytes": 0.0, "time": 1.0}.get(objective, mix_weight / 1000.0)
+
+    raw = [len(d) for _, d in runs]
+    rle = [len(rle_encode(d)) for _, d in runs]
+    graw = [0] * k
+    grle = [0] * k
+    gsec = [0] * k  # whole sectors inside the gap before run i
+    for i in range(1, k):
+        g0 = runs[i - 1][0] + raw[i - 1]
+        g1 = runs[i][0]
+        graw[i] = g1 - g0
+        # Gaps that cannot fit in one chunk are never merged; skip their RLE.
+        grle[i] = graw[i]
+        if graw[i] <= MAX_CHUNK_DATA:
+            grle[i] = len(rle_encode(target[g0:g1]))
+        gsec[i] = max(0, g1 // sec - (g0 + sec - 1) // sec)
+
+    inf = float("inf")
+    best = [0.0] + [inf] * k
+    cut = [0] * (k + 1)
+    for j in range(k):
+        sum_raw = sum_rle = 0
+        extra_us = 0.0
+        for i in range(j, max(-1, j - max_span), -1):
+            sum_raw += raw[i]
+            sum_rle += rle[i]
+            if i < j:
+                sum_raw += graw[i + 1]
+                sum_rle += grle[i + 1]
+                extra_us += gsec[i + 1] * (rewrite - untouched)
+            if min(sum_raw, sum_rle) > MAX_CHUNK_DATA:
+                break
+            cost = (w_bytes * (chunk_overhead + min(sum_raw, sum_rle))
+                    + w_time * (prof["chunk_us"]
+                                + prof["decode_us_per_byte"] * sum_raw
+                                + extra_us))
+            if best[i] + cost < best[j + 1]:
+                best[j + 1] = best[i] + cost
+                cut[j + 1] = i
+
+    plan = []
+    j = k
+    while j > 0:
+        i = cut[j]
+        off = runs[i][0]
+        end = runs[j - 1][0] + raw[j - 1]
+        plan.append((off, target[off:end]))
+        j = i
+    plan.reverse()
+    return plan
+
+
+def _subtract(pieces, holes):
+    """Remove the [start, end) @p holes from (offset, bytes) pieces."""
+    out = []
+    for off, data in pieces:
+        segs = [(off, off + len(data))]
+        for h0, h1 in holes:
+            nxt = []
+            for a, b in segs:
+                if h1 <= a or h0 >= b:
+                    nxt.append((a, b))
+                    continue
+                if a < h0:
+                    nxt.append((a, h0))
+                if h1 < b:
+                    nxt.append((h1, b))
+            segs = nxt
+        out += [(a, data[a - off:b - off]) for a, b in segs]
+    return out
+
+
+def tflite_moved(base: bytes, target: bytes):
+    """(target off, target len, base off, base len) of every tensor buffer
+    that moved between @p base and @p target (see tflite_pieces()).
+
+    Raises:
+        ValueError: base or target is not a readable TFLite model.
+    """
+    if buffer_regions is None:
+        raise ValueError("tinymldelta_tflite reader unavailable")
+    rb = buffer_regions(base)
+    rt = buffer_regions(target)
+    return sorted((t_off, t_len, rb[k][0], rb[k][1])
+                  for k, (t_off, t_len) in rt.items()
+                  if k in rb and rb[k][0] != t_off)
+
+
+def delta_source(off: int, n: int, base_len: int, moved=(), sector: int = 0):
+    """Base offset a delta chunk for target[off:off+n] is taken against.
+
+    Bytes of a moved tensor buffer diff against its old copy, everything
+    else against the same offset. None if the range has no base bytes, or
+    (with @p sector, for in-place patches) if the source would lie in a
+    sector the runtime has already rewritten.
+    """
+    src = off if off + n <= base_len else None
+    for t_off, t_len, b_off, b_len in moved:
+        if t_off <= off < t_off + t_len:
+            src = (b_off + (off - t_off)
+                   if off + n <= t_off + min(t_len, b_len) else None)
+            break
+    if src is not None and sector and src < off:
+        if (off % sector) < off - src or off // sector != (off + n - 1) // sector:
+            return None
+    return src
+
+
+def restrict_in_place(pieces, sector: int):
+    """Make COPY pieces safe for an in-place apply (TMD_HDR_F_IN_PLACE).
+
+    In place, the runtime rewrites the slot sector by sector and only keeps
+    the original of the current sector (in its swap sector). A copy whose
+    source lies d bytes before its destination is therefore only valid for
+    the bytes at least d into their sector; the rest becomes literal data.
+    """
+    out = []
+    for off, data, src in pieces:
+        if src is None or src >= off:
+            out.append((off, data, src))
+            continue
+        d = off - src
+        pos, end = off, off + len(data)
+        while pos < end:
+            sec_lo = pos - pos % sector
+            stop = min(end, sec_lo + sector)
+            ok = max(pos, sec_lo + d)
+            if stop - ok < COPY_KEY:
+                ok = stop  # too short to be worth a COPY chunk
+            if ok > pos:
+                lit = min(ok, stop)
+                out += [(o, b, None) for o, b in
+                        _split_long([(pos, data[pos - off:lit - off])])]
+            if ok < stop:
+                out.append((ok, data[ok - off:stop - off], ok - d))
+            pos = stop
+    return out
+
+
+def tflite_pieces(base: bytes, target: bytes, diffs, min_copy: int = 32):
+    """Structure-aware pieces: align moved tensor buffers by identity.
+
+    When a retrain re-serializes the model, tensor buffers keep their names
+    but move in the file, and a positional diff resends all of them. Here
+    each target buffer is matched to the base buffer of the same tensor(s)
+    (tinymldelta_tflite.buffer_regions()) and diffed against it at its old
+    offset: unchanged stretches of at least @p min_copy bytes become COPY
+    pieces from the base buffer, the rest is literal. Bytes outside moved
+    buffers keep the positional @p diffs.
+
+    Returns:
+        Ascending (offset, bytes, src) triples like find_copies(), or None
+        if no buffer moved (the positional diff is already aligned).
+
+    Raises:
+        ValueError: base or target is not a readable TFLite model.
+    """
+    moved = tflite_moved(base, target)
+    if not moved:
+        return None
+
+    out = [(off, data, None)
+           for off, data in _subtract(diffs, [(t, t + n) for t, n, _, _ in moved])]
+    for t_off, t_len, b_off, b_len in moved:
+        m = min(t_len, b_len)
+        runs = find_diffs(base[b_off:b_off + m], target[t_off:t_off + m],
+                          merge_gap=min_copy - 1)
+        pos = 0
+        for r_off, r_data in runs + [(m, b"")]:
+            if r_off - pos >= min_copy:
+                out.append((t_off + pos, target[t_off + pos:t_off + r_off],
+                            b_off + pos))
+            elif r_off > pos:
+                out.append((t_off + pos, target[t_off + pos:t_off + r_off], None))
+            if r_data:
+                out.append((t_off + r_off, r_data, None))
+            pos = r_off + len(r_data)
+        if t_len > m:
+            out.append((t_off + m, target[t_off + m:t_off + t_len], None))
+    out.sort(key=lambda p: p[0])
+
+    # Merge touching literal pieces and keep them within the chunk limit.
+    merged = []
+    for off, data, src in out:
+        if (src is None and merged and merged[-1][2] is None
+                and merged[-1][0] + len(merged[-1][1]) == off):
+            merged[-1] = (merged[-1][0], merged[-1][1] + data, None)
+        else:
+            merged.append((off, data, src))
+    final = []
+    for off, data, src in merged:
+        if src is None:
+            final += [(o, d, None) for o, d in _split_long([(off, data)])]
+        else:
+            final.append((off, data, src))
+    return final
+
+
+def align_pieces(pieces, target: bytes, write_align: int, sector_size: int):
+    """Lay data pieces out on the device's program units and sectors.
+
+    Each literal piece is widened to whole program units (using the
+    unchanged target bytes around it, but never into a neighbouring COPY
+    piece or past the image end), touching pieces are merged, and the
+    result is cut at erase-sector boundaries and at the u16 length limit.
+    The runtime can then program every unit straight from the patch.
+
+    Args:
+        pieces:      Ascending (offset, bytes, src) triples (see find_copies()).
+        target:      Target image.
+        write_align: Flash program unit in bytes (TMD_ALIGN_WRITE).
+        sector_size: Erase sector in bytes (TMD_SECTOR_SZ); 0 = no cuts.
+
+    Returns:
+        New list of (offset, bytes, src) triples.
+    """
+    a = max(1, write_align)
+    out = []
+    for i, (off, data, src) in enumerate(pieces):
+        if src is not None:
+            out.append((off, data, src))
+            continue
+        lo = off - off % a
+        hi = -(-(off + len(data)) // a) * a
+        if out:
+            lo = max(lo, out[-1][0] + len(out[-1][1]))
+        if i + 1 < len(pieces):
+            hi = min(hi, pieces[i + 1][0])
+        hi = min(hi, len(target))
+        if out and out[-1][2] is None and out[-1][0] + len(out[-1][1]) == lo:
+            lo = out.pop()[0]
+        out.append((lo, target[lo:hi], None))
+
+    limit = MAX_CHUNK_DATA - MAX_CHUNK_DATA % a
+    cut = []
+    for off, data, src in out:
+        if src is not None:
+            cut.append((off, data, src))
+            continue
+        pos, end = off, off + len(data)
+        while pos < end:
+            stop = min(end, pos + limit)
+            if sector_size:
+                stop = min(stop, (pos // sector_size + 1) * sector_size)
+            cut.append((pos, target[pos:stop], None))
+            pos = stop
+    return cut
+
+
 # --------------------------------------------------------------------------- #
 #                             Metadata (TLV)                                  #
 # --------------------------------------------------------------------------- #
@@ -226,7 +855,7 @@ def debug_print_patch_header(path: str) -> None:
     print(f"  file       : {path}")
     print(f"  first16    : {first16}")
     print(f"  v          : {v}")
-    print(f"  algo       : {algo}  (0=NONE, 1=CRC32)")
+    print(f"  algo       : {algo}  (0=NONE, 1=CRC32, 2=SHA256)")
     print(f"  chunks_n   : {chunks_n}")
     print(f"  base_len   : {base_len}")
     print(f"  target_len : {target_len}")
@@ -234,6 +863,771 @@ def debug_print_patch_header(path: str) -> None:
     print(f"  flags      : 0x{flags:04x}")
 
 
+# --------------------------------------------------------------------------- #
+#                        Content-addressed diff cache                         #
+# --------------------------------------------------------------------------- #
+
+#: Bump whenever patch output for the same inputs/options changes.
+CACHE_VERSION = 2
+
+#: CLI options that influence the patch bytes (and so the cache key).
+CACHE_OPTS = ("algo", "merge_gap", "min_chunk", "plan", "objective",
+              "mix_weight", "no_rle", "lz4", "copy", "min_copy",
+              "write_align", "sector_size", "tflite", "delta", "in_place")
+
+
+class PatchCache:
+    """On-disk cache of finished patches and encoded chunks (one SQLite file).
+
+    patches: sha256(base) + sha256(target) + CACHE_OPTS + profile + TLVs
+             -> the whole .tmd. A re-run on unchanged inputs skips diffing.
+    chunks:  the chunk's target bytes + --no-rle/--lz4/--delta (+ the LZ4
+             dictionary window when --lz4) -> chosen encoding and payload.
+             A partially changed model re-encodes only the chunks that
+             changed.
+
+    Safe to share between bundle worker processes (SQLite locking).
+    """
+
+    def __init__(self, cache_dir: str):
+        os.makedirs(cache_dir, exist_ok=True)
+        self.db = sqlite3.connect(os.path.join(cache_dir, "tmd_cache.sqlite"),
+                                  timeout=60)
+        self.db.execute("CREATE TABLE IF NOT EXISTS patches "
+                        "(key TEXT PRIMARY KEY, patch BLOB)")
+        self.db.execute("CREATE TABLE IF NOT EXISTS chunks "
+                        "(key TEXT PRIMARY KEY, enc INTEGER, data BLOB)")
+        self.db.commit()
+        self.chunk_hits = 0
+        self.chunk_misses = 0
+
+    @staticmethod
+    def patch_key(args, base: bytes, target: bytes, tinfo: dict,
+                  profile) -> str:
+        desc = {
+            "v": CACHE_VERSION,
+            "base": hashlib.sha256(base).hexdigest(),
+            "target": hashlib.sha256(target).hexdigest(),
+            "opts": {k: getattr(args, k) for k in CACHE_OPTS},
+            # The DP planner costs the profile; --in-place without
+            # --sector-size takes its swap sector from it.
+            "profile": (profile if args.plan == "dp" or
+                        (args.in_place and not args.sector_size) else None),
+            "meta": tinfo["meta"].hex(),
+        }
+        return hashlib.sha256(json.dumps(desc, sort_keys=True).encode()).hexdigest()
+
+    @staticmethod
+    def chunk_key(args, target: bytes, off: int, raw: bytes,
+                  dsrc: Optional[int] = None,
+                  dbase: Optional[bytes] = None) -> str:
+        # Every option that changes which encodings are tried.
+        h = hashlib.sha256(b"chunk/%d/%d/%d/%d/" % (
+            CACHE_VERSION, int(args.no_rle), int(args.lz4), int(args.delta)))
+        h.update(raw)
+        if args.lz4:
+            # LZ4 matches reach into the 64 KiB of target before the chunk.
+            h.update(target[max(0, off - LZ4_MAX_DIST):off])
+        if dbase is not None:
+            # Delta chunks depend on the base bytes and carry their offset.
+            h.update(b"delta/%d/" % dsrc)
+            h.update(dbase)
+        return h.hexdigest()
+
+    def get_patch(self, key: str) -> Optional[bytes]:
+        row = self.db.execute("SELECT patch FROM patches WHERE key=?",
+                              (key,)).fetchone()
+        return bytes(row[0]) if row else None
+
+    def put_patch(self, key: str, patch: bytes) -> None:
+        self.db.execute("INSERT OR REPLACE INTO patches VALUES (?, ?)",
+                        (key, patch))
+        self.db.commit()
+
+    def get_chunk(self, key: str):
+        row = self.db.execute("SELECT enc, data FROM chunks WHERE key=?",
+                              (key,)).fetchone()
+        if row is None:
+            self.chunk_misses += 1
+            return None
+        self.chunk_hits += 1
+        return row[0], bytes(row[1])
+
+    def put_chunk(self, key: str, enc: int, data: bytes) -> None:
+        self.db.execute("INSERT OR REPLACE INTO chunks VALUES (?, ?, ?)",
+                        (key, enc, data))
+
+    def flush(self) -> None:
+        self.db.commit()
+
+
+# --------------------------------------------------------------------------- #
+#                              Patch building                                 #
+# --------------------------------------------------------------------------- #
+
+def image_digest(data: bytes, algo: str) -> bytes:
+    """32-byte header digest field of @p data for --algo @p algo."""
+    if algo == "crc32":
+        return struct.pack("<I", zlib.crc32(data) & 0xFFFFFFFF) + b"\x00" * 28
+    if algo == "sha256":
+        return hashlib.sha256(data).digest()
+    return b"\x00" * 32
+
+
+def digest_key(data: bytes, algo: str) -> str:
+    """Hex key identifying an image the way a device reports it.
+
+    This is the header digest for --algo crc32 / sha256 (CRC32 as 8 hex
+    digits). With --algo none the header carries no digest, so SHA-256 is
+    used instead.
+    """
+    if algo == "crc32":
+        return f"{zlib.crc32(data) & 0xFFFFFFFF:08x}"
+    return hashlib.sha256(data).hexdigest()
+
+
+def target_info(args, target: bytes) -> dict:
+    """Everything about the target a patch needs, independent of the base.
+
+    Header digest, resolved metadata and the encoded TLV block. Bundle mode
+    computes this once and shares it across all bases.
+    """
+    # Auto metadata (TFLite-aware), if requested
+    auto_req_arena = auto_abi = auto_opset = auto_io = None
+    if args.auto_meta:
+        if compute_from_tflite is None:
+            print("[TinyMLDelta] Warning: auto-meta requested but "
+                  "tinymldelta_meta_compute.compute_from_tflite() is unavailable.")
+        else:
+            try:
+                auto_abi, auto_opset, auto_io, auto_req_arena = compute_from_tflite(
+                    args.target,
+                    None
+                    if args.arena_factor is None or args.arena_factor <= 0
+                    else float(args.arena_factor),
+                )
+            except Exception as e:
+                print(f"[TinyMLDelta] Auto-metadata unavailable: {e}")
+                auto_req_arena = auto_abi = auto_opset = auto_io = None
+
+    # Manual overrides take precedence over auto-meta
+    req_arena = args.req_arena if args.req_arena is not None else (auto_req_arena or 0)
+    tflm_abi = args.tflm_abi if args.tflm_abi is not None else (auto_abi or 0)
+    opset = args.opset_hash if args.opset_hash is not None else (auto_opset or 0)
+    io_hash = args.io_hash if args.io_hash is not None else (auto_io or 0)
+
+    meta = bytearray()
+    if req_arena and req_arena > 0:
+        meta += tlv(TMD_META_REQ_ARENA_BYTES, struct.pack("<I", int(req_arena)))
+    if tflm_abi and tflm_abi > 0:
+        meta += tlv(TMD_META_TFLM_ABI, struct.pack("<H", int(tflm_abi & 0xFFFF)))
+    if opset and opset > 0:
+        meta += tlv(TMD_META_OPSET_HASH, struct.pack("<I", int(opset & 0xFFFFFFFF)))
+    if io_hash and io_hash > 0:
+        meta += tlv(TMD_META_IO_HASH, struct.pack("<I", int(io_hash & 0xFFFFFFFF)))
+
+    return {
+        "target_chk": image_digest(target, args.algo),
+        "key": digest_key(target, args.algo),
+        "meta": bytes(meta),
+        "resolved": (req_arena, tflm_abi, opset, io_hash),
+    }
+
+
+def build_patch(args, base: bytes, target: bytes, tinfo: dict, log=print,
+                stats: Optional[dict] = None):
+    """Diff @p base against @p target and encode the .tmd patch.
+
+    Args:
+        args:   Parsed CLI options (encoding / planning knobs).
+        base:   Base image bytes.
+        target: Target image bytes.
+        tinfo:  target_info() of @p target.
+        log:    Progress printer (bundle workers pass a no-op).
+        stats:  If given, filled with "encodings" (chunk count per
+                encoding name) and "apply_us" (estimate_plan() of the
+                final chunk layout). Left untouched on a cache hit.
+
+    Returns:
+        (patch bytes, number of chunks, encoded chunk bytes)
+    """
+    profile = dict(DEFAULT_PROFILE)
+    if args.flash_profile:
+        with open(args.flash_profile, "r") as f:
+            profile.update(json.load(f))
+
+    # 0) Whole-patch cache: identical inputs + options -> stored patch
+    cache = PatchCache(args.cache) if getattr(args, "cache", None) else None
+    if cache is not None:
+        pkey = PatchCache.patch_key(args, base, target, tinfo, profile)
+        hit = cache.get_patch(pkey)
+        if hit is not None:
+            log(f"Cache: patch hit ({pkey[:16]})")
+            n_chunks = struct.unpack_from(HDR_FMT, hit)[2]
+            return hit, n_chunks, _encoded_bytes(hit)
+
+    # 1) Compute raw diffs
+    diffs = find_diffs(base, target, merge_gap=args.merge_gap)
+
+    # 2) Coalesce very small diffs into their predecessor if close enough
+    coalesced = []
+    for off, data in diffs:
+        if (
+            coalesced
+            and (len(data) < args.min_chunk)
+            and (off <= coalesced[-1][0] + len(coalesced[-1][1]) + args.merge_gap)
+        ):
+            prev_off, prev_data = coalesced[-1]
+            gap = target[prev_off + len(prev_data):off]
+            coalesced[-1] = (prev_off, prev_data + gap + data)
+        else:
+            coalesced.append((off, data))
+    diffs = coalesced
+
+    chunk_overhead = struct.calcsize(CHUNK_FMT) + (4 if args.algo == "crc32" else 0)
+
+    def report(name, plan):
+        wire, us = estimate_plan(plan, len(target), chunk_overhead, profile)
+        log(f"Plan {name}: {len(plan)} chunks, ~{wire} wire bytes "
+            f"(before LZ4/COPY), ~{us / 1000.0:.1f} ms apply")
+
+    diffs = _split_long(diffs)
+    report("greedy", diffs)
+    if args.plan == "dp":
+        diffs = plan_chunks(base, target, chunk_overhead,
+                            objective=args.objective,
+                            mix_weight=args.mix_weight, profile=profile)
+        report(f"dp/{args.objective}", diffs)
+
+    # 2b) TFLite-aware: diff moved tensor buffers against their base copy
+    pieces = None
+    moved = []
+    if args.tflite:
+        try:
+            moved = tflite_moved(base, target)
+            pieces = tflite_pieces(base, target, diffs, min_copy=args.min_copy)
+        except ValueError as e:
+            log(f"[TinyMLDelta] --tflite: {e}; using positional diff")
+        if pieces is not None:
+            log(f"TFLite: {sum(1 for p in pieces if p[2] is not None)} "
+                f"buffer COPY pieces")
+
+    # 2c) Replace data that moved within the base by COPY chunks
+    if pieces is None:
+        pieces = [(off, data, None) for off, data in diffs]
+    if args.copy:
+        lits = [(off, data) for off, data, src in pieces if src is None]
+        pieces = sorted([p for p in pieces if p[2] is not None]
+                        + find_copies(base, target, lits, min_copy=args.min_copy),
+                        key=lambda p: p[0])
+
+    # 2d) In-place patches never read source bytes already rewritten
+    flags = 0
+    ip_sector = 0
+    if args.in_place:
+        ip_sector = args.sector_size or profile["sector_size"]
+        pieces = restrict_in_place(pieces, ip_sector)
+        flags |= HDR_F_IN_PLACE
+
+    # 2e) Device flash geometry: program-unit / sector aligned layout
+    if args.write_align or args.sector_size:
+        pieces = align_pieces(pieces, target, args.write_align, args.sector_size)
+        flags |= HDR_F_ALIGNED
+
+    # 3) Header digests
+    if args.algo == "crc32":
+        algo = ALGO_CRC32
+        chunk_has_crc = 1
+    elif args.algo == "sha256":
+        # SHA-256 builds carry no CRC32 code, so chunks go without CRCs and
+        # the whole-image digests carry integrity.
+        algo = ALGO_SHA256
+        chunk_has_crc = 0
+    else:
+        algo = ALGO_NONE
+        chunk_has_crc = 0
+    base_chk = image_digest(base, args.algo)
+    tgt_chk = tinfo["target_chk"]
+
+    v = 1
+    meta = tinfo["meta"]
+    meta_len = len(meta)
+
+    # 4) Encode chunks with optional RLE / LZ4
+    chunks = []
+    lz4 = Lz4Encoder(target) if args.lz4 else None
+    for off, raw, src in pieces:
+        if src is not None:
+            chunks.append((off, ENC_COPY, struct.pack("<II", src, len(raw))))
+            continue
+        dsrc = (delta_source(off, len(raw), len(base), moved, ip_sector)
+                if args.delta else None)
+        dbase = base[dsrc:dsrc + len(raw)] if dsrc is not None else None
+        hit = ckey = None
+        if cache is not None:
+            ckey = PatchCache.chunk_key(args, target, off, raw, dsrc, dbase)
+            hit = cache.get_chunk(ckey)
+        if hit is not None:
+            enc, data = hit
+        else:
+            enc, data = ENC_RAW, raw
+            rle = rle_encode(raw) if not args.no_rle else raw
+            if len(rle) < len(data):
+                enc, data = ENC_RLE, rle
+            if lz4 is not None:
+                lz = lz4.encode(off, len(raw))
+                if len(lz) < len(data):
+                    enc, data = ENC_LZ4, lz
+            if dbase is not None:
+                d_enc, d_data = delta_encode(raw, dbase, dsrc)
+                if len(d_data) < len(data):
+                    enc, data = d_enc, d_data
+            if cache is not None:
+                cache.put_chunk(ckey, enc, data)
+        if len(data) > MAX_CHUNK_DATA:
+            raise SystemExit(f"chunk @{off}: {len(data)} encoded bytes exceed "
+                             f"the u16 chunk length")
+        chunks.append((off, enc, data))
+
+    # 5) Serialize
+    out = bytearray()
+    out += struct.pack(
+        HDR_FMT,
+        v,
+        algo,
+        len(chunks),
+        len(base),
+        len(target),
+        base_chk,
+        tgt_chk,
+        meta_len,
+        flags,
+    )
+    out += meta
+    for off, enc, data in chunks:
+        out += struct.pack(CHUNK_FMT, off, len(data), enc, chunk_has_crc)
+        if chunk_has_crc:
+            out += struct.pack("<I", zlib.crc32(data) & 0xFFFFFFFF)
+        out += data
+
+    if cache is not None:
+        cache.put_patch(pkey, bytes(out))
+        log(f"Cache: {cache.chunk_hits}/{cache.chunk_hits + cache.chunk_misses} "
+            f"chunk encodings reused")
+    if stats is not None:
+        counts = {}
+        for _, enc, _ in chunks:
+            name = enc_name(enc)
+            counts[name] = counts.get(name, 0) + 1
+        stats["encodings"] = counts
+        stats["apply_us"] = estimate_plan([(off, raw) for off, raw, _ in pieces],
+                                          len(target), chunk_overhead, profile)[1]
+    return bytes(out), len(chunks), sum(len(d) for _, _, d in chunks)
+
+
+def enc_name(enc: int) -> str:
+    """Short name of a chunk encoding byte (XOR/SUB residuals are "delta")."""
+    if enc & (ENC_F_XOR | ENC_F_SUB):
+        return "delta"
+    return {ENC_RAW: "raw", ENC_RLE: "rle", ENC_LZ4: "lz4",
+            ENC_COPY: "copy"}.get(enc, str(enc))
+
+
+def _encoded_bytes(patch: bytes) -> int:
+    """Sum of chunk payload lengths in a serialized patch."""
+    hdr = struct.unpack_from(HDR_FMT, patch)
+    pos = struct.calcsize(HDR_FMT) + hdr[7]
+    total = 0
+    for _ in range(hdr[2]):
+        _, n, _, has_crc = struct.unpack_from(CHUNK_FMT, patch, pos)
+        pos += struct.calcsize(CHUNK_FMT) + (4 if has_crc else 0) + n
+        total += n
+    return total
+
+
+# --------------------------------------------------------------------------- #
+#                     Host apply / squash (patch chains)                      #
+# --------------------------------------------------------------------------- #
+
+#: Header algo byte -> --algo name.
+ALGO_NAMES = {ALGO_NONE: "none", ALGO_CRC32: "crc32", ALGO_SHA256: "sha256"}
+
+
+def rle_decode(data: bytes) -> bytes:
+    """Inverse of rle_encode()."""
+    out = bytearray()
+    for i in range(0, len(data) - 1, 2):
+        out += bytes([data[i + 1]]) * (data[i] or 256)
+    return bytes(out)
+
+
+def lz4_decode_into(out: bytearray, pos: int, data: bytes) -> int:
+    """Decode one LZ4 block into @p out at @p pos; returns the end offset.
+
+    Matches may reach back into @p out before @p pos, as on the device.
+    """
+    i = 0
+    while i < len(data):
+        token = data[i]
+        i += 1
+        n = token >> 4
+        if n == 15:
+            while True:
+                b = data[i]
+                i += 1
+                n += b
+                if b != 255:
+                    break
+        out[pos:pos + n] = data[i:i + n]
+        pos += n
+        i += n
+        if i >= len(data):
+            break
+        dist = struct.unpack_from("<H", data, i)[0]
+        i += 2
+        n = token & 15
+        if n == 15:
+            while True:
+                b = data[i]
+                i += 1
+                n += b
+                if b != 255:
+                    break
+        if dist == 0 or dist > pos:
+            raise ValueError(f"LZ4 match distance {dist} at {pos}")
+        for _ in range(n + LZ4_MIN_MATCH):
+            out[pos] = out[pos - dist]
+            pos += 1
+    return pos
+
+
+def apply_patch(base: bytes, patch: bytes) -> bytes:
+    """Apply a .tmd patch to @p base on the host, as the runtime would.
+
+    Checks the base length and digest, every chunk CRC and the target
+    digest.
+
+    Raises:
+        ValueError: If the patch is malformed or does not fit @p base.
+    """
+    hdr_len = struct.calcsize(HDR_FMT)
+    if len(patch) < hdr_len:
+        raise ValueError("patch shorter than its header")
+    (_, algo, chunks_n, base_len, target_len, base_chk, tgt_chk, meta_len,
+     _) = struct.unpack_from(HDR_FMT, patch)
+    name = ALGO_NAMES.get(algo)
+    if name is None:
+        raise ValueError(f"unknown digest algo {algo}")
+    if base_len != len(base) or base_chk != image_digest(base, name):
+        raise ValueError("patch was not built against this base")
+    # Bytes no chunk writes keep their base contents; the generator always
+    # covers a target tail past the base with chunks.
+    out = bytearray(base[:target_len])
+    out += b"\xff" * (target_len - len(out))
+    pos = hdr_len + meta_len
+    for _ in range(chunks_n):
+        off, n, enc, has_crc = struct.unpack_from(CHUNK_FMT, patch, pos)
+        pos += struct.calcsize(CHUNK_FMT)
+        if has_crc:
+            crc = struct.unpack_from("<I", patch, pos)[0]
+            pos += 4
+        data = patch[pos:pos + n]
+        pos += n
+        if len(data) != n:
+            raise ValueError(f"chunk @{off} truncated")
+        if has_crc and zlib.crc32(data) & 0xFFFFFFFF != crc:
+            raise ValueError(f"chunk @{off}: CRC mismatch")
+        if enc == ENC_LZ4:
+            end = lz4_decode_into(out, off, data)
+        else:
+            if enc == ENC_COPY:
+                src, count = struct.unpack("<II", data)
+                body = base[src:src + count]
+            elif enc & (ENC_F_XOR | ENC_F_SUB):
+                src = struct.unpack_from("<I", data)[0]
+                res = data[4:] if enc & 0x0F == ENC_RAW else rle_decode(data[4:])
+                ref = base[src:src + len(res)]
+                if enc & ENC_F_XOR:
+                    body = bytes(r ^ b for r, b in zip(res, ref))
+                else:
+                    body = bytes((r + b) & 0xFF for r, b in zip(res, ref))
+            elif enc == ENC_RLE:
+                body = rle_decode(data)
+            elif enc == ENC_RAW:
+                body = data
+            else:
+                raise ValueError(f"chunk @{off}: unknown encoding {enc}")
+            end = off + len(body)
+            out[off:end] = body
+        if end > target_len:
+            raise ValueError(f"chunk @{off} runs past the target")
+    result = bytes(out)
+    if tgt_chk != image_digest(result, name):
+        raise ValueError("target digest mismatch after apply")
+    return result
+
+
+def parse_meta(patch: bytes) -> dict:
+    """Metadata TLVs of a serialized patch as {tag: int value}."""
+    hdr_len = struct.calcsize(HDR_FMT)
+    meta_len = struct.unpack_from(HDR_FMT, patch)[7]
+    meta = patch[hdr_len:hdr_len + meta_len]
+    out = {}
+    i = 0
+    while i + 2 <= len(meta):
+        tag, n = meta[i], meta[i + 1]
+        out[tag] = int.from_bytes(meta[i + 2:i + 2 + n], "little")
+        i += 2 + n
+    return out
+
+
+def run_squash(args, base_path: str, patch_paths) -> None:
+    """Squash a chain of patches (v1->v2, v2->v3, ...) into one v1->vN patch.
+
+    Replays the chain on the host and diffs the base against the final
+    image, so a device that missed several releases catches up with one
+    apply: one slot copy, one flip, each sector written at most once. Only
+    the base and the released patches are needed, not the intermediate
+    models. Metadata TLVs come from the last patch unless overridden.
+    """
+    with open(base_path, "rb") as f:
+        base = f.read()
+    image = base
+    for path in patch_paths:
+        with open(path, "rb") as f:
+            patch = f.read()
+        try:
+            image = apply_patch(image, patch)
+        except ValueError as e:
+            raise SystemExit(f"[squash] {path}: {e}")
+        print(f"[squash] {path}: {len(image)} bytes")
+    last = parse_meta(patch)
+    for key, tag in (("req_arena", TMD_META_REQ_ARENA_BYTES),
+                     ("tflm_abi", TMD_META_TFLM_ABI),
+                     ("opset_hash", TMD_META_OPSET_HASH),
+                     ("io_hash", TMD_META_IO_HASH)):
+        if getattr(args, key) is None and tag in last:
+            setattr(args, key, last[tag])
+    tinfo = target_info(args, image)
+    out, n_chunks, enc_bytes = build_patch(args, base, image, tinfo)
+    with open(args.squash, "wb") as f:
+        f.write(out)
+    print(f"Squashed {len(patch_paths)} patches: {args.squash} "
+          f"({len(out)} bytes, {n_chunks} chunks, {enc_bytes} encoded bytes)")
+
+
+# --------------------------------------------------------------------------- #
+#                        Bundle (one target, N bases)                         #
+# --------------------------------------------------------------------------- #
+
+_bundle_ctx = {}
+
+
+def _bundle_init(args, target: bytes, tinfo: dict) -> None:
+    """Process-pool initializer: ship the shared target state once per worker."""
+    _bundle_ctx.update(args=args, target=target, tinfo=tinfo)
+
+
+def _bundle_one(job):
+    """Build one bundle patch; returns its manifest entry."""
+    base_path, out_path = job
+    args, target, tinfo = (_bundle_ctx["args"], _bundle_ctx["target"],
+                           _bundle_ctx["tinfo"])
+    with open(base_path, "rb") as f:
+        base = f.read()
+    patch, n_chunks, enc_bytes = build_patch(args, base, target, tinfo,
+                                             log=lambda *a, **k: None)
+    with open(out_path, "wb") as f:
+        f.write(patch)
+    return digest_key(base, args.algo), {
+        "base": base_path,
+        "base_len": len(base),
+        "patch": os.path.basename(out_path),
+        "patch_len": len(patch),
+        "chunks": n_chunks,
+        "encoded_bytes": enc_bytes,
+    }
+
+
+def run_bundle(args, target_path: str, base_paths) -> None:
+    """Generate one patch per base for a single target, in parallel.
+
+    Writes <out_dir>/<base key>.tmd for every base and a manifest.json that
+    maps each base key (digest_key(): what the device reports for its
+    installed model) to its patch, so an OTA server picks the delta with one
+    dictionary lookup.
+    """
+    out_dir = args.bundle
+    os.makedirs(out_dir, exist_ok=True)
+    with open(target_path, "rb") as f:
+        target = f.read()
+    tinfo = target_info(args, target)
+
+    jobs = []
+    for i, path in enumerate(base_paths):
+        jobs.append((path, os.path.join(out_dir, f"patch_{i:04d}.tmd")))
+
+    patches = {}
+    with ProcessPoolExecutor(max_workers=args.jobs or None,
+                             initializer=_bundle_init,
+                             initargs=(args, target, tinfo)) as pool:
+        for key, entry in pool.map(_bundle_one, jobs):
+            if key in patches:
+                # Same base content twice: keep one patch.
+                os.remove(os.path.join(out_dir, entry["patch"]))
+                continue
+            final = os.path.join(out_dir, f"{key}.tmd")
+            os.replace(os.path.join(out_dir, entry["patch"]), final)
+            entry["patch"] = os.path.basename(final)
+            patches[key] = entry
+            print(f"[bundle] {entry['base']} -> {entry['patch']} "
+                  f"({entry['patch_len']} bytes, {entry['chunks']} chunks)")
+
+    req_arena, tflm_abi, opset, io_hash = tinfo["resolved"]
+    manifest = {
+        "format": 1,
+        "key_algo": "crc32" if args.algo == "crc32" else "sha256",
+        "target": {
+            "path": target_path,
+            "len": len(target),
+            "key": tinfo["key"],
+            "meta": {
+                "req_arena": req_arena,
+                "tflm_abi": tflm_abi,
+                "opset_hash": opset,
+                "io_hash": io_hash,
+            },
+        },
+        "patches": patches,
+    }
+    with open(os.path.join(out_dir, "manifest.json"), "w") as f:
+        json.dump(manifest, f, indent=2, sort_keys=True)
+    print(f"Bundle written: {out_dir}/manifest.json ({len(patches)} patches)")
+
+
+# --------------------------------------------------------------------------- #
+#                   Benchmark (corpus x encoders x planners)                  #
+# --------------------------------------------------------------------------- #
+
+#: --bench encoder sets: option overrides on top of the command line.
+BENCH_ENCODERS = {
+    "raw": {"no_rle": True},
+    "rle": {},
+    "lz4": {"lz4": True},
+    "copy": {"copy": True},
+    "delta": {"delta": True},
+    "tflite": {"tflite": True},
+    "all": {"lz4": True, "copy": True, "delta": True, "tflite": True},
+}
+
+#: --bench planner settings.
+BENCH_PLANS = {
+    "greedy": {"plan": "greedy"},
+    "dp-bytes": {"plan": "dp", "objective": "bytes"},
+    "dp-time": {"plan": "dp", "objective": "time"},
+    "dp-mix": {"plan": "dp", "objective": "mix"},
+}
+
+#: Report columns, in order.
+BENCH_FIELDS = ("base", "target", "encoder", "plan", "target_len",
+                "patch_bytes", "ratio", "chunks", "chunks_raw", "chunks_rle",
+                "chunks_lz4", "chunks_copy", "chunks_delta", "gen_ms",
+                "peak_kib", "apply_ms")
+
+
+def _bench_one(args, base: bytes, target: bytes, tinfo: dict) -> dict:
+    """Build one patch twice: timed, then under tracemalloc for the peak."""
+    def quiet(*a, **k):
+        return None
+
+    stats = {}
+    t0 = time.perf_counter()
+    patch, n_chunks, _ = build_patch(args, base, target, tinfo, log=quiet,
+                                     stats=stats)
+    gen_ms = (time.perf_counter() - t0) * 1000.0
+    tracemalloc.start()
+    try:
+        build_patch(args, base, target, tinfo, log=quiet)
+        peak = tracemalloc.get_traced_memory()[1]
+    finally:
+        tracemalloc.stop()
+    row = {
+        "target_len": len(target),
+        "patch_bytes": len(patch),
+        "ratio": round(len(target) / len(patch), 2),
+        "chunks": n_chunks,
+        "gen_ms": round(gen_ms, 1),
+        "peak_kib": round(peak / 1024.0, 1),
+        "apply_ms": round(stats["apply_us"] / 1000.0, 1),
+    }
+    for name in ("raw", "rle", "lz4", "copy", "delta"):
+        row[f"chunks_{name}"] = stats["encodings"].get(name, 0)
+    return row
+
+
+def run_bench(args, pairs) -> None:
+    """Build every (base, target) pair with every --bench-encoders set and
+    --bench-plans setting and write one row per patch to args.bench.
+
+    Patch size, generation time, peak Python heap during generation and
+    the modelled device apply time (estimate_plan() under the flash
+    profile) are reported; .json writes a list of rows, anything else CSV.
+    The cache is not used, so times are those of a cold build. The
+    tracemalloc pass makes a run several times slower than gen_ms.
+    """
+    encoders = [e for e in args.bench_encoders.split(",") if e]
+    plans = [p for p in args.bench_plans.split(",") if p]
+    for name in encoders:
+        if name not in BENCH_ENCODERS:
+            raise SystemExit(f"--bench-encoders: unknown {name!r} "
+                             f"(have {', '.join(BENCH_ENCODERS)})")
+    for name in plans:
+        if name not in BENCH_PLANS:
+            raise SystemExit(f"--bench-plans: unknown {name!r} "
+                             f"(have {', '.join(BENCH_PLANS)})")
+
+    rows = []
+    for base_path, target_path in pairs:
+        with open(base_path, "rb") as f:
+            base = f.read()
+        with open(target_path, "rb") as f:
+            target = f.read()
+        args.target = target_path
+        tinfo = target_info(args, target)
+        best = None
+        for enc in encoders:
+            for plan in plans:
+                run = argparse.Namespace(**vars(args))
+                run.cache = None
+                for k, v in dict(BENCH_ENCODERS[enc], **BENCH_PLANS[plan]).items():
+                    setattr(run, k, v)
+                row = {"base": base_path, "target": target_path,
+                       "encoder": enc, "plan": plan}
+                row.update(_bench_one(run, base, target, tinfo))
+                rows.append(row)
+                print(f"[bench] {os.path.basename(target_path)} {enc:<6} "
+                      f"{plan:<8} {row['patch_bytes']:>8} B "
+                      f"x{row['ratio']:<7} {row['gen_ms']:>8.1f} ms gen "
+                      f"{row['peak_kib']:>9.1f} KiB "
+                      f"{row['apply_ms']:>8.1f} ms apply")
+                if best is None or row["patch_bytes"] < best["patch_bytes"]:
+                    best = row
+        if best is not None:
+            print(f"[bench] {target_path}: smallest is {best['encoder']}/"
+                  f"{best['plan']} ({best['patch_bytes']} bytes)")
+
+    with open(args.bench, "w", newline="") as f:
+        if args.bench.endswith(".json"):
+            json.dump([{k: r[k] for k in BENCH_FIELDS} for r in rows], f,
+                      indent=2)
+            f.write("\n")
+        else:
+            w = csv.DictWriter(f, fieldnames=BENCH_FIELDS)
+            w.writeheader()
+            w.writerows(rows)
+    print(f"Benchmark written: {args.bench} ({len(rows)} rows)")
+
+
 # --------------------------------------------------------------------------- #
 #                              Main entry point                               #
 # --------------------------------------------------------------------------- #
@@ -243,22 +1637,78 @@ def main() -> None:
 
     It:
       1) Reads the base and target model bytes.
-      2) Computes byte-level diffs (and merges nearby runs).
-      3) Optionally derives TFLite metadata (arena, ABI, opset, I/O hash).
-      4) Applies manual metadata overrides, if provided.
-      5) Encodes everything into the TinyMLDelta patch wire format.
+      2) Derives the target digest and metadata TLVs (target_info()).
+      3) Diffs, plans and encodes the chunks (build_patch()).
+      4) Writes the patch, or with --bundle one patch per base plus a
+         manifest (run_bundle()).
     """
     ap = argparse.ArgumentParser(
         description="TinyMLDelta patch generator (TFLite-first)."
     )
-    ap.add_argument("base", help="base .tflite path (or any binary)")
-    ap.add_argument("target", help="target .tflite path (or any binary)")
-    ap.add_argument("out", help="output patch file path")
+    ap.add_argument(
+        "paths",
+        nargs="+",
+        metavar="PATH",
+        help="base.tflite target.tflite out.tmd; with --bundle: "
+             "target.tflite base1.tflite [base2.tflite ...]; with --bench: "
+             "base1 target1 [base2 target2 ...]; with --squash: "
+             "base.tflite patch1.tmd [patch2.tmd ...]",
+    )
+    ap.add_argument(
+        "--cache",
+        metavar="DIR",
+        default=None,
+        help="content-addressed cache of patches and chunk encodings; "
+             "re-runs on unchanged inputs return the stored patch",
+    )
+    ap.add_argument(
+        "--bundle",
+        metavar="OUT_DIR",
+        default=None,
+        help="fleet mode: one patch per base for a single target, plus "
+             "OUT_DIR/manifest.json mapping base digest -> patch",
+    )
+    ap.add_argument(
+        "--squash",
+        metavar="OUT",
+        default=None,
+        help="chain mode: replay the patches on the base and write one "
+             "base -> final patch to OUT",
+    )
+    ap.add_argument(
+        "--bench",
+        metavar="OUT",
+        default=None,
+        help="benchmark mode: PATHs are base/target pairs; build each with "
+             "every --bench-encoders set and --bench-plans setting and "
+             "write size, time, memory and apply estimate to OUT (.csv "
+             "or .json)",
+    )
+    ap.add_argument(
+        "--bench-encoders",
+        default="raw,rle,lz4,copy,delta,tflite,all",
+        help="encoder sets for --bench (default: all of "
+             "raw,rle,lz4,copy,delta,tflite,all)",
+    )
+    ap.add_argument(
+        "--bench-plans",
+        default="greedy,dp-bytes,dp-time",
+        help="planner settings for --bench: greedy, dp-bytes, dp-time, "
+             "dp-mix (default: greedy,dp-bytes,dp-time)",
+    )
+    ap.add_argument(
+        "-j",
+        "--jobs",
+        type=int,
+        default=0,
+        help="worker processes for --bundle (default: CPU count)",
+    )
     ap.add_argument(
         "--algo",
-        choices=["none", "crc32"],
+        choices=["none", "crc32", "sha256"],
         default="crc32",
-        help="header digest mode (default: crc32)",
+        help="header digest mode; must match the runtime's TMD_USE_* "
+             "(default: crc32)",
     )
     ap.add_argument(
         "--merge-gap",
@@ -272,6 +1722,90 @@ def main() -> None:
         default=8,
         help="coalesce tiny diffs into their predecessor if nearby",
     )
+    ap.add_argument(
+        "--plan",
+        choices=["greedy", "dp"],
+        default="greedy",
+        help="chunk planner: greedy --merge-gap/--min-chunk heuristics, or "
+             "dp to minimize --objective (default: greedy)",
+    )
+    ap.add_argument(
+        "--objective",
+        choices=["bytes", "time", "mix"],
+        default="bytes",
+        help="dp planner cost: wire bytes, device apply time, or "
+             "bytes + --mix-weight * milliseconds (default: bytes)",
+    )
+    ap.add_argument(
+        "--mix-weight",
+        type=float,
+        default=1.0,
+        help="bytes one millisecond of apply time is worth (objective=mix)",
+    )
+    ap.add_argument(
+        "--flash-profile",
+        default=None,
+        help="JSON file overriding DEFAULT_PROFILE timing keys",
+    )
+    ap.add_argument(
+        "--write-align",
+        type=int,
+        default=0,
+        help="flash program unit in bytes (TMD_ALIGN_WRITE); emits an "
+             "aligned layout (TMD_HDR_F_ALIGNED), as does --sector-size",
+    )
+    ap.add_argument(
+        "--sector-size",
+        type=int,
+        default=0,
+        help="flash erase sector in bytes (TMD_SECTOR_SZ); emits an "
+             "aligned layout (TMD_HDR_F_ALIGNED)",
+    )
+    ap.add_argument(
+        "--no-rle",
+        action="store_true",
+        help="never RLE-encode chunks (RAW baseline; LZ4/delta still "
+             "apply if enabled)",
+    )
+    ap.add_argument(
+        "--lz4",
+        action="store_true",
+        help="also try LZ4 per chunk and keep the smallest encoding "
+             "(runtime needs TMD_FEAT_LZ4TINY)",
+    )
+    ap.add_argument(
+        "--tflite",
+        action="store_true",
+        help="structure-aware diff: match tensor buffers by name across "
+             "re-layouts and COPY their unchanged parts (runtime needs "
+             "TMD_FEAT_COPY)",
+    )
+    ap.add_argument(
+        "--delta",
+        action="store_true",
+        help="try XOR/SUB residual chunks against the base bytes (the "
+             "matched buffer with --tflite); runtime needs TMD_FEAT_DELTA",
+    )
+    ap.add_argument(
+        "--in-place",
+        action="store_true",
+        help="build for a single-slot device patched in place "
+             "(tmd_layout_t.in_place); COPY/delta sources are kept within "
+             "reach of the device's swap sector (--sector-size, default "
+             "from the flash profile)",
+    )
+    ap.add_argument(
+        "--copy",
+        action="store_true",
+        help="emit COPY chunks for data that moved within the base "
+             "(runtime needs TMD_FEAT_COPY)",
+    )
+    ap.add_argument(
+        "--min-copy",
+        type=int,
+        default=32,
+        help="shortest run turned into a COPY chunk (with --copy)",
+    )
 
     # Auto metadata from the target TFLite model
     ap.add_argument(
@@ -314,128 +1848,55 @@ def main() -> None:
 
     args = ap.parse_args()
 
+    if args.bench:
+        if len(args.paths) < 2 or len(args.paths) % 2:
+            ap.error("--bench needs base/target pairs")
+        run_bench(args, list(zip(args.paths[0::2], args.paths[1::2])))
+        return
+    if args.squash:
+        if len(args.paths) < 2:
+            ap.error("--squash needs a base and at least one patch")
+        if args.auto_meta:
+            ap.error("--squash takes metadata from the last patch, not "
+                     "--auto-meta")
+        run_squash(args, args.paths[0], args.paths[1:])
+        return
+    if args.bundle:
+        if len(args.paths) < 2:
+            ap.error("--bundle needs a target and at least one base")
+        args.target = args.paths[0]
+        run_bundle(args, args.paths[0], args.paths[1:])
+        return
+    if len(args.paths) != 3:
+        ap.error("expected: base target out")
+    args.base, args.target, args.out = args.paths
+
     # 1) Load models
     with open(args.base, "rb") as f:
         base = f.read()
     with open(args.target, "rb") as f:
         target = f.read()
 
-    # 2) Compute raw diffs
-    diffs = find_diffs(base, target, merge_gap=args.merge_gap)
-
-    # 3) Coalesce very small diffs into their predecessor if close enough
-    coalesced = []
-    for off, data in diffs:
-        if (
-            coalesced
-            and (len(data) < args.min_chunk)
-            and (off <= coalesced[-1][0] + len(coalesced[-1][1]) + args.merge_gap)
-        ):
-            prev_off, prev_data = coalesced[-1]
-            gap = target[prev_off + len(prev_data):off]
-            coalesced[-1] = (prev_off, prev_data + gap + data)
-        else:
-            coalesced.append((off, data))
-    diffs = coalesced
-
-    # 4) Header digests
-    if args.algo == "crc32":
-        base_chk = struct.pack("<I", zlib.crc32(base) & 0xFFFFFFFF) + b"\x00" * 28
-        tgt_chk = struct.pack("<I", zlib.crc32(target) & 0xFFFFFFFF) + b"\x00" * 28
-        algo = ALGO_CRC32
-        chunk_has_crc = 1
-    else:
-        base_chk = b"\x00" * 32
-        tgt_chk = b"\x00" * 32
-        algo = ALGO_NONE
-        chunk_has_crc = 0
-
-    # 5) Auto metadata (TFLite-aware), if requested
-    auto_req_arena = auto_abi = auto_opset = auto_io = None
-    if args.auto_meta:
-        if compute_from_tflite is None:
-            print("[TinyMLDelta] Warning: auto-meta requested but "
-                  "tinymldelta_meta_compute.compute_from_tflite() is unavailable.")
-        else:
-            try:
-                auto_abi, auto_opset, auto_io, auto_req_arena = compute_from_tflite(
-                    args.target,
-                    None
-                    if args.arena_factor is None or args.arena_factor <= 0
-                    else float(args.arena_factor),
-                )
-            except Exception as e:
-                print(f"[TinyMLDelta] Auto-metadata unavailable: {e}")
-                auto_req_arena = auto_abi = auto_opset = auto_io = None
-
-    # 6) Manual overrides take precedence over auto-meta
-    req_arena = args.req_arena if args.req_arena is not None else (auto_req_arena or 0)
-    tflm_abi = args.tflm_abi if args.tflm_abi is not None else (auto_abi or 0)
-    opset = args.opset_hash if args.opset_hash is not None else (auto_opset or 0)
-    io_hash = args.io_hash if args.io_hash is not None else (auto_io or 0)
-
-    # 7) Build metadata TLVs
-    meta = bytearray()
-    if req_arena and req_arena > 0:
-        meta += tlv(TMD_META_REQ_ARENA_BYTES, struct.pack("<I", int(req_arena)))
-    if tflm_abi and tflm_abi > 0:
-        meta += tlv(TMD_META_TFLM_ABI, struct.pack("<H", int(tflm_abi & 0xFFFF)))
-    if opset and opset > 0:
-        meta += tlv(TMD_META_OPSET_HASH, struct.pack("<I", int(opset & 0xFFFFFFFF)))
-    if io_hash and io_hash > 0:
-        meta += tlv(TMD_META_IO_HASH, struct.pack("<I", int(io_hash & 0xFFFFFFFF)))
-
-    v = 1
-    meta_len = len(meta)
-    flags = 0
+    # 2-3) Target digest + metadata, then diff / plan / encode
+    tinfo = target_info(args, target)
+    patch, n_chunks, enc_bytes = build_patch(args, base, target, tinfo)
 
-    # 8) Encode chunks with optional RLE
-    chunks = []
-    for off, raw in diffs:
-        rle = rle_encode(raw)
-        if len(rle) < len(raw):
-            enc = ENC_RLE
-            data = rle
-        else:
-            enc = ENC_RAW
-            data = raw
-        chunks.append((off, enc, data))
-
-    # 9) Write final patch
+    # 4) Write final patch
     with open(args.out, "wb") as out:
-        hdr = struct.pack(
-            HDR_FMT,
-            v,
-            algo,
-            len(chunks),
-            len(base),
-            len(target),
-            base_chk,
-            tgt_chk,
-            meta_len,
-            flags,
-        )
-        out.write(hdr)
-        if meta_len:
-            out.write(meta)
-        for off, enc, data in chunks:
-            chdr = struct.pack(CHUNK_FMT, off, len(data), enc, chunk_has_crc)
-            out.write(chdr)
-            if chunk_has_crc:
-                out.write(struct.pack("<I", zlib.crc32(data) & 0xFFFFFFFF))
-            out.write(data)
+        out.write(patch)
 
     print(f"TinyMLDelta patch written: {args.out}")
     print(
-        f"Chunks: {len(chunks)}  "
-        f"Encoded bytes: {sum(len(d) for _, _, d in chunks)}  "
-        f"Meta: {meta_len} bytes"
+        f"Chunks: {n_chunks}  "
+        f"Encoded bytes: {enc_bytes}  "
+        f"Meta: {len(tinfo['meta'])} bytes"
     )
 
-    # 10) Debug header dump (so you can see what runtime will parse)
+    # 5) Debug header dump (so you can see what runtime will parse)
     debug_print_patch_header(args.out)
 
     if args.auto_meta:
+        req_arena, tflm_abi, opset, io_hash = tinfo["resolved"]
         print(
             f"Auto-meta (resolved): req_arena={req_arena} bytes, "
             f"tflm_abi={tflm_abi}, opset_hash=0x{opset:08x}, io_hash=0x{io_hash:08x}"
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+@file tinymldelta_tflite.py
+@brief TinyMLDelta — Minimal TFLite FlatBuffer reader for structure-aware diffs.
+@author Felix Galindo
+@license Apache-2.0
+
+Reads just enough of the TFLite schema to locate each constant tensor
+buffer in a .tflite file and give it a stable identity:
+
+    Model.subgraphs[].tensors[] -> (name, buffer index)
+    Model.buffers[]             -> data vector (or offset/size for models
+                                   with buffers stored after the FlatBuffer)
+
+It is self-contained (no `tflite` / `flatbuffers` packages), so the patch
+generator can align buffers on any host. Only the fields listed above are
+read; everything else in the schema is ignored.
+"""
+
+import struct
+from typing import Dict, List, Optional, Tuple
+
+# Field slots (schema.fbs declaration order).
+_MODEL_SUBGRAPHS = 2
+_MODEL_BUFFERS = 4
+_SUBGRAPH_TENSORS = 0
+_TENSOR_BUFFER = 2
+_TENSOR_NAME = 3
+_BUFFER_DATA = 0
+_BUFFER_OFFSET = 1
+_BUFFER_SIZE = 2
+
+
+class _Table:
+    """A FlatBuffer table: fields are located through its vtable."""
+
+    def __init__(self, buf: bytes, pos: int):
+        self.buf = buf
+        self.pos = pos
+        self.vt = pos - struct.unpack_from("<i", buf, pos)[0]
+        self.vt_size = struct.unpack_from("<H", buf, self.vt)[0]
+
+    def _field(self, slot: int) -> int:
+        o = 4 + 2 * slot
+        if o >= self.vt_size:
+            return 0
+        rel = struct.unpack_from("<H", self.buf, self.vt + o)[0]
+        return self.pos + rel if rel else 0
+
+    def scalar(self, slot: int, fmt: str, default=0):
+        p = self._field(slot)
+        return struct.unpack_from(fmt, self.buf, p)[0] if p else default
+
+    def _deref(self, slot: int) -> int:
+        p = self._field(slot)
+        return p + struct.unpack_from("<I", self.buf, p)[0] if p else 0
+
+    def vector(self, slot: int) -> Optional[Tuple[int, int]]:
+        """(first element position, element count) of a vector field."""
+        v = self._deref(slot)
+        if not v:
+            return None
+        n = struct.unpack_from("<I", self.buf, v)[0]
+        return v + 4, n
+
+    def tables(self, slot: int) -> List["_Table"]:
+        vec = self.vector(slot)
+        if vec is None:
+            return []
+        start, n = vec
+        out = []
+        for i in range(n):
+            e = start + 4 * i
+            out.append(_Table(self.buf, e + struct.unpack_from("<I", self.buf, e)[0]))
+        return out
+
+    def string(self, slot: int) -> Optional[str]:
+        vec = self.vector(slot)
+        if vec is None:
+            return None
+        start, n = vec
+        return self.buf[start:start + n].decode("utf-8", "replace")
+
+
+def buffer_regions(model: bytes) -> Dict[str, Tuple[int, int]]:
+    """Map each identifiable constant buffer to its (file offset, length).
+
+    A buffer's identity is the set of tensor names that reference it
+    (e.g. "0:dense/kernel"), which survives re-serialization even when the
+    buffer index or file offset changes. Empty buffers, unreferenced
+    buffers and identities shared by several buffers are left out.
+
+    Raises:
+        ValueError: @p model is not a readable TFLite FlatBuffer.
+    """
+    if len(model) < 8 or model[4:8] != b"TFL3":
+        raise ValueError("not a TFLite model (missing TFL3 identifier)")
+    try:
+        root = _Table(model, struct.unpack_from("<I", model, 0)[0])
+
+        names: Dict[int, List[str]] = {}
+        for sg_idx, sg in enumerate(root.tables(_MODEL_SUBGRAPHS)):
+            for t in sg.tables(_SUBGRAPH_TENSORS):
+                b = t.scalar(_TENSOR_BUFFER, "<I", 0)
+                name = t.string(_TENSOR_NAME) or ""
+                names.setdefault(b, []).append(f"{sg_idx}:{name}")
+
+        regions: Dict[str, Tuple[int, int]] = {}
+        dup = set()
+        for b_idx, b in enumerate(root.tables(_MODEL_BUFFERS)):
+            data = b.vector(_BUFFER_DATA)
+            if data is not None and data[1] > 0:
+                off, n = data
+            else:
+                off = b.scalar(_BUFFER_OFFSET, "<Q", 0)
+                n = b.scalar(_BUFFER_SIZE, "<Q", 0)
+            if n == 0 or b_idx not in names or off + n > len(model):
+                continue
+            key = "|".join(sorted(names[b_idx]))
+            if key in regions:
+                dup.add(key)
+            regions[key] = (off, n)
+        for key in dup:
+            del regions[key]
+        return regions
+    except (struct.error, IndexError) as e:
+        raise ValueError(f"malformed TFLite FlatBuffer: {e}") from e
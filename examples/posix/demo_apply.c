@@ -5,8 +5,8 @@
  * This is a small command-line utility used by the POSIX demo environment.
  *
  * It demonstrates how an embedded device would:
- *   1) Load a TinyMLDelta patch from disk (simulating OTA receive)
- *   2) Pass the patch to the TinyMLDelta core engine
+ *   1) Receive a TinyMLDelta patch in small frames (simulating OTA receive)
+ *   2) Feed each frame to the TinyMLDelta core engine as it arrives
  *   3) Allow the core to update an inactive flash slot safely
  *   4) Atomically flip the active slot if all checks pass
  *
@@ -15,120 +15,372 @@
  * POSIX port (tinymldelta_ports_posix.c).
  *
  * Usage:
- *      ./demo_apply flash.bin patch.tmd
+ *      ./demo_apply [--inspect] [--mmap] [--prepare] [--step BYTES]
+ *                   [--cut OP] flash.bin patch.tmd
  *
- * This mimics how a real MCU would consume a downloaded patch.
+ * This mimics how a real MCU would consume a downloaded patch. With --mmap
+ * the patch is instead memory-mapped and applied in one call, the way a
+ * device with the patch already in XIP flash (e.g. a download partition)
+ * would: RAW payloads are then written straight from the mapping.
+ *
+ * With --prepare the inactive slot is first readied by tmd_prepare_slot_ctx(),
+ * one sector erase per call as idle time would allow, so the apply itself
+ * only programs.
+ *
+ * With --step the mapped patch is applied by tmd_apply_step() in slices of
+ * BYTES of work, the way a device would interleave the update with its
+ * inference loop.
+ *
+ * With --inspect the patch is first checked by tmd_inspect_patch(), without
+ * touching flash, and its estimated cost printed; a patch that would fail
+ * is rejected before the apply starts.
+ *
+ * With --cut the process stops as if power were lost during the OP-th flash
+ * erase or program (tmd_posix_set_power_cut()); running the same command
+ * without it resumes the update.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "tinymldelta.h"
 #include "tinymldelta_ports.h"
 
 /*
- * These functions are implemented in tinymldelta_ports_posix.c.
+ * POSIX port helpers (tinymldelta_ports_posix.c). They configure where the
+ * simulated flash storage is (flash.bin) and where the port stores/reads
+ * the "active slot" index; the TinyMLDelta runtime then reaches flash, the
+ * active slot, the journal and the logger through the tmd_ports_t table.
+ */
+#include "tinymldelta_ports_posix.h"
+
+/*
+ * Patch bytes are handed to the core in frames of this size, mimicking the
+ * payload of a BLE/LTE transfer. The patch is never held in RAM as a whole.
+ */
+#ifndef DEMO_FRAME_SZ
+#define DEMO_FRAME_SZ 128
+#endif
+
+/**
+ * @brief Stream a patch file into the TinyMLDelta core frame by frame.
  *
- * They configure:
- *   - Where the simulated flash storage is (flash.bin)
- *   - Where the POSIX port stores/reads the "active slot" index
+ * In a real MCU the frames would come from the OTA transport instead of a
+ * file; the core consumes them the same way.
  *
- * The TinyMLDelta runtime calls the port layer when it needs to:
- *   - read/erase/write flash
- *   - update active slot
- *   - use journaling for crash-safe updates
- *   - print log messages
+ * @param path  Path to the .tmd patch file
+ * @param ctx   Streaming context (left readable for tmd_stream_stats())
+ * @return TinyMLDelta status (TMD_STATUS_ERR_PARAM if the file can't be read)
  */
-void tmd_posix_set_flash_path(const char* path);
-void tmd_posix_set_active_slot_path(const char* path);
+static tmd_status_t stream_patch_file(const char* path, tmd_stream_t* ctx) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "Failed to read patch file: %s\n", path);
+    return TMD_STATUS_ERR_PARAM;
+  }
+
+  uint8_t frame[DEMO_FRAME_SZ];
+  tmd_status_t st = TMD_STATUS_OK;
+  while (st == TMD_STATUS_OK) {
+    size_t n = fread(frame, 1, sizeof(frame), f);
+    if (n == 0)
+      break;
+    st = tmd_stream_feed(ctx, frame, n);
+  }
+  if (st == TMD_STATUS_OK && ferror(f))
+    st = TMD_STATUS_ERR_PARAM;
+  fclose(f);
+
+  if (st == TMD_STATUS_OK)
+    st = tmd_stream_finish(ctx);
+  return st;
+}
+
+/**
+ * @brief Map a patch file read-only.
+ *
+ * @return The mapping (*len bytes), or NULL if the file can't be mapped.
+ */
+static const uint8_t* map_patch_file(const char* path, size_t* len) {
+  struct stat sb;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &sb) != 0 || sb.st_size <= 0) {
+    fprintf(stderr, "Failed to read patch file: %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  void* v = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (v == MAP_FAILED) {
+    fprintf(stderr, "Failed to map patch file: %s\n", path);
+    return NULL;
+  }
+  *len = (size_t)sb.st_size;
+  return (const uint8_t*)v;
+}
 
 /**
- * @brief Load any file fully into memory.
+ * @brief Apply a patch file straight from a read-only memory mapping.
  *
- * This helper is used to read *.tmd patch files completely into RAM so that
- * the TinyMLDelta core can parse and apply them. In a real MCU, patches
- * may arrive via OTA and be streamed instead—this is purely for demo purposes.
+ * Stands in for a patch stored in memory-mapped flash: nothing is copied
+ * into RAM, and the core hands RAW payloads to flash_write() directly from
+ * the mapped bytes.
  *
- * @param path     Path to file
- * @param out_buf  Returned buffer (malloc'ed)
- * @param out_len  Returned length
- * @return 0 on success, -1 on failure
+ * @param path  Path to the .tmd patch file
+ * @param ctx   Streaming context (left readable for tmd_stream_stats())
+ * @return TinyMLDelta status (TMD_STATUS_ERR_PARAM if the file can't be mapped)
  */
-static int load_file(const char* path, uint8_t** out_buf, size_t* out_len) {
-  struct stat st;
-  if (stat(path, &st) != 0)
-    return -1;
+static tmd_status_t apply_mapped_patch_file(const char* path,
+                                            tmd_stream_t* ctx) {
+  size_t len = 0;
+  const uint8_t* p = map_patch_file(path, &len);
+  if (!p)
+    return TMD_STATUS_ERR_PARAM;
 
-  FILE* f = fopen(path, "rb");
-  if (!f)
-    return -1;
+  tmd_status_t st = tmd_apply_patch_ctx(ctx, p, len);
+  munmap((void*)p, len);
+  return st;
+}
 
-  uint8_t* buf = (uint8_t*)malloc((size_t)st.st_size);
-  if (!buf) {
-    fclose(f);
-    return -1;
-  }
+/**
+ * @brief Apply a memory-mapped patch file in time slices (tmd_apply_step()).
+ *
+ * @param path   Path to the .tmd patch file
+ * @param ctx    Streaming context (left readable for tmd_stream_stats())
+ * @param budget Work per tmd_apply_step() call, in bytes
+ * @param steps  Number of tmd_apply_step() calls made
+ * @return TinyMLDelta status (TMD_STATUS_ERR_PARAM if the file can't be mapped)
+ */
+static tmd_status_t apply_stepped_patch_file(const char* path,
+                                             tmd_stream_t* ctx,
+                                             uint32_t budget,
+                                             unsigned* steps) {
+  size_t len = 0;
+  const uint8_t* p = map_patch_file(path, &len);
+  if (!p)
+    return TMD_STATUS_ERR_PARAM;
 
-  if (fread(buf, 1, (size_t)st.st_size, f) != (size_t)st.st_size) {
-    fclose(f);
-    free(buf);
-    return -1;
+  tmd_status_t st = tmd_apply_begin(ctx, p, len);
+  *steps = 0;
+  if (st == TMD_STATUS_OK) {
+    do {
+      /* A device would run an inference between the steps. */
+      st = tmd_apply_step(ctx, budget);
+      ++*steps;
+    } while (st == TMD_STATUS_PENDING);
   }
+  munmap((void*)p, len);
+  return st;
+}
 
-  fclose(f);
-  *out_buf = buf;
-  *out_len = (size_t)st.st_size;
-  return 0;
+/**
+ * @brief Ready the inactive slot for a patch file ahead of the apply, in
+ *        steps of one sector erase (tmd_prepare_slot_ctx()).
+ *
+ * On a device each step would run in idle time between inferences.
+ *
+ * @param path  Path to the .tmd patch file
+ * @param ctx   Context to prepare in (reused by the apply afterwards)
+ * @param steps Number of tmd_prepare_slot_ctx() calls made
+ * @return TinyMLDelta status (TMD_STATUS_ERR_PARAM if the file can't be mapped)
+ */
+static tmd_status_t prepare_patch_file(const char* path, tmd_stream_t* ctx,
+                                       unsigned* steps) {
+  size_t len = 0;
+  const uint8_t* p = map_patch_file(path, &len);
+  if (!p)
+    return TMD_STATUS_ERR_PARAM;
+
+  tmd_status_t st;
+  *steps = 0;
+  do {
+    st = tmd_prepare_slot_ctx(ctx, p, len, 1);
+    ++*steps;
+  } while (st == TMD_STATUS_PENDING);
+  munmap((void*)p, len);
+  return st;
+}
+
+/**
+ * @brief Check a patch file with tmd_inspect_patch() and print its summary.
+ *
+ * @param path  Path to the .tmd patch file
+ * @return TinyMLDelta status; a failed guardrail is reported as
+ *         TMD_STATUS_ERR_GUARDRAIL
+ */
+static tmd_status_t inspect_patch_file(const char* path) {
+  size_t len = 0;
+  const uint8_t* p = map_patch_file(path, &len);
+  if (!p)
+    return TMD_STATUS_ERR_PARAM;
+
+  tmd_patch_info_t info;
+  tmd_status_t st = tmd_inspect_patch(p, len, &info);
+  munmap((void*)p, len);
+  if (st == TMD_STATUS_OK || st == TMD_STATUS_PENDING)
+    fprintf(stdout,
+            "Inspect: %u/%u chunks, %lu payload -> %lu target bytes, "
+            "%lu of %lu sectors touched, ~%lu erase / %lu program bytes, "
+            "guardrails %s\n",
+            (unsigned)info.chunks_checked, (unsigned)info.chunks,
+            (unsigned long)info.payload_bytes, (unsigned long)info.write_bytes,
+            (unsigned long)info.touched_sectors,
+            (unsigned long)info.image_sectors,
+            (unsigned long)info.erase_bytes, (unsigned long)info.program_bytes,
+            info.guardrail == TMD_STATUS_OK ? "ok" : "FAILED");
+  if (st == TMD_STATUS_OK && info.guardrail != TMD_STATUS_OK)
+    st = TMD_STATUS_ERR_GUARDRAIL;
+  return st;
+}
+
+/**
+ * @brief Print the core's apply statistics (TMD_FEAT_STATS builds only).
+ */
+static void print_stats(const tmd_stream_t* ctx) {
+  static const char* const names[TMD_PHASE_N] = {
+    "parse", "guard", "copy", "decode", "crc", "write", "journal"
+  };
+  static const char* const bins[TMD_STATS_HIST_N] = {
+    "<=16", "<=64", "<=256", "<=1K", "<=4K", ">4K"
+  };
+  tmd_stats_t s;
+  if (tmd_stream_stats(ctx, &s) != TMD_STATUS_OK)
+    return;
+
+  fprintf(stdout, "Core time (us):");
+  for (int i = 0; i < TMD_PHASE_N; ++i)
+    fprintf(stdout, " %s=%lu", names[i], (unsigned long)s.phase_us[i]);
+  fprintf(stdout, "\nCore I/O: read %lu bytes in %lu ops, wrote %lu, erased %lu in %lu ops\n",
+          (unsigned long)s.bytes_read, (unsigned long)s.reads,
+          (unsigned long)s.bytes_written, (unsigned long)s.bytes_erased,
+          (unsigned long)s.erases);
+  fprintf(stdout, "Core writes by size:");
+  for (int i = 0; i < TMD_STATS_HIST_N; ++i)
+    fprintf(stdout, " %s:%lu", bins[i], (unsigned long)s.write_hist[i]);
+  fprintf(stdout, "\n");
 }
 
 int main(int argc, char** argv) {
-  if (argc != 3) {
+  int inspect = 0;
+  int mapped = 0;
+  int prepare = 0;
+  unsigned long step = 0;
+  unsigned long cut = 0;
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi) {
+    if (strcmp(argv[argi], "--inspect") == 0)
+      inspect = 1;
+    else if (strcmp(argv[argi], "--mmap") == 0)
+      mapped = 1;
+    else if (strcmp(argv[argi], "--prepare") == 0)
+      prepare = 1;
+    else if (strcmp(argv[argi], "--step") == 0 && argi + 1 < argc &&
+             (step = strtoul(argv[argi + 1], NULL, 0)) > 0)
+      ++argi;
+    else if (strcmp(argv[argi], "--cut") == 0 && argi + 1 < argc &&
+             (cut = strtoul(argv[argi + 1], NULL, 0)) > 0)
+      ++argi;
+    else
+      break;
+  }
+  if (argc - argi != 2) {
     fprintf(stderr,
-            "Usage: %s flash.bin patch.tmd\n"
+            "Usage: %s [--inspect] [--mmap] [--prepare] [--step BYTES] "
+            "[--cut OP] flash.bin patch.tmd\n"
             "Example:\n"
             "    ./demo_apply flash.bin patch.tmd\n",
             argv[0]);
     return 1;
   }
 
-  const char* flash_path = argv[1];
-  const char* patch_path = argv[2];
+  const char* flash_path = argv[argi];
+  const char* patch_path = argv[argi + 1];
 
   /*
    * Tell the POSIX port where the simulated flash file lives.
    * The TinyMLDelta core will read/write flash via the tmd_ports_t interface.
    */
-  tmd_posix_set_flash_path(flash_path);
+  if (tmd_posix_set_flash_path(flash_path) != 0) {
+    fprintf(stderr, "Failed to open flash image: %s\n", flash_path);
+    return 1;
+  }
 
   /*
    * The POSIX demo stores the "active slot index" in a small text file.
    * This mimics how a bootloader might store slot state in NVM.
    */
   tmd_posix_set_active_slot_path("active_slot.txt");
+  tmd_posix_set_power_cut((uint32_t)cut);
 
-  uint8_t* patch = NULL;
-  size_t patch_len = 0;
-
-  if (load_file(patch_path, &patch, &patch_len) != 0) {
-    fprintf(stderr, "Failed to read patch file: %s\n", patch_path);
-    return 1;
+  if (inspect) {
+    tmd_status_t ist = inspect_patch_file(patch_path);
+    if (ist != TMD_STATUS_OK) {
+      tmd_posix_flash_close();
+      fprintf(stderr, "Patch rejected by inspection (status %d)\n", (int)ist);
+      return 2;
+    }
   }
 
   /*
-   * Apply the patch from memory.
+   * Stream the patch into the core.
    *
    * Internally, TinyMLDelta will:
-   *   - Parse the patch header + TLVs
+   *   - Parse the patch header + TLVs as they arrive
    *   - Validate compatibility guardrails (arena, ABI, opset, IO schema)
    *   - Validate integrity digests (CRC32)
    *   - Write to the inactive slot
    *   - Update journaling for crash safety
    *   - Atomically flip active slot on success
    */
-  tmd_status_t st = tmd_apply_patch_from_memory(patch, patch_len);
-  free(patch);
+  tmd_stream_t ctx;
+  tmd_status_t st = TMD_STATUS_OK;
+  tmd_posix_flash_stats_t ps = {0};
+  if (prepare) {
+    unsigned steps = 0;
+    st = prepare_patch_file(patch_path, &ctx, &steps);
+    tmd_posix_flash_stats(&ps);
+    if (st == TMD_STATUS_ERR_UNSUPPORTED) {
+      /* No journal, or an in-place layout: the apply erases as it goes. */
+      fprintf(stdout, "Slot prepare not available, applying directly\n");
+      st = TMD_STATUS_OK;
+    } else if (st != TMD_STATUS_OK) {
+      tmd_posix_flash_close();
+      fprintf(stderr, "Slot prepare failed with status %d\n", (int)st);
+      return 2;
+    } else {
+      fprintf(stdout, "Slot prepared in %u steps: %lu erases, %lu writes\n",
+              steps, (unsigned long)ps.erases, (unsigned long)ps.writes);
+    }
+  }
+  unsigned steps = 0;
+  if (st == TMD_STATUS_OK && step > 0)
+    st = apply_stepped_patch_file(patch_path, &ctx, (uint32_t)step, &steps);
+  else if (st == TMD_STATUS_OK && mapped)
+    st = apply_mapped_patch_file(patch_path, &ctx);
+  else if (st == TMD_STATUS_OK) {
+    st = tmd_stream_init(&ctx);
+    if (st == TMD_STATUS_OK)
+      st = stream_patch_file(patch_path, &ctx);
+  }
+
+  tmd_posix_flash_stats_t fs;
+  tmd_posix_flash_stats(&fs);
+  tmd_posix_flash_close();
+  /* Report the apply's own traffic; the prepare was printed above. */
+  fs.erases -= ps.erases;
+  fs.erase_bytes -= ps.erase_bytes;
+  fs.writes -= ps.writes;
+  fs.write_bytes -= ps.write_bytes;
+  fs.busy_us -= ps.busy_us;
 
   if (st != TMD_STATUS_OK) {
     fprintf(stderr, "Patch apply failed with status %d\n", (int)st);
@@ -136,5 +388,14 @@ int main(int argc, char** argv) {
   }
 
   fprintf(stdout, "Patch applied successfully.\n");
+  if (steps > 0)
+    fprintf(stdout, "Applied in %u steps of %lu bytes of work\n", steps, step);
+  fprintf(stdout,
+          "Flash: %lu erases (%llu bytes), %lu writes (%llu bytes), "
+          "~%llu ms modelled busy time\n",
+          (unsigned long)fs.erases, (unsigned long long)fs.erase_bytes,
+          (unsigned long)fs.writes, (unsigned long long)fs.write_bytes,
+          (unsigned long long)(fs.busy_us / 1000u));
+  print_stats(&ctx);
   return 0;
 }
@@ -9,10 +9,10 @@
  * License: Apache-2.0
  *
  * -----------------------------------------------------------------------------
- * FLASH MAP (POSIX DEMO — 256 KiB total)
+ * FLASH MAP (POSIX DEMO — 260 KiB total)
  * -----------------------------------------------------------------------------
  *
- *   flash.bin total size: 256 KiB (262144 bytes)
+ *   flash.bin total size: 260 KiB (266240 bytes)
  *
  *   +---------------------------+ 0x00000 (0 KiB)
  *   |         Slot A           |
@@ -22,12 +22,18 @@
  *   |         Slot B           |
  *   |     128 KiB region       |
  *   | (inactive/target write)  |
- *   +---------------------------+ 0x40000 (256 KiB)  <-- End of flash
+ *   +---------------------------+ 0x40000 (256 KiB)
+ *   |      Meta / journal      |
+ *   |   4 KiB (one sector)     |
+ *   +---------------------------+ 0x41000 (260 KiB)  <-- End of flash
  *
  * Notes:
  *  - This layout matches make_flash.py and run_demo.sh exactly.
- *  - No metadata/manifest region is used in the POSIX demo.
+ *  - The meta region holds the core's append-only journal log.
  *  - Real MCU ports will replace this with actual flash geometry.
+ *  - Built with -DTMD_POSIX_IN_PLACE=1, the demo patches Slot A in place
+ *    (patchgen --in-place): the Slot B range becomes a 12 KiB meta region
+ *    at 0x20000, one swap sector followed by a two-sector journal log.
  *
  * -----------------------------------------------------------------------------
  */
@@ -42,16 +48,37 @@
 /* Flash Geometry Constants                                                   */
 /* -------------------------------------------------------------------------- */
 
-#define TMD_POSIX_FLASH_BYTES   (256u * 1024u)   /* Total flash.bin size       */
+#define TMD_POSIX_FLASH_BYTES   (260u * 1024u)   /* Total flash.bin size       */
 #define TMD_POSIX_SLOT_BYTES    (128u * 1024u)   /* Each slot is 128 KiB       */
+#define TMD_POSIX_META_BYTES    (4u * 1024u)     /* Journal log region         */
 
 #define TMD_POSIX_SLOT_A_ADDR   (0u)                       /* Offset 0x00000       */
 #define TMD_POSIX_SLOT_B_ADDR   (TMD_POSIX_SLOT_BYTES)     /* Offset 0x20000       */
+#define TMD_POSIX_META_ADDR     (2u * TMD_POSIX_SLOT_BYTES) /* Offset 0x40000      */
+
+/* In-place variant: swap sector + journal log where Slot B used to be. */
+#ifndef TMD_POSIX_IN_PLACE
+#define TMD_POSIX_IN_PLACE      0
+#endif
+#define TMD_POSIX_IP_META_BYTES (12u * 1024u)    /* Swap + 2 log sectors       */
 
 /* -------------------------------------------------------------------------- */
 /* TinyMLDelta Layout Structure                                               */
 /* -------------------------------------------------------------------------- */
 
+#if TMD_POSIX_IN_PLACE
+static const tmd_layout_t g_layout = {
+    .slotA = {
+        .addr = TMD_POSIX_SLOT_A_ADDR,
+        .size = TMD_POSIX_SLOT_BYTES,
+    },
+
+    /* Swap sector, then the core's journal log. */
+    .meta_addr = TMD_POSIX_SLOT_B_ADDR,
+    .meta_size = TMD_POSIX_IP_META_BYTES,
+    .in_place  = true,
+};
+#else
 static const tmd_layout_t g_layout = {
     .slotA = {
         .addr = TMD_POSIX_SLOT_A_ADDR,
@@ -62,9 +89,10 @@ static const tmd_layout_t g_layout = {
         .size = TMD_POSIX_SLOT_BYTES,
     },
 
-    /* POSIX demo: no metadata region is used, but fields must exist. */
-    .meta_addr = TMD_POSIX_FLASH_BYTES,   /* Disabled */
-    .meta_size = 0u,
+    /* Journal log, managed by the core (the port has no journal hooks). */
+    .meta_addr = TMD_POSIX_META_ADDR,
+    .meta_size = TMD_POSIX_META_BYTES,
 };
+#endif
 
 #endif /* FLASH_LAYOUT_H_ */
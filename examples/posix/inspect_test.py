@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+@file inspect_test.py
+@brief TinyMLDelta POSIX demo — tmd_inspect_patch() must fail like the apply.
+
+tmd_inspect_patch() fails with the status the apply would. For each
+broken patch below this runs demo_apply --inspect (rejected before the apply
+starts) and a plain demo_apply on a fresh A/B flash image, and checks that
+both report the same status:
+
+    base-too-long  header base_len past the slot size
+    bad-lz4-crc    an LZ4 chunk whose payload is malformed and so also fails
+                   its chunk CRC (the CRC is checked first)
+
+Usage:
+    python3 inspect_test.py --demo ./demo_apply
+"""
+
+import argparse
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PATCHGEN = os.path.join(HERE, "..", "..", "cli", "tinymldelta_patchgen.py")
+
+# Keep in sync with flash_layout.h (A/B layout) and tinymldelta_internal.h.
+SLOT_BYTES = 128 * 1024
+META_BYTES = 4 * 1024
+HDR_FMT = "<BBHII32s32sHH"
+CHUNK_FMT = "<IHBB"
+ENC_LZ4 = 2
+
+STATUS_RE = re.compile(r"status (-?\d+)")
+
+
+def make_patch(tmp: str, base: bytes, target: bytes, extra: list) -> bytearray:
+    paths = [os.path.join(tmp, n) for n in ("base", "target", "p.tmd")]
+    for path, data in zip(paths, (base, target)):
+        with open(path, "wb") as f:
+            f.write(data)
+    subprocess.run([sys.executable, PATCHGEN] + extra + paths,
+                   check=True, stdout=subprocess.DEVNULL)
+    with open(paths[2], "rb") as f:
+        return bytearray(f.read())
+
+
+def base_too_long(patch: bytearray) -> bytearray:
+    struct.pack_into("<I", patch, 4, SLOT_BYTES + 1)
+    return patch
+
+
+def bad_lz4_crc(patch: bytearray) -> bytearray:
+    hdr = struct.unpack_from(HDR_FMT, patch)
+    pos = struct.calcsize(HDR_FMT) + hdr[7]
+    for _ in range(hdr[2]):
+        _, plen, enc, has_crc = struct.unpack_from(CHUNK_FMT, patch, pos)
+        pay = pos + struct.calcsize(CHUNK_FMT) + (4 if has_crc else 0)
+        if enc & 0x0F == ENC_LZ4 and has_crc:
+            # Literal-length bytes that never end: no valid LZ4 block.
+            patch[pay:pay + plen] = b"\xff" * plen
+            return patch
+        pos = pay + plen
+    raise RuntimeError("patch has no LZ4 chunk with a CRC")
+
+
+def run_demo(demo: str, work: str, base: bytes, patch: bytes,
+             inspect: bool) -> int:
+    flash = bytearray(b"\xff" * (2 * SLOT_BYTES + META_BYTES))
+    flash[:len(base)] = base
+    flash[SLOT_BYTES:SLOT_BYTES + len(base)] = base
+    with open(os.path.join(work, "flash.bin"), "wb") as f:
+        f.write(flash)
+    with open(os.path.join(work, "active_slot.txt"), "w") as f:
+        f.write("0")
+    with open(os.path.join(work, "p.tmd"), "wb") as f:
+        f.write(patch)
+    cmd = [demo] + (["--inspect"] if inspect else []) + ["flash.bin", "p.tmd"]
+    res = subprocess.run(cmd, cwd=work, stdout=subprocess.DEVNULL,
+                         stderr=subprocess.PIPE, text=True)
+    m = STATUS_RE.search(res.stderr)
+    return int(m.group(1)) if m else 0
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description="Inspect vs apply status test.")
+    ap.add_argument("--demo", required=True, help="A/B demo_apply build")
+    ap.add_argument("--seed", type=int, default=1)
+    args = ap.parse_args()
+
+    demo = os.path.abspath(args.demo)
+    rng = random.Random(args.seed)
+    base = rng.randbytes(32 * 1024)
+    target = bytearray(base)
+    for off in range(0, len(target), 4096):
+        # Repetitive spans, so the planner picks LZ4 for them.
+        target[off + 512:off + 1536] = bytes([off >> 12]) * 16 * 64
+    target = bytes(target)
+
+    cases = [
+        ("base-too-long", [], base_too_long),
+        ("bad-lz4-crc", ["--lz4", "--no-rle"], bad_lz4_crc),
+    ]
+    failed = 0
+    with tempfile.TemporaryDirectory(prefix="tmd_inspect_") as tmp:
+        work = os.path.join(tmp, "work")
+        os.mkdir(work)
+        for name, extra, mangle in cases:
+            patch = bytes(mangle(make_patch(tmp, base, target, extra)))
+            ist = run_demo(demo, work, base, patch, inspect=True)
+            ast = run_demo(demo, work, base, patch, inspect=False)
+            ok = ist == ast and ist != 0
+            failed += not ok
+            print(f"[inspect] {name}: inspect={ist} apply={ast} "
+                  f"{'OK' if ok else 'FAIL'}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -8,9 +8,10 @@
 # -----------------------------------------------------------------------------
 """
 Creates a simulated flash image with:
-  - total flash size (default: 256 KiB)
+  - A/B slot area (default: 256 KiB, split into two slots)
   - Slot A containing the base .tflite model
   - Slot B initialized as a copy of Slot A
+  - A meta/journal region after the slots (default: 4 KiB, erased)
   - Remaining flash bytes set to 0xFF
 """
 
@@ -22,11 +23,14 @@ def main():
     parser.add_argument("--flash", required=True, help="Output flash image path")
     parser.add_argument("--base", required=True, help="Base .tflite model path")
     parser.add_argument("--size", type=int, default=262144,
-                        help="Total flash size in bytes (default 256 KiB)")
+                        help="Size of the A/B slot area in bytes (default 256 KiB)")
+    parser.add_argument("--meta-size", type=int, default=4096,
+                        help="Size of the meta/journal region after the slots "
+                             "(default 4 KiB, must match flash_layout.h)")
     args = parser.parse_args()
 
-    flash_size = args.size
-    slot_size = flash_size // 2  # A/B slots
+    slot_size = args.size // 2  # A/B slots
+    flash_size = 2 * slot_size + args.meta_size
 
     # Read base model
     with open(args.base, "rb") as f:
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+@file powercut_test.py
+@brief TinyMLDelta POSIX demo — power-cut regression test for in-place updates.
+@author Felix Galindo
+@license Apache-2.0
+
+Applies a chain of in-place patches to a single-slot flash image, cutting
+power at every flash operation of every update in turn (demo_apply --cut N)
+and then resuming with a plain demo_apply run. Every resume must succeed and
+leave the slot byte-for-byte equal to that update's target. The first run
+of each attempt also passes --inspect, so tmd_inspect_patch() must accept
+every in-place patch before it is applied (it touches no flash, so the
+operation count is unchanged). The chain is
+long enough for the core's journal log to move between its sectors several
+times, so cuts land on the log-page erases too.
+
+The demo must be built for this layout: make powercut does that with
+-DTMD_POSIX_IN_PLACE=1 -DTMD_POSIX_NOR=1 and runs the test.
+
+Usage:
+    python3 powercut_test.py --demo ./demo_apply_ip [--updates 24]
+                             [--image-size 32768] [--stride 1]
+"""
+
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PATCHGEN = os.path.join(HERE, "..", "..", "cli", "tinymldelta_patchgen.py")
+
+# Keep in sync with flash_layout.h (TMD_POSIX_IN_PLACE) and
+# tinymldelta_ports_posix.h.
+SLOT_BYTES = 128 * 1024
+SECTOR = 4096
+META_ADDR = SLOT_BYTES
+META_BYTES = 12 * 1024
+LOG_ADDR = META_ADDR + SECTOR   # after the swap sector
+POWER_CUT_EXIT = 75
+
+
+def next_image(rng: random.Random, image: bytes) -> bytes:
+    """Change a few spans in every sector, like a fine-tune would."""
+    out = bytearray(image)
+    for sec in range(0, len(out), SECTOR):
+        for _ in range(3):
+            off = sec + rng.randrange(SECTOR - 64)
+            out[off:off + 64] = rng.randbytes(64)
+    return bytes(out)
+
+
+def run_demo(demo: str, work: str, patch: str, cut: int = 0,
+             inspect: bool = False) -> int:
+    cmd = [demo]
+    if inspect:
+        cmd.append("--inspect")
+    if cut:
+        cmd += ["--cut", str(cut)]
+    cmd += ["flash.bin", patch]
+    return subprocess.run(cmd, cwd=work, stdout=subprocess.DEVNULL,
+                          stderr=subprocess.DEVNULL).returncode
+
+
+def log_blank_bytes(flash: bytes):
+    """Erased bytes per journal log sector."""
+    return [flash[a:a + SECTOR].count(0xFF)
+            for a in range(LOG_ADDR, META_ADDR + META_BYTES, SECTOR)]
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description="In-place power-cut test.")
+    ap.add_argument("--demo", required=True,
+                    help="demo_apply built with -DTMD_POSIX_IN_PLACE=1")
+    ap.add_argument("--updates", type=int, default=24,
+                    help="patches in the chain (default 24)")
+    ap.add_argument("--image-size", type=int, default=8 * SECTOR,
+                    help="model size in bytes (default 32 KiB)")
+    ap.add_argument("--stride", type=int, default=1,
+                    help="test every Nth flash operation (default 1)")
+    ap.add_argument("--seed", type=int, default=1)
+    args = ap.parse_args()
+
+    demo = os.path.abspath(args.demo)
+    rng = random.Random(args.seed)
+    image = rng.randbytes(args.image_size)
+    flash = bytearray(b"\xff" * (META_ADDR + META_BYTES))
+    flash[:len(image)] = image
+
+    trials = wraps = 0
+    with tempfile.TemporaryDirectory(prefix="tmd_powercut_") as tmp:
+        work = os.path.join(tmp, "work")
+        os.mkdir(work)
+        for u in range(1, args.updates + 1):
+            target = next_image(rng, image)
+            paths = [os.path.join(tmp, n) for n in ("base", "target", "p.tmd")]
+            for path, data in zip(paths, (image, target)):
+                with open(path, "wb") as f:
+                    f.write(data)
+            subprocess.run([sys.executable, PATCHGEN, "--in-place"] + paths,
+                           check=True, stdout=subprocess.DEVNULL)
+
+            cut = 1
+            while True:
+                with open(os.path.join(work, "flash.bin"), "wb") as f:
+                    f.write(flash)
+                with open(os.path.join(work, "active_slot.txt"), "w") as f:
+                    f.write("0")
+                rc = run_demo(demo, work, paths[2], cut, inspect=True)
+                if rc == POWER_CUT_EXIT:
+                    rc = run_demo(demo, work, paths[2])
+                    what = f"resume after a cut at op {cut}"
+                else:
+                    what = "uncut apply"
+                with open(os.path.join(work, "flash.bin"), "rb") as f:
+                    after = f.read()
+                slot_ok = after[:len(target)] == target
+                if rc != 0 or not slot_ok:
+                    print(f"[powercut] FAIL update {u}: {what} (rc={rc}, "
+                          f"slot {'ok' if slot_ok else 'wrong'})")
+                    return 1
+                if what == "uncut apply":
+                    break
+                trials += 1
+                cut += args.stride
+
+            # A log sector that lost records was erased for the log to move on.
+            wraps += sum(b > a for a, b in zip(log_blank_bytes(flash),
+                                               log_blank_bytes(after)))
+            flash = bytearray(after)
+            image = target
+            print(f"[powercut] update {u}: {cut - 1} flash operations, "
+                  f"every cut tested resumed", flush=True)
+
+    if wraps < 2:
+        print(f"[powercut] FAIL: only {wraps} journal log sector erases; "
+              f"raise --updates")
+        return 1
+    print(f"[powercut] OK: {trials} power cuts over {args.updates} updates, "
+          f"{wraps} journal log sector erases")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
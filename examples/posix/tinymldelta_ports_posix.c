@@ -16,6 +16,12 @@
  *  - flash.bin
  *      Represents NOR flash as a flat binary file.
  *      The layout is described by flash_layout.h (g_layout).
+ *      The file is mmap'ed shared and read/write: erase and program are
+ *      memset/memcpy on the mapping, and the mapping is published as
+ *      tmd_ports_t::flash_map (the host stand-in for XIP flash). No
+ *      syscall is made per flash operation; msync() runs at commit points
+ *      only (see TMD_POSIX_MSYNC). Since the mapping is shared, every
+ *      completed operation survives a killed process.
  *
  *  - active_slot.txt
  *      A one-byte text file storing '0' or '1' to indicate which slot is
@@ -23,9 +29,43 @@
  *      the "source" slot (A or B) and which slot to patch into.
  *
  *  - Journal (optional)
- *      When TMD_FEAT_JOURNAL is enabled, a small tmd_journal_t structure is
- *      stored at g_layout.meta_addr within flash.bin. This allows recovery
- *      of partially-applied patches after a reset or power loss.
+ *      When TMD_FEAT_JOURNAL is enabled, the core appends journal records
+ *      to the meta region at g_layout.meta_addr within flash.bin. This
+ *      allows recovery of partially-applied patches after a reset or power
+ *      loss.
+ *
+ * -----------------------------------------------------------------------------
+ * FLASH MODEL (compile-time options)
+ * -----------------------------------------------------------------------------
+ *
+ *  TMD_POSIX_NOR          0: plain memory, writes overwrite (default).
+ *                         1: NOR semantics: program only clears bits (new =
+ *                            old & data), erase must cover whole
+ *                            TMD_SECTOR_SZ sectors.
+ *  TMD_POSIX_NOR_STRICT   With TMD_POSIX_NOR: refuse a program that would
+ *                         need to set a cleared bit, i.e. a write to a
+ *                         location not erased first (default 1). With 0
+ *                         the bits are silently ANDed, like real parts do.
+ *  TMD_POSIX_ERASE_US     Modelled time per sector erase.
+ *  TMD_POSIX_PROG_NS_PER_BYTE
+ *                         Modelled program time per byte. Both default to
+ *                         typical SPI NOR datasheet values, are summed in
+ *                         tmd_posix_flash_stats_t::busy_us and only cost
+ *                         wall-clock time with TMD_POSIX_FLASH_DELAY=1.
+ *  TMD_POSIX_MSYNC        Commit points that msync() the mapping: 0 none
+ *                         (default), 1 the slot flip, 2 also every journal
+ *                         record. Only matters if the host itself crashes;
+ *                         a killed process loses nothing either way.
+ *
+ * tmd_posix_set_power_cut(n) stops the process in the middle of the n-th
+ * erase or program, with the first half of its range done, the way a power
+ * loss tears an operation (see powercut_test.py).
+ *
+ * With TMD_FEAT_ASYNC_WRITE the port also provides flash_erase_async /
+ * flash_write_async / flash_poll. An operation only takes effect once
+ * flash_poll() sees its modelled time pass (immediately without
+ * TMD_POSIX_FLASH_DELAY), so a core that read or reused a buffer too early
+ * would write or see stale bytes.
  *
  * This POSIX port is purely for demos and tests; real MCU ports should
  * enforce flash geometry, erase block sizes, alignment rules, and wear
@@ -34,55 +74,164 @@
  * -----------------------------------------------------------------------------
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "tinymldelta_ports.h"
+#include "tinymldelta_ports_posix.h"
 #include "flash_layout.h"
 
+#ifndef TMD_POSIX_NOR
+#define TMD_POSIX_NOR              0
+#endif
+#ifndef TMD_POSIX_NOR_STRICT
+#define TMD_POSIX_NOR_STRICT       1
+#endif
+#ifndef TMD_POSIX_ERASE_US
+#define TMD_POSIX_ERASE_US         45000u /* 4 KiB sector erase, SPI NOR */
+#endif
+#ifndef TMD_POSIX_PROG_NS_PER_BYTE
+#define TMD_POSIX_PROG_NS_PER_BYTE 2700u  /* ~0.7 ms per 256-byte page */
+#endif
+#ifndef TMD_POSIX_FLASH_DELAY
+#define TMD_POSIX_FLASH_DELAY      0
+#endif
+#ifndef TMD_POSIX_MSYNC
+#define TMD_POSIX_MSYNC            0
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* Global state for POSIX-backed flash + active-slot tracking                 */
 /* -------------------------------------------------------------------------- */
 
-/* Path to the flash image (flash.bin), configured by tmd_posix_set_flash_path. */
-static const char* g_flash_path = NULL;
-/* File handle used for all flash read/write/erase operations. */
-static FILE* g_flash_fp = NULL;
+/* File descriptor of flash.bin, or -1 if not open. */
+static int g_flash_fd = -1;
+/* Shared read/write mapping of the whole of flash.bin. */
+static uint8_t* g_flash = NULL;
+/* Size of the mapping in bytes. */
+static size_t g_flash_len = 0;
 /* Path to the active-slot marker file (e.g., active_slot.txt). */
 static const char* g_active_slot_path = NULL;
+/* Operation counters, see tmd_posix_flash_stats(). */
+static tmd_posix_flash_stats_t g_stats;
+/* Operations left before the simulated power cut (0 = none). */
+static uint32_t g_cut_ops = 0;
+
+static tmd_ports_t g_ports;
+
+#if TMD_FEAT_ASYNC_WRITE
+/* Operation started by flash_*_async() and not yet carried out. */
+enum { POSIX_OP_NONE = 0, POSIX_OP_ERASE, POSIX_OP_WRITE };
+static struct {
+  int         kind;   /* POSIX_OP_* */
+  uint32_t    addr;
+  uint32_t    len;
+  const void* src;
+  uint64_t    due_ns; /* CLOCK_MONOTONIC time it completes */
+  int         result; /* flash_poll() result once kind is NONE */
+} g_op;
+#endif
 
 /* -------------------------------------------------------------------------- */
 /* Internal helpers                                                           */
 /* -------------------------------------------------------------------------- */
 
 /**
- * @brief Ensure g_flash_fp is open and ready for I/O.
- *
- * If flash.bin does not exist yet, it is created. For this POSIX demo we rely
- * on examples/posix/make_flash.py to size and initialize the file, so we do
- * not attempt to grow it or enforce size here.
+ * @brief Check that [addr, addr + len) lies inside the mapped image.
+ */
+static bool flash_in_range(uint32_t addr, uint32_t len) {
+  return g_flash != NULL && (size_t)addr <= g_flash_len &&
+         (size_t)len <= g_flash_len - addr;
+}
+
+/**
+ * @brief Modelled time of erasing @p len bytes.
+ */
+static uint64_t erase_ns(uint32_t len) {
+  return (uint64_t)TMD_POSIX_ERASE_US * 1000u *
+         ((len + TMD_SECTOR_SZ - 1u) / TMD_SECTOR_SZ);
+}
+
+/**
+ * @brief Modelled time of programming @p len bytes.
+ */
+static uint64_t prog_ns(uint32_t len) {
+  return (uint64_t)TMD_POSIX_PROG_NS_PER_BYTE * len;
+}
+
+/**
+ * @brief Account (and with TMD_POSIX_FLASH_DELAY, wait) @p ns of flash time.
+ */
+static void flash_busy(uint64_t ns) {
+  g_stats.busy_us += ns / 1000u;
+#if TMD_POSIX_FLASH_DELAY
+#if TMD_FEAT_ASYNC_WRITE
+  if (g_op.kind != POSIX_OP_NONE) {
+    return; /* completing an async operation: its time has passed already */
+  }
+#endif
+  struct timespec ts;
+  ts.tv_sec = (time_t)(ns / 1000000000u);
+  ts.tv_nsec = (long)(ns % 1000000000u);
+  nanosleep(&ts, NULL);
+#endif
+}
+
+/**
+ * @brief Commit point: write the dirty pages of the mapping back to the file
+ *        if TMD_POSIX_MSYNC >= @p level.
+ */
+static void flash_sync(int level) {
+  if (TMD_POSIX_MSYNC >= level && g_flash != NULL) {
+    msync(g_flash, g_flash_len, MS_SYNC);
+    g_stats.syncs++;
+  }
+}
+
+/**
+ * @brief Extent of the layout in bytes (end of the last region).
+ */
+static uint32_t layout_end(void) {
+  uint32_t end = g_layout.meta_addr + g_layout.meta_size;
+  if (g_layout.slotA.addr + g_layout.slotA.size > end) {
+    end = g_layout.slotA.addr + g_layout.slotA.size;
+  }
+  if (g_layout.slotB.addr + g_layout.slotB.size > end) {
+    end = g_layout.slotB.addr + g_layout.slotB.size;
+  }
+  return end;
+}
+
+/**
+ * @brief Simulated power cut: if this is the operation named by
+ *        tmd_posix_set_power_cut(), carry out the first half of it and exit.
  *
- * @return 0 on success, -1 on failure.
+ * @param src  Bytes to program, or NULL for an erase
  */
-static int ensure_flash_open(void) {
-  if (!g_flash_path) {
-    return -1;
+static void flash_power_cut(uint32_t addr, const uint8_t* src, uint32_t len) {
+  if (g_cut_ops == 0 || --g_cut_ops != 0) {
+    return;
   }
-  if (!g_flash_fp) {
-    /* Try to open existing flash.bin for read/write. */
-    g_flash_fp = fopen(g_flash_path, "r+b");
-    if (!g_flash_fp) {
-      /* If it does not exist, create a new one. Caller (demo) is responsible
-       * for making sure it has the right size and contents. */
-      g_flash_fp = fopen(g_flash_path, "w+b");
-      if (!g_flash_fp) {
-        return -1;
-      }
-    }
+  uint8_t* d = g_flash + addr;
+  for (uint32_t i = 0; i < len / 2u; ++i) {
+#if TMD_POSIX_NOR
+    d[i] = src ? (uint8_t)(d[i] & src[i]) : 0xFFu;
+#else
+    d[i] = src ? src[i] : 0xFFu;
+#endif
   }
-  return 0;
+  fprintf(stderr, "posix flash: power cut during %s @0x%08lx\n",
+          src ? "program" : "erase", (unsigned long)addr);
+  _exit(TMD_POSIX_POWER_CUT_EXIT);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -90,96 +239,137 @@ static int ensure_flash_open(void) {
 /* -------------------------------------------------------------------------- */
 
 /**
- * @brief Erase a region of flash by writing 0xFF bytes.
+ * @brief Erase a region of flash to 0xFF.
  *
- * This is a simple model of NOR flash erase behavior. It does not enforce
- * sector boundaries or erase block size; it simply overwrites the requested
- * range with 0xFF.
+ * With TMD_POSIX_NOR the region must be whole TMD_SECTOR_SZ sectors.
  */
 static bool posix_flash_erase(uint32_t addr, uint32_t len) {
-  if (ensure_flash_open() != 0) {
+  if (!flash_in_range(addr, len)) {
     return false;
   }
-  if (fseek(g_flash_fp, (long)addr, SEEK_SET) != 0) {
+#if TMD_POSIX_NOR
+  if (addr % TMD_SECTOR_SZ != 0 || len % TMD_SECTOR_SZ != 0) {
+    fprintf(stderr, "posix flash: unaligned erase @0x%08lx len=%lu\n",
+            (unsigned long)addr, (unsigned long)len);
+    g_stats.rejected++;
     return false;
   }
-
-  uint8_t buf[256];
-  memset(buf, 0xFF, sizeof(buf));
-
-  while (len > 0) {
-    uint32_t chunk = (len > (uint32_t)sizeof(buf)) ? (uint32_t)sizeof(buf) : len;
-    if (fwrite(buf, 1, chunk, g_flash_fp) != chunk) {
-      return false;
-    }
-    len -= chunk;
-  }
-  fflush(g_flash_fp);
+#endif
+  flash_power_cut(addr, NULL, len);
+  memset(g_flash + addr, 0xFF, len);
+  g_stats.erases++;
+  g_stats.erase_bytes += len;
+  flash_busy(erase_ns(len));
   return true;
 }
 
 /**
- * @brief Write a range of bytes into flash.bin.
+ * @brief Program a range of bytes.
  *
- * No alignment or wear-leveling is modeled here; this is a straight file
- * write used for the POSIX TinyMLDelta demo.
+ * A write into the meta region is a journal commit (TMD_POSIX_MSYNC=2
+ * syncs the mapping right after it).
  */
 static bool posix_flash_write(uint32_t addr, const void* src, uint32_t len) {
-  if (ensure_flash_open() != 0) {
+  if (!flash_in_range(addr, len)) {
     return false;
   }
-  if (fseek(g_flash_fp, (long)addr, SEEK_SET) != 0) {
-    return false;
+  uint8_t* d = g_flash + addr;
+  const uint8_t* s = (const uint8_t*)src;
+#if TMD_POSIX_NOR
+#if TMD_POSIX_NOR_STRICT
+  for (uint32_t i = 0; i < len; ++i) {
+    if ((s[i] & (uint8_t)~d[i]) != 0) {
+      fprintf(stderr, "posix flash: program over unerased byte @0x%08lx\n",
+              (unsigned long)(addr + i));
+      g_stats.rejected++;
+      return false;
+    }
   }
-  if (fwrite(src, 1, len, g_flash_fp) != len) {
-    return false;
+#endif
+  flash_power_cut(addr, s, len);
+  for (uint32_t i = 0; i < len; ++i) {
+    d[i] &= s[i];
+  }
+#else
+  flash_power_cut(addr, s, len);
+  memcpy(d, s, len);
+#endif
+  g_stats.writes++;
+  g_stats.write_bytes += len;
+  flash_busy(prog_ns(len));
+  if (addr >= g_layout.meta_addr &&
+      addr - g_layout.meta_addr < g_layout.meta_size) {
+    flash_sync(2);
   }
-  fflush(g_flash_fp);
   return true;
 }
 
 /**
- * @brief Read a range of bytes from flash.bin.
+ * @brief Read a range of bytes. The core normally reads flash_map directly.
  */
 static bool posix_flash_read(uint32_t addr, void* dst, uint32_t len) {
-  if (ensure_flash_open() != 0) {
-    return false;
-  }
-  if (fseek(g_flash_fp, (long)addr, SEEK_SET) != 0) {
+  if (!flash_in_range(addr, len)) {
     return false;
   }
-  if (fread(dst, 1, len, g_flash_fp) != len) {
+  memcpy(dst, g_flash + addr, len);
+  return true;
+}
+
+#if TMD_FEAT_ASYNC_WRITE
+/**
+ * @brief CLOCK_MONOTONIC in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Record an operation to carry out in posix_flash_poll().
+ */
+static bool flash_start(int kind, uint32_t addr, const void* src,
+                        uint32_t len, uint64_t ns) {
+  if (g_op.kind != POSIX_OP_NONE) {
+    fprintf(stderr, "posix flash: operation started while busy\n");
     return false;
   }
+  g_op.kind = kind;
+  g_op.addr = addr;
+  g_op.len = len;
+  g_op.src = src;
+  g_op.due_ns = now_ns() + (TMD_POSIX_FLASH_DELAY ? ns : 0u);
   return true;
 }
 
-/* -------------------------------------------------------------------------- */
-/* CRC32 (software)                                                           */
-/* -------------------------------------------------------------------------- */
+static bool posix_flash_erase_async(uint32_t addr, uint32_t len) {
+  return flash_start(POSIX_OP_ERASE, addr, NULL, len, erase_ns(len));
+}
+
+static bool posix_flash_write_async(uint32_t addr, const void* src,
+                                    uint32_t len) {
+  return flash_start(POSIX_OP_WRITE, addr, src, len, prog_ns(len));
+}
 
-#if TMD_FEAT_CRC32
 /**
- * @brief Very small software CRC32 implementation (not optimized).
- *
- * This is sufficient for the POSIX demo and keeps the runtime fully
- * self-contained. Real firmware may wire this to a hardware CRC engine
- * or a more optimized library implementation.
+ * @brief Carry out the operation in flight once its time is up, the way a
+ *        completion interrupt would report it.
  */
-static uint32_t crc32_sw(const void* buf, size_t len) {
-  const uint8_t* p = (const uint8_t*)buf;
-  uint32_t crc = 0xFFFFFFFFu;
-
-  for (size_t i = 0; i < len; ++i) {
-    crc ^= p[i];
-    for (int b = 0; b < 8; ++b) {
-      uint32_t mask = -(crc & 1u);
-      crc = (crc >> 1) ^ (0xEDB88320u & mask);
-    }
+static int posix_flash_poll(void) {
+  if (g_op.kind == POSIX_OP_NONE) {
+    return g_op.result;
   }
-  return ~crc;
+  if (now_ns() < g_op.due_ns) {
+    return TMD_FLASH_BUSY;
+  }
+  bool ok = (g_op.kind == POSIX_OP_ERASE)
+                ? posix_flash_erase(g_op.addr, g_op.len)
+                : posix_flash_write(g_op.addr, g_op.src, g_op.len);
+  g_op.kind = POSIX_OP_NONE;
+  g_op.result = ok ? TMD_FLASH_IDLE : TMD_FLASH_ERROR;
+  return g_op.result;
 }
-#endif /* TMD_FEAT_CRC32 */
+#endif /* TMD_FEAT_ASYNC_WRITE */
 
 /* -------------------------------------------------------------------------- */
 /* Active slot tracking (active_slot.txt)                                     */
@@ -210,11 +400,14 @@ static uint8_t posix_get_active_slot(void) {
 
 /**
  * @brief Persist the active slot index (0 or 1) into active_slot.txt.
+ *
+ * The flip is a commit point: the new slot's contents are synced first.
  */
 static bool posix_set_active_slot(uint8_t idx) {
   if (!g_active_slot_path) {
     return false;
   }
+  flash_sync(1);
   FILE* f = fopen(g_active_slot_path, "wb");
   if (!f) {
     return false;
@@ -228,59 +421,26 @@ static bool posix_set_active_slot(uint8_t idx) {
 /* Journal support (optional)                                                 */
 /* -------------------------------------------------------------------------- */
 
-#if TMD_FEAT_JOURNAL
-/**
- * @brief Read the TinyMLDelta journal structure from flash.
- *
- * The journal location is defined by g_layout.meta_addr. On a short read,
- * the output structure is zeroed and true is still returned so the caller
- * can treat it as "no journal present".
+/*
+ * No journal hooks: the core keeps its append-only journal log in the meta
+ * region of flash.bin (g_layout.meta_addr/meta_size) using the flash
+ * primitives above.
  */
-static bool posix_journal_read(tmd_journal_t* out) {
-  if (!out) {
-    return false;
-  }
-  if (ensure_flash_open() != 0) {
-    return false;
-  }
-  if (fseek(g_flash_fp, (long)g_layout.meta_addr, SEEK_SET) != 0) {
-    return false;
-  }
-  if (fread(out, 1, sizeof(*out), g_flash_fp) != sizeof(*out)) {
-    memset(out, 0, sizeof(*out));
-  }
-  return true;
-}
 
-/**
- * @brief Write the TinyMLDelta journal structure to flash.
- */
-static bool posix_journal_write(const tmd_journal_t* in) {
-  if (!in) {
-    return false;
-  }
-  if (ensure_flash_open() != 0) {
-    return false;
-  }
-  if (fseek(g_flash_fp, (long)g_layout.meta_addr, SEEK_SET) != 0) {
-    return false;
-  }
-  if (fwrite(in, 1, sizeof(*in), g_flash_fp) != sizeof(*in)) {
-    return false;
-  }
-  fflush(g_flash_fp);
-  return true;
-}
+/* -------------------------------------------------------------------------- */
+/* Instrumentation clock (optional)                                           */
+/* -------------------------------------------------------------------------- */
 
+#if TMD_FEAT_STATS
 /**
- * @brief Clear the journal by writing a zeroed tmd_journal_t.
+ * @brief Monotonic microsecond clock for the core's phase timings.
  */
-static bool posix_journal_clear(void) {
-  tmd_journal_t zero;
-  memset(&zero, 0, sizeof(zero));
-  return posix_journal_write(&zero);
+static uint32_t posix_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u);
 }
-#endif /* TMD_FEAT_JOURNAL */
+#endif
 
 /* -------------------------------------------------------------------------- */
 /* Logging (optional)                                                         */
@@ -313,8 +473,20 @@ static tmd_ports_t g_ports = {
   .flash_erase = posix_flash_erase,
   .flash_write = posix_flash_write,
   .flash_read  = posix_flash_read,
+  .flash_map   = NULL, /* set by tmd_posix_set_flash_path() */
+  /* flash_write() is a memcpy: any source buffer will do. An async
+     operation only touches its own range until it completes. */
+  .caps        = TMD_PORT_CAP_WRITE_FROM_PATCH | TMD_PORT_CAP_READ_WHILE_WRITE,
+#if TMD_FEAT_ASYNC_WRITE
+  .flash_erase_async = posix_flash_erase_async,
+  .flash_write_async = posix_flash_write_async,
+  .flash_poll        = posix_flash_poll,
+#endif
 #if TMD_FEAT_CRC32
-  .crc32 = crc32_sw,
+  /* No CRC hardware on the host: use the core's software CRC32. */
+  .crc32_init   = NULL,
+  .crc32_update = NULL,
+  .crc32_final  = NULL,
 #endif
 #if TMD_FEAT_SHA256
   .sha256_init   = NULL,
@@ -327,9 +499,12 @@ static tmd_ports_t g_ports = {
   .get_active_slot = posix_get_active_slot,
   .set_active_slot = posix_set_active_slot,
 #if TMD_FEAT_JOURNAL
-  .journal_read  = posix_journal_read,
-  .journal_write = posix_journal_write,
-  .journal_clear = posix_journal_clear,
+  .journal_read  = NULL,
+  .journal_write = NULL,
+  .journal_clear = NULL,
+#endif
+#if TMD_FEAT_STATS
+  .now_us = posix_now_us,
 #endif
 #if TMD_FEAT_LOG
   .log = posix_log,
@@ -355,12 +530,76 @@ const tmd_layout_t* tmd_layout(void) {
 /* -------------------------------------------------------------------------- */
 
 /**
- * @brief Configure the path to the POSIX flash image (flash.bin).
+ * @brief Open and map the POSIX flash image (flash.bin).
  *
- * The demo app calls this once before invoking TinyMLDelta APIs.
+ * The demo app calls this once before invoking TinyMLDelta APIs. A missing
+ * or short image is created / extended to the layout's size, erased (0xFF);
+ * make_flash.py normally provides it with the base model in place.
  */
-void tmd_posix_set_flash_path(const char* path) {
-  g_flash_path = path;
+int tmd_posix_set_flash_path(const char* path) {
+  struct stat sb;
+  uint32_t need = layout_end();
+
+  tmd_posix_flash_close();
+  g_flash_fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (g_flash_fd < 0 || fstat(g_flash_fd, &sb) != 0) {
+    perror(path);
+    tmd_posix_flash_close();
+    return -1;
+  }
+  if ((uint64_t)sb.st_size < need) {
+    uint8_t ff[4096];
+    memset(ff, 0xFF, sizeof(ff));
+    for (off_t off = sb.st_size; off < (off_t)need; ) {
+      size_t n = (size_t)((off_t)need - off);
+      if (n > sizeof(ff)) {
+        n = sizeof(ff);
+      }
+      if (pwrite(g_flash_fd, ff, n, off) != (ssize_t)n) {
+        perror(path);
+        tmd_posix_flash_close();
+        return -1;
+      }
+      off += (off_t)n;
+    }
+    sb.st_size = (off_t)need;
+  }
+
+  void* v = mmap(NULL, (size_t)sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 g_flash_fd, 0);
+  if (v == MAP_FAILED) {
+    perror(path);
+    tmd_posix_flash_close();
+    return -1;
+  }
+  g_flash = (uint8_t*)v;
+  g_flash_len = (size_t)sb.st_size;
+  g_ports.flash_map = g_flash;
+  return 0;
+}
+
+/**
+ * @brief Sync and unmap flash.bin (also called before re-mapping).
+ */
+void tmd_posix_flash_close(void) {
+  if (g_flash != NULL) {
+    flash_sync(1);
+    munmap(g_flash, g_flash_len);
+  }
+  if (g_flash_fd >= 0) {
+    close(g_flash_fd);
+  }
+  g_flash = NULL;
+  g_flash_len = 0;
+  g_flash_fd = -1;
+  g_ports.flash_map = NULL;
+}
+
+/**
+ * @brief Snapshot of the flash operation counters.
+ */
+void tmd_posix_flash_stats(tmd_posix_flash_stats_t* out) {
+  *out = g_stats;
 }
 
 /**
@@ -369,3 +608,10 @@ void tmd_posix_set_flash_path(const char* path) {
 void tmd_posix_set_active_slot_path(const char* path) {
   g_active_slot_path = path;
 }
+
+/**
+ * @brief Arm the simulated power cut at flash operation @p op (0 = off).
+ */
+void tmd_posix_set_power_cut(uint32_t op) {
+  g_cut_ops = op;
+}
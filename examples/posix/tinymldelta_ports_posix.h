@@ -0,0 +1,65 @@
+#ifndef TINYMLDELTA_PORTS_POSIX_H_
+#define TINYMLDELTA_PORTS_POSIX_H_
+/**
+ * @file tinymldelta_ports_posix.h
+ * @brief TinyMLDelta POSIX port — helpers for the demo and host test runs.
+ *
+ * Author: Felix Galindo
+ * License: Apache-2.0
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Flash operation counters of the simulated flash (since the last reset). */
+typedef struct {
+  uint32_t erases;        /**< flash_erase() calls */
+  uint32_t writes;        /**< flash_write() calls */
+  uint64_t erase_bytes;   /**< Bytes erased */
+  uint64_t write_bytes;   /**< Bytes programmed */
+  uint32_t rejected;      /**< Operations refused by the NOR model */
+  uint32_t syncs;         /**< msync() calls at commit points */
+  uint64_t busy_us;       /**< Modelled flash busy time (TMD_POSIX_*_US) */
+} tmd_posix_flash_stats_t;
+
+/**
+ * @brief Configure the path to the simulated flash image (flash.bin) and
+ *        map it. Call once before invoking TinyMLDelta APIs.
+ *
+ * @return 0 on success, -1 if the image cannot be opened or mapped.
+ */
+int tmd_posix_set_flash_path(const char* path);
+
+/**
+ * @brief Configure the path to the active-slot marker file.
+ */
+void tmd_posix_set_active_slot_path(const char* path);
+
+/**
+ * @brief Copy the flash operation counters into @p out.
+ */
+void tmd_posix_flash_stats(tmd_posix_flash_stats_t* out);
+
+/**
+ * @brief Write back and unmap flash.bin.
+ */
+void tmd_posix_flash_close(void);
+
+/** Exit status of a process stopped by a simulated power cut. */
+#define TMD_POSIX_POWER_CUT_EXIT 75
+
+/**
+ * @brief Simulate a power cut at flash operation @p op (1-based, counting
+ *        erases and programs; 0 = never). That operation is left half done
+ *        and the process exits with TMD_POSIX_POWER_CUT_EXIT.
+ */
+void tmd_posix_set_power_cut(uint32_t op);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TINYMLDELTA_PORTS_POSIX_H_ */
@@ -9,6 +9,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "tinymldelta_config.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,29 +23,290 @@ typedef enum {
   TMD_STATUS_ERR_GUARDRAIL,
   TMD_STATUS_ERR_FLASH,
   TMD_STATUS_ERR_UNSUPPORTED,
-  TMD_STATUS_ERR_INTERNAL
+  TMD_STATUS_ERR_INTERNAL,
+  TMD_STATUS_PENDING       /**< Not an error: more work left, call again. */
 } tmd_status_t;
 
+/**
+ * @brief Streaming apply context.
+ *
+ * Holds the complete state of an in-progress patch application: the parsed
+ * header, the TLV/chunk parser position and a small work buffer. The size is
+ * fixed at TMD_SCRATCH_SZ bytes so it can live in static storage or on a task
+ * stack; no heap is used.
+ *
+ * The contents are private to the core. Treat it as opaque storage.
+ *
+ * It is the only work memory an apply uses: the same buffer serves the slot
+ * compare and copy, chunk decoding and the merge window, so a large
+ * TMD_SCRATCH_SZ (e.g. one flash sector, for fewer and larger flash ops)
+ * costs stack only where the context itself is placed.
+ */
+typedef struct {
+  uint64_t opaque[TMD_SCRATCH_SZ / sizeof(uint64_t)];
+} tmd_stream_t;
+
+/**
+ * @brief Bytes of caller storage an apply needs: sizeof(tmd_stream_t).
+ *
+ * For callers that carve the context out of their own arena (8-byte
+ * aligned). With it passed in, the core's own stack use stays well under
+ * 1 KiB whatever TMD_SCRATCH_SZ is.
+ */
+size_t tmd_workspace_size(void);
+
 /**
  * @brief Apply a TinyMLDelta patch from memory to the inactive slot.
  *
  * Flow:
  *   - Parse header and TLVs from @p patch.
  *   - Validate metadata against firmware guardrails.
- *   - Copy active slot to inactive slot.
- *   - Apply diff chunks into inactive slot.
- *   - Optionally verify final digest.
+ *   - Build the target image in the inactive slot in one forward pass,
+ *     sector by sector: in sectors hit by a chunk, active-slot bytes and
+ *     chunk bytes are merged in RAM and each byte is programmed once;
+ *     untouched sectors are only rewritten if they differ from the active
+ *     slot.
+ *   - Verify the header's base and target digests, computed during the same
+ *     pass (TMD_VERIFY_BASE / TMD_VERIFY_TARGET).
  *   - Flip active slot.
  *
  * The exact flash layout and HAL details are provided by the application via
  * tmd_ports() and tmd_layout().
  *
+ * This is a convenience wrapper around the streaming API below that feeds the
+ * whole buffer in one call. It keeps its context (TMD_SCRATCH_SZ bytes) on
+ * the stack; tasks with small stacks use tmd_apply_patch_ctx().
+ *
  * @param patch     Pointer to patch bytes.
  * @param patch_len Length of patch buffer in bytes.
  * @return ::TMD_STATUS_OK on success, error code otherwise.
  */
 tmd_status_t tmd_apply_patch_from_memory(const uint8_t* patch, size_t patch_len);
 
+/**
+ * @brief tmd_apply_patch_from_memory() in a caller-owned context.
+ *
+ * @p s is left readable afterwards (e.g. for tmd_stream_stats()).
+ *
+ * @param s         Caller-owned context.
+ * @param patch     Pointer to patch bytes.
+ * @param patch_len Length of patch buffer in bytes.
+ * @return ::TMD_STATUS_OK on success, error code otherwise.
+ */
+tmd_status_t tmd_apply_patch_ctx(tmd_stream_t* s, const uint8_t* patch,
+                                 size_t patch_len);
+
+/**
+ * @brief Get the inactive slot ready for @p patch ahead of the apply
+ *        (TMD_FEAT_PREPARE).
+ *
+ * Erases the sectors the patch's chunks will program and brings every other
+ * sector of the image in line with the active slot, at most @p max_erases
+ * sector erases per call, so it can run in idle time while the active model
+ * keeps serving. Progress is kept in the journal: calls resume where the
+ * previous one stopped, across reboots, and the apply of the same patch
+ * skips the erases already done. Nothing is programmed into sectors the
+ * patch changes and the active slot is left alone, so stopping at any
+ * point is harmless.
+ *
+ * The whole patch must be readable (e.g. downloaded to a staging area);
+ * only its chunk records are used, nothing is verified against the digests.
+ * Like tmd_apply_patch_from_memory(), it keeps a context on the stack; see
+ * tmd_prepare_slot_ctx().
+ *
+ * @param patch      Patch bytes.
+ * @param patch_len  Length of @p patch.
+ * @param max_erases Erases allowed in this call; 0 = no limit.
+ * @return ::TMD_STATUS_OK once the slot is ready, ::TMD_STATUS_PENDING if
+ *         the budget ran out first, ::TMD_STATUS_ERR_UNSUPPORTED for
+ *         in-place layouts, another error code on failure.
+ */
+tmd_status_t tmd_prepare_slot(const uint8_t* patch, size_t patch_len,
+                              uint32_t max_erases);
+
+/**
+ * @brief tmd_prepare_slot() in a caller-owned context.
+ *
+ * @p s only lives for the call; it can be the context the apply uses next.
+ */
+tmd_status_t tmd_prepare_slot_ctx(tmd_stream_t* s, const uint8_t* patch,
+                                  size_t patch_len, uint32_t max_erases);
+
+/**
+ * @brief What tmd_inspect_patch() learned about a patch.
+ *
+ * Flash cost counts the sectors chunks write: each is erased and programmed
+ * once (twice with an in-place layout, which saves the sector to the swap
+ * sector first). On A/B layouts, untouched sectors whose inactive-slot
+ * contents differ from the active slot are rewritten too, at most
+ * image_sectors in all; that depends on the device and is not included.
+ */
+typedef struct {
+  tmd_status_t guardrail;      /**< Guardrail verdict on the metadata TLVs
+                                    (::TMD_STATUS_PENDING until all of them
+                                    are present). */
+  uint32_t     base_len;       /**< Header base_len. */
+  uint32_t     target_len;     /**< Header target_len. */
+  uint16_t     chunks;         /**< Chunk records the header announces. */
+  uint16_t     chunks_checked; /**< Of those, fully present and checked. */
+  uint16_t     flags;          /**< Header TMD_HDR_F_* bits. */
+  uint32_t     payload_bytes;  /**< Encoded chunk payload bytes. */
+  uint32_t     write_bytes;    /**< Target bytes the chunks produce. */
+  uint32_t     image_sectors;  /**< Sectors spanned by the target image. */
+  uint32_t     touched_sectors;/**< Sectors at least one chunk writes. */
+  uint32_t     erase_bytes;    /**< Estimated bytes erased: whole
+                                    TMD_SECTOR_SZ sectors, also where the
+                                    image or slot ends partway through one. */
+  uint32_t     program_bytes;  /**< Estimated bytes programmed. */
+} tmd_patch_info_t;
+
+/**
+ * @brief Check a patch without touching flash and summarize it
+ *        (TMD_FEAT_INSPECT).
+ *
+ * Parses the header and TLVs, evaluates the guardrails, and walks the chunk
+ * table checking each record's encoding, bounds and CRC as the apply would,
+ * against the layout's slot sizes. Only tmd_layout() and the port's CRC
+ * hooks are used, so a node can reject a patch, or a gateway rank it by
+ * cost, before anything is written.
+ *
+ * @p patch may be a prefix of the patch (e.g. a download in progress):
+ * everything present is checked and ::TMD_STATUS_PENDING says more bytes
+ * are needed for the rest. @p info is filled as far as the bytes go.
+ *
+ * @param patch     Patch bytes.
+ * @param patch_len Bytes of @p patch available.
+ * @param info      Filled with the summary.
+ * @return ::TMD_STATUS_OK if the whole patch is well formed (the guardrail
+ *         verdict is in @p info), ::TMD_STATUS_PENDING if it is truncated
+ *         but fine so far, an error status otherwise: the one the apply
+ *         fails with when each chunk payload reaches it in one piece (a
+ *         payload split across feeds can hit a decode error in an earlier
+ *         fragment before its chunk CRC is checked).
+ */
+tmd_status_t tmd_inspect_patch(const uint8_t* patch, size_t patch_len,
+                               tmd_patch_info_t* info);
+
+/**
+ * @brief Start a time-sliced apply of a patch held in memory
+ *        (TMD_FEAT_STEP).
+ *
+ * Same result as tmd_apply_patch_from_memory(), but the work is done by
+ * repeated tmd_apply_step() calls of bounded cost, so the application can
+ * keep running its inference loop between them. @p patch must stay
+ * readable and unchanged until the apply has completed or failed.
+ *
+ * @param s         Caller-owned context.
+ * @param patch     Patch bytes.
+ * @param patch_len Length of @p patch.
+ * @return ::TMD_STATUS_OK on success, error code otherwise.
+ */
+tmd_status_t tmd_apply_begin(tmd_stream_t* s, const uint8_t* patch,
+                             size_t patch_len);
+
+/**
+ * @brief Do the next slice of an apply started by tmd_apply_begin().
+ *
+ * @p budget caps the work of the call, in bytes: each patch byte parsed
+ * and each image byte merged, copied, compared or hashed costs one. A call
+ * overruns it by at most one sector of work, plus the flash operations
+ * that work issues (a sector erase included). Progress is journaled as
+ * usual, so a reset between steps resumes like any interrupted apply.
+ *
+ * @param s      Context from tmd_apply_begin().
+ * @param budget Work allowed in this call; 0 = run to completion.
+ * @return ::TMD_STATUS_PENDING if work is left, ::TMD_STATUS_OK once the
+ *         patch is applied and the active slot flipped, error code
+ *         otherwise (sticky, as for tmd_stream_feed()).
+ */
+tmd_status_t tmd_apply_step(tmd_stream_t* s, uint32_t budget);
+
+/**
+ * @brief Start a streaming (push-style) patch application.
+ *
+ * The patch is consumed incrementally via tmd_stream_feed() as it arrives
+ * (e.g. BLE/LTE frames), so it never has to be resident in RAM and no staging
+ * area in flash is needed. Chunk payloads are written to the inactive slot as
+ * they are received; the active slot is only flipped by tmd_stream_finish()
+ * once every chunk has been received and verified.
+ *
+ * @param s Caller-owned context.
+ * @return ::TMD_STATUS_OK on success, error code otherwise.
+ */
+tmd_status_t tmd_stream_init(tmd_stream_t* s);
+
+/**
+ * @brief Feed the next @p len bytes of the patch.
+ *
+ * Bytes may be split at arbitrary boundaries. Errors are sticky: once a feed
+ * fails, every later call on the same context returns the same status.
+ *
+ * With TMD_FEAT_ASYNC_WRITE the last window program may still be in flight
+ * when this returns (never one from @p data); it completes during the next
+ * call on the context.
+ *
+ * @param s    Context initialized by tmd_stream_init().
+ * @param data Next patch bytes.
+ * @param len  Number of bytes in @p data.
+ * @return ::TMD_STATUS_OK if the bytes were accepted, error code otherwise.
+ */
+tmd_status_t tmd_stream_feed(tmd_stream_t* s, const uint8_t* data, size_t len);
+
+/**
+ * @brief Complete a streaming application and flip the active slot.
+ *
+ * Fails with ::TMD_STATUS_ERR_HDR if the patch ended before its last chunk.
+ *
+ * @param s Context that has been fed the whole patch.
+ * @return ::TMD_STATUS_OK on success, error code otherwise.
+ */
+tmd_status_t tmd_stream_finish(tmd_stream_t* s);
+
+/** Apply-path phases timed in tmd_stats_t::phase_us. */
+typedef enum {
+  TMD_PHASE_PARSE = 0, /**< Header, TLV and chunk record parsing. */
+  TMD_PHASE_GUARD,     /**< Guardrail checks. */
+  TMD_PHASE_COPY,      /**< Carrying source-slot bytes into the target. */
+  TMD_PHASE_DECODE,    /**< Decoding chunk payloads. */
+  TMD_PHASE_CRC,       /**< Chunk CRCs and image digests. */
+  TMD_PHASE_WRITE,     /**< flash_write() / flash_erase(). */
+  TMD_PHASE_JOURNAL,   /**< Journal load / commit / clear, slot flip. */
+  TMD_PHASE_N
+} tmd_phase_t;
+
+/** Size classes of tmd_stats_t::write_hist: <=16, <=64, <=256, <=1K, <=4K, more. */
+#define TMD_STATS_HIST_N 6
+
+/**
+ * @brief Cost of one patch application (TMD_FEAT_STATS).
+ *
+ * Phase times are exclusive (time in a flash_write() issued while copying
+ * counts as WRITE, not COPY) and only cover time spent inside tmd_stream_*
+ * calls. They stay 0 if the port has no now_us() clock.
+ */
+typedef struct {
+  uint32_t phase_us[TMD_PHASE_N];          /**< Microseconds per tmd_phase_t. */
+  uint32_t bytes_read;                     /**< Flash bytes read. */
+  uint32_t bytes_written;                  /**< Flash bytes programmed. */
+  uint32_t bytes_erased;                   /**< Flash bytes erased. */
+  uint32_t reads;                          /**< Flash read operations. */
+  uint32_t erases;                         /**< flash_erase() calls. */
+  uint32_t write_hist[TMD_STATS_HIST_N];   /**< flash_write() calls by length. */
+} tmd_stats_t;
+
+/**
+ * @brief Copy the statistics gathered so far by @p s into @p out.
+ *
+ * Valid at any point after tmd_stream_init(), including after
+ * tmd_stream_finish() or a failed feed, until the context is re-initialized.
+ *
+ * @param s   Streaming context.
+ * @param out Filled with the counters (all zero without TMD_FEAT_STATS).
+ * @return ::TMD_STATUS_OK, or ::TMD_STATUS_ERR_UNSUPPORTED if the core was
+ *         built without TMD_FEAT_STATS.
+ */
+tmd_status_t tmd_stream_stats(const tmd_stream_t* s, tmd_stats_t* out);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -22,6 +22,84 @@
 
 #include <stdint.h>
 
+/* --------------------------------------------------------------------------
+ *  Build Profiles
+ * --------------------------------------------------------------------------
+ *
+ * TMD_PROFILE picks the defaults of the feature flags below, so the core
+ * compiles to an applier with only the paths a deployment uses. Any flag
+ * can still be overridden on its own. Footprints: README "Footprint";
+ * `make -C runtime size` measures them with your compiler.
+ *
+ *   TMD_PROFILE_FULL     — every encoding, CRC32 digests, journal, in-place,
+ *                          prepare, step API, logging (default)
+ *   TMD_PROFILE_RLE_CRC  — RAW + RLE chunks, CRC32 chunks and digests,
+ *                          guardrails, journal; no LZ4/COPY/delta, in-place,
+ *                          prepare, step or inspect API, or logging
+ *   TMD_PROFILE_MINIMAL  — RAW chunks only, no integrity checks, guardrails
+ *                          or journal (an interrupted apply starts over; the
+ *                          A/B flip still only happens at the end), 512-byte
+ *                          context
+ */
+#define TMD_PROFILE_FULL     0
+#define TMD_PROFILE_RLE_CRC  1
+#define TMD_PROFILE_MINIMAL  2
+
+#ifndef TMD_PROFILE
+#define TMD_PROFILE TMD_PROFILE_FULL
+#endif
+
+#if TMD_PROFILE == TMD_PROFILE_RLE_CRC || TMD_PROFILE == TMD_PROFILE_MINIMAL
+  #ifndef TMD_FEAT_LZ4TINY
+  #define TMD_FEAT_LZ4TINY  0
+  #endif
+  #ifndef TMD_FEAT_COPY
+  #define TMD_FEAT_COPY     0
+  #endif
+  #ifndef TMD_FEAT_DELTA
+  #define TMD_FEAT_DELTA    0
+  #endif
+  #ifndef TMD_FEAT_IN_PLACE
+  #define TMD_FEAT_IN_PLACE 0
+  #endif
+  #ifndef TMD_FEAT_PREPARE
+  #define TMD_FEAT_PREPARE  0
+  #endif
+  #ifndef TMD_FEAT_STEP
+  #define TMD_FEAT_STEP     0
+  #endif
+  #ifndef TMD_FEAT_INSPECT
+  #define TMD_FEAT_INSPECT  0
+  #endif
+  #ifndef TMD_FEAT_LOG
+  #define TMD_FEAT_LOG      0
+  #endif
+#elif TMD_PROFILE != TMD_PROFILE_FULL
+#error "Unknown TMD_PROFILE"
+#endif
+
+#if TMD_PROFILE == TMD_PROFILE_MINIMAL
+  #ifndef TMD_FEAT_RLE
+  #define TMD_FEAT_RLE      0
+  #endif
+  #if !defined(TMD_USE_CRC32) && !defined(TMD_USE_SHA256) && \
+      !defined(TMD_USE_CMAC_CRC)
+  #define TMD_USE_CRC32     0
+  #ifndef TMD_NO_CHECK
+  #define TMD_NO_CHECK      1
+  #endif
+  #endif
+  #ifndef TMD_FEAT_GUARDRAILS
+  #define TMD_FEAT_GUARDRAILS 0
+  #endif
+  #ifndef TMD_FEAT_JOURNAL
+  #define TMD_FEAT_JOURNAL  0
+  #endif
+  #ifndef TMD_SCRATCH_SZ
+  #define TMD_SCRATCH_SZ    512
+  #endif
+#endif
+
 /* --------------------------------------------------------------------------
  *  Integrity Algorithms (pick exactly ONE)
  * --------------------------------------------------------------------------
@@ -54,6 +132,36 @@
 #error "Pick exactly ONE of: TMD_NO_CHECK, TMD_USE_CRC32, TMD_USE_CMAC_CRC, TMD_USE_SHA256"
 #endif
 
+/*
+ * Software CRC32 used when the port has no CRC hooks (tinymldelta_crc32.c):
+ *   0 = bitwise      (no table; smallest, slowest)
+ *   1 = table        (1 KiB const table; good default for Cortex-M0..M4)
+ *   2 = slice-by-8   (8 KiB const table; Cortex-M7/A-class and hosts)
+ */
+#ifndef TMD_CRC32_IMPL
+#define TMD_CRC32_IMPL    1
+#endif
+
+/*
+ * Whole-image digests from the patch header, checked in the same pass that
+ * builds the target image (no extra flash pass), before the slot flip:
+ *   TMD_VERIFY_BASE   — base_chk over the first base_len bytes of the active
+ *                       slot (rejects a patch made for a different model)
+ *   TMD_VERIFY_TARGET — target_chk over the target_len bytes written
+ * Active with TMD_USE_CRC32 or TMD_USE_SHA256; ignored otherwise.
+ */
+#ifndef TMD_VERIFY_BASE
+#define TMD_VERIFY_BASE   1
+#endif
+#ifndef TMD_VERIFY_TARGET
+#define TMD_VERIFY_TARGET 1
+#endif
+
+/* Bytes reserved for the port's SHA-256 context (per digest, x2). */
+#ifndef TMD_SHA256_CTX_SZ
+#define TMD_SHA256_CTX_SZ 128
+#endif
+
 /* Optional COSE signatures (future OTA authenticity layer). */
 #ifndef TMD_USE_COSE_SIG
 #define TMD_USE_COSE_SIG  0
@@ -64,13 +172,25 @@
  * --------------------------------------------------------------------------
  *
  * RLE: Simple run-length encoding for repetitive deltas.
- * LZ4Tiny: Placeholder for future compressed chunk formats.
+ * LZ4Tiny: LZ4 block decoding (enc=2). Needs no history buffer: matches are
+ *          served from the merge window or read back from the dst slot.
+ * COPY: Copy a range of the source slot (enc=3), so data a re-layout only
+ *       moved costs 8 payload bytes instead of its full length.
+ * DELTA: XOR / SUB residuals against source bytes (enc flags 0x10 / 0x20),
+ *        so small weight updates RLE-compress. Source bytes are read with
+ *        flash_read() during the merge; no extra RAM.
  */
 #ifndef TMD_FEAT_RLE
 #define TMD_FEAT_RLE      1
 #endif
 #ifndef TMD_FEAT_LZ4TINY
-#define TMD_FEAT_LZ4TINY  0
+#define TMD_FEAT_LZ4TINY  1
+#endif
+#ifndef TMD_FEAT_COPY
+#define TMD_FEAT_COPY     1
+#endif
+#ifndef TMD_FEAT_DELTA
+#define TMD_FEAT_DELTA    1
 #endif
 
 /* --------------------------------------------------------------------------
@@ -78,8 +198,15 @@
  * --------------------------------------------------------------------------
  *
  * TMD_SCRATCH_SZ   — RAM scratch buffer for decoding chunks (RLE/LZ4Tiny).
+ *                    Also the fixed size of the streaming context
+ *                    (tmd_stream_t); must be a multiple of 8.
  * TMD_ALIGN_WRITE  — Ensure writes align to flash driver requirements.
  * TMD_SECTOR_SZ    — Typical MCU flash erase sector size (4 KiB default).
+ * TMD_ZERO_COPY_MIN — Smallest run of RAW patch bytes written straight from
+ *                    the caller's buffer instead of through the merge window
+ *                    (whole TMD_ALIGN_WRITE units only). Keeps tiny feeds
+ *                    from turning into tiny flash writes. Only used if the
+ *                    port sets TMD_PORT_CAP_WRITE_FROM_PATCH.
  */
 #ifndef TMD_SCRATCH_SZ
 #define TMD_SCRATCH_SZ    1024
@@ -90,6 +217,28 @@
 #ifndef TMD_SECTOR_SZ
 #define TMD_SECTOR_SZ     4096     /* Common value for most MCUs */
 #endif
+#ifndef TMD_ZERO_COPY_MIN
+#define TMD_ZERO_COPY_MIN 64
+#endif
+
+/*
+ * Asynchronous flash programming (tmd_ports_t::flash_*_async, flash_poll):
+ * the work buffer becomes two merge windows, so the next window is decoded
+ * and checked while the previous one is being programmed, and a sector's
+ * erase is started as soon as merging into it begins. Each window is half
+ * the size, so TMD_SCRATCH_SZ must be at least 1024 bytes; ports that leave
+ * the hooks NULL get the synchronous calls.
+ */
+#ifndef TMD_FEAT_ASYNC_WRITE
+#define TMD_FEAT_ASYNC_WRITE 0
+#endif
+
+#if (TMD_SCRATCH_SZ % 8) != 0 || TMD_SCRATCH_SZ < 512
+#error "TMD_SCRATCH_SZ must be a multiple of 8 and at least 512 bytes"
+#endif
+#if TMD_FEAT_ASYNC_WRITE && TMD_SCRATCH_SZ < 1024
+#error "TMD_FEAT_ASYNC_WRITE needs TMD_SCRATCH_SZ >= 1024"
+#endif
 
 /* --------------------------------------------------------------------------
  *  Journal & Diagnostics
@@ -97,18 +246,86 @@
  *
  * Journaling enables crash-safe model updates. The journal tracks:
  *   • which patch is being applied
- *   • the next chunk index
+ *   • the next chunk index and the finalized part of the target slot
  *   • which slot is the target
  *
+ * Ports either provide journal_read/write/clear, or leave them NULL and let
+ * the core keep an append-only journal log in the layout's meta region.
+ *
  * Logging is optional; useful for debugging or POSIX simulations.
  */
 #ifndef TMD_FEAT_JOURNAL
 #define TMD_FEAT_JOURNAL  1
 #endif
+
+/*
+ * Journal commit interval. Progress can only be recorded at the end of a
+ * sector of the target image; a commit is made at the first sector boundary
+ * after at least TMD_JOURNAL_COMMIT_BYTES of the image have been finalized,
+ * or TMD_JOURNAL_COMMIT_CHUNKS chunks have been completed (0 disables the
+ * chunk trigger), since the previous commit. Larger intervals mean fewer
+ * journal writes but more work redone after an interruption.
+ */
+#ifndef TMD_JOURNAL_COMMIT_BYTES
+#define TMD_JOURNAL_COMMIT_BYTES   TMD_SECTOR_SZ   /* Every sector */
+#endif
+#ifndef TMD_JOURNAL_COMMIT_CHUNKS
+#define TMD_JOURNAL_COMMIT_CHUNKS  0
+#endif
+
+/*
+ * In-place apply (tmd_layout_t.in_place): patch the active slot itself,
+ * sector by sector, saving each sector's original to a swap sector in the
+ * meta region first. Needs the journal to be crash safe.
+ */
+#ifndef TMD_FEAT_IN_PLACE
+#define TMD_FEAT_IN_PLACE TMD_FEAT_JOURNAL
+#endif
+#if TMD_FEAT_IN_PLACE && !TMD_FEAT_JOURNAL
+#error "TMD_FEAT_IN_PLACE requires TMD_FEAT_JOURNAL"
+#endif
+
+/*
+ * tmd_prepare_slot(): erase the destination sectors of a pending patch ahead
+ * of the apply, in budgeted steps. Progress lives in the journal.
+ */
+#ifndef TMD_FEAT_PREPARE
+#define TMD_FEAT_PREPARE TMD_FEAT_JOURNAL
+#endif
+#if TMD_FEAT_PREPARE && !TMD_FEAT_JOURNAL
+#error "TMD_FEAT_PREPARE requires TMD_FEAT_JOURNAL"
+#endif
+
+/*
+ * tmd_apply_begin() / tmd_apply_step(): apply a patch held in memory in
+ * slices of bounded work, e.g. between inference runs. Costs ~40 bytes of
+ * the context.
+ */
+#ifndef TMD_FEAT_STEP
+#define TMD_FEAT_STEP     1
+#endif
+
+/*
+ * tmd_inspect_patch(): check a patch held in memory (header, TLVs, chunk
+ * table, CRCs, guardrails) and estimate its flash cost, without any flash
+ * access.
+ */
+#ifndef TMD_FEAT_INSPECT
+#define TMD_FEAT_INSPECT  1
+#endif
 #ifndef TMD_FEAT_LOG
 #define TMD_FEAT_LOG      1
 #endif
 
+/*
+ * Apply statistics (tmd_stream_stats()): per-phase time via the port's
+ * now_us() clock, flash byte counters and a flash_write() size histogram.
+ * Costs one clock read per phase change and ~90 bytes of the context.
+ */
+#ifndef TMD_FEAT_STATS
+#define TMD_FEAT_STATS    0
+#endif
+
 /* --------------------------------------------------------------------------
  *  Derived features (do not modify manually)
  * --------------------------------------------------------------------------
@@ -140,6 +357,14 @@
   #define TMD_FEAT_SHA256 0
 #endif
 
+#if TMD_USE_CRC32 || TMD_USE_SHA256
+  #define TMD_FEAT_VERIFY_BASE   TMD_VERIFY_BASE
+  #define TMD_FEAT_VERIFY_TARGET TMD_VERIFY_TARGET
+#else
+  #define TMD_FEAT_VERIFY_BASE   0
+  #define TMD_FEAT_VERIFY_TARGET 0
+#endif
+
 #if TMD_FEAT_AES_CMAC && TMD_FEAT_SHA256
 #error "Enable either CMAC OR SHA256 (not both)."
 #endif
@@ -157,8 +382,14 @@
  *   • IO hash mismatch (if enabled)
  *
  * These protect devices from incompatible or dangerous model upgrades.
+ * TMD_FEAT_GUARDRAILS=0 compiles the TLV decoding and these checks out;
+ * metadata is then skipped unread.
  */
 
+#ifndef TMD_FEAT_GUARDRAILS
+#define TMD_FEAT_GUARDRAILS 1
+#endif
+
 #ifndef TMD_FIRMWARE_ARENA_BYTES
 #define TMD_FIRMWARE_ARENA_BYTES  (64 * 1024)   /* Example: 64 KiB arena */
 #endif
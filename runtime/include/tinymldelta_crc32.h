@@ -0,0 +1,45 @@
+#ifndef TINYMLDELTA_CRC32_H_
+#define TINYMLDELTA_CRC32_H_
+/**
+ * @file tinymldelta_crc32.h
+ * @brief TinyMLDelta — Incremental software CRC32 (IEEE, as used by zlib).
+ * @author Felix Galindo
+ * @license Apache-2.0
+ *
+ * Used by the core for chunk CRCs when the port has no CRC hooks, and
+ * available to ports and applications that need a CRC32 of their own. The
+ * implementation is selected with TMD_CRC32_IMPL in tinymldelta_config.h.
+ *
+ * Usage:
+ *
+ *   uint32_t c = tmd_crc32_init();
+ *   c = tmd_crc32_update(c, part1, n1);
+ *   c = tmd_crc32_update(c, part2, n2);
+ *   uint32_t crc = tmd_crc32_final(c);   // == zlib.crc32(part1 + part2)
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tinymldelta_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initial CRC register value. */
+uint32_t tmd_crc32_init(void);
+
+/** @brief Feed @p len bytes into the register @p crc; returns the new register. */
+uint32_t tmd_crc32_update(uint32_t crc, const void* buf, size_t len);
+
+/** @brief Turn a register into the final CRC value. */
+uint32_t tmd_crc32_final(uint32_t crc);
+
+/** @brief One-shot CRC32 of @p len bytes. */
+uint32_t tmd_crc32(const void* buf, size_t len);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* TINYMLDELTA_CRC32_H_ */
@@ -63,10 +63,29 @@ typedef struct __attribute__((packed)) {
   uint16_t meta_len;   /**< Total size in bytes of the metadata TLV block
                             immediately following this header. */
 
-  uint16_t flags;      /**< Reserved for future extensions (semantic versioning,
-                            signature flags, encryption policy, etc.). */
+  uint16_t flags;      /**< TMD_HDR_F_* bits. Others are reserved for future
+                            extensions (semantic versioning, signature flags,
+                            encryption policy, etc.). */
 } tmd_hdr_t;
 
+/** Header flags (tmd_hdr_t.flags). */
+enum {
+  /**
+   * Built for the device's flash geometry: data chunks start on program-unit
+   * boundaries, span whole units (except at the image end) and never cross
+   * an erase sector, so the core writes RAW payloads straight from the
+   * patch buffer to flash_write() without staging them in RAM.
+   */
+  TMD_HDR_F_ALIGNED = 0x0001,
+
+  /**
+   * Safe to apply in place: no COPY or delta chunk reads source bytes from
+   * a sector before the one it writes, since those have been rewritten by
+   * then. Required by tmd_layout_t.in_place.
+   */
+  TMD_HDR_F_IN_PLACE = 0x0002,
+};
+
 
 /* --------------------------------------------------------------------------
  *  Chunk Record Header
@@ -84,25 +103,55 @@ typedef struct __attribute__((packed)) {
  * Payload encoding may be:
  *    • RAW (verbatim bytes)
  *    • RLE (simple run-length encoding)
- *
- * The core validates chunk bounds before writing to flash.
+ *    • LZ4 (LZ4 block format; matches may reach back up to 64 KiB into the
+ *      target image before the chunk, i.e. into earlier chunks and the
+ *      source bytes carried over between them)
+ *    • COPY (bytes taken from the source slot at another offset)
+ *    • XOR / SUB delta (RAW or RLE residual against source slot bytes)
+ *
+ * Chunks must appear in ascending offset order and must not overlap: the
+ * core merges source bytes and chunk bytes in a single forward pass over the
+ * slot and rejects a chunk that starts before the end of the previous one
+ * (TMD_STATUS_ERR_HDR). The core validates chunk bounds before writing to
+ * flash.
  */
 
 typedef struct __attribute__((packed)) {
   uint32_t off;      /**< Byte offset inside the model image where payload
                           should be written (relative to slot base). */
 
-  uint16_t len;      /**< Length of encoded payload in bytes (RAW or RLE). */
+  uint16_t len;      /**< Length of encoded payload in bytes (8 for COPY). */
 
-  uint8_t  enc;      /**< Encoding:
+  uint8_t  enc;      /**< Encoding (TMD_ENC_*):
                           0 = RAW
                           1 = RLE
-                          Future: LZ4Tiny, etc. */
+                          2 = LZ4 block (needs TMD_FEAT_LZ4TINY)
+                          3 = COPY from source (needs TMD_FEAT_COPY)
+                          | 0x10 / 0x20 = XOR / SUB delta of a RAW or RLE
+                          body against the source (needs TMD_FEAT_DELTA) */
 
   uint8_t  has_crc;  /**< If 1, a CRC32 appears immediately before payload. */
 } tmd_chunk_hdr_t;
 
 
+/** Chunk payload encodings (tmd_chunk_hdr_t.enc). */
+enum {
+  TMD_ENC_RAW = 0, /**< Verbatim bytes. */
+  TMD_ENC_RLE = 1, /**< [count][byte] pairs, count 0 => 256. */
+  TMD_ENC_LZ4 = 2, /**< LZ4 block, prefix = target image before the chunk. */
+  TMD_ENC_COPY = 3,/**< u32 src_off, u32 count: source slot bytes. */
+
+  /**
+   * Delta flags, OR'ed onto TMD_ENC_RAW or TMD_ENC_RLE. The payload is
+   * <u32 src_off> followed by the body; each decoded body byte is combined
+   * with the source slot byte at src_off onwards. Fine-tuned int8 weights
+   * move by a few steps, so the residual is mostly zeros and small values.
+   */
+  TMD_ENC_F_XOR = 0x10, /**< target = source ^ decoded. */
+  TMD_ENC_F_SUB = 0x20, /**< target = source + decoded (mod 256). */
+};
+
+
 /* --------------------------------------------------------------------------
  *  Metadata TLV (Type-Length-Value)
  * --------------------------------------------------------------------------
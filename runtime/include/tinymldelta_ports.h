@@ -59,13 +59,26 @@ typedef struct {
  *   - slotB: location + size
  *   - meta_addr/meta_size: region reserved for journaling or metadata pages
  *
- * The core uses these values to copy slots atomically and safely.
+ * The core uses these values to copy slots atomically and safely. If the
+ * port leaves the journal hooks NULL, the core keeps its own append-only
+ * journal log in the meta region (a whole number of erase sectors; 0
+ * disables journaling for such ports).
+ *
+ * With in_place set (TMD_FEAT_IN_PLACE), there is no second slot: the
+ * active slot is patched in place and slotB is unused. The first
+ * TMD_SECTOR_SZ bytes of the meta region become the swap sector that holds
+ * the original of the sector being rewritten; the journal log, if the core
+ * keeps it, takes the rest, which must be at least two sectors. Only
+ * patches built for it (TMD_HDR_F_IN_PLACE) are accepted, the base digest
+ * is checked before anything is erased, and the model is unusable until the
+ * apply has completed.
  */
 typedef struct {
   tmd_slot_t slotA;     /**< Primary model slot */
   tmd_slot_t slotB;     /**< Secondary model slot */
   uint32_t   meta_addr; /**< Flash region used for journaling */
   uint32_t   meta_size; /**< Journal size in bytes */
+  bool       in_place;  /**< Patch the active slot in place (single slot) */
 } tmd_layout_t;
 
 /* --------------------------------------------------------------------------
@@ -75,19 +88,59 @@ typedef struct {
  *
  * Fields:
  *   magic          - Identifies journal validity ('TMDP')
- *   patch_id       - Optional: ID of patch being applied
- *   next_chunk_idx - Which diff chunk still needs to be applied
+ *   patch_id       - ID of the patch being applied (hash of its header)
+ *   next_chunk_idx - First diff chunk not yet fully committed
+ *   dst_off        - Bytes of the target slot already final (sector aligned)
+ *   swap_sector    - In-place mode: 1 + index of the sector whose original
+ *                    is held in the swap sector (0 = none)
+ *   prep_chunk_idx - tmd_prepare_slot(): first chunk not yet prepared
+ *   prep_off       - tmd_prepare_slot(): target slot bytes already prepared
+ *                    (sector aligned); between dst_off and prep_off, sectors
+ *                    the patch programs are erased and the others match the
+ *                    source. The apply clears both before its first write.
  *   target_slot    - Which slot is being written (0 or 1)
  *
- * After a reboot mid-update, the core resumes from next_chunk_idx.
+ * The core rewrites the journal at sector boundaries of the target image,
+ * batched per TMD_JOURNAL_COMMIT_BYTES / TMD_JOURNAL_COMMIT_CHUNKS. After a
+ * reboot mid-update, re-applying the same patch resumes at dst_off: chunks
+ * before next_chunk_idx are skipped without being decoded and nothing below
+ * dst_off is erased or written again. A journal whose patch_id or
+ * target_slot does not match is discarded.
  */
 typedef struct {
   uint32_t magic;          /**< Must match TMD_JOURNAL_MAGIC */
-  uint32_t patch_id;       /**< Optional patch identifier */
-  uint32_t next_chunk_idx; /**< Next unapplied chunk index */
+  uint32_t patch_id;       /**< Identifier of the patch being applied */
+  uint32_t next_chunk_idx; /**< First chunk not yet fully committed */
+  uint32_t dst_off;        /**< Target slot bytes already final */
+  uint32_t swap_sector;    /**< In-place: 1 + sector held in swap (0 = none) */
+  uint32_t prep_chunk_idx; /**< First chunk not yet prepared */
+  uint32_t prep_off;       /**< Target slot bytes already prepared */
   uint8_t  target_slot;    /**< Destination slot (0=A, 1=B) */
 } tmd_journal_t;
 
+/* --------------------------------------------------------------------------
+ * Port capabilities (tmd_ports_t::caps)
+ * --------------------------------------------------------------------------
+ * TMD_PORT_CAP_WRITE_FROM_PATCH — flash_write() accepts a source pointer into
+ *   the caller's patch buffer, which may itself be memory-mapped / XIP flash.
+ *   Lets RAW payloads go to flash without a copy through the merge window
+ *   (see TMD_ZERO_COPY_MIN). Leave it clear if the driver cannot program
+ *   from a buffer that lives in flash (e.g. single-bank parts that stall
+ *   XIP reads during a program operation).
+ * TMD_PORT_CAP_READ_WHILE_WRITE — with TMD_FEAT_ASYNC_WRITE, flash can be
+ *   read (flash_read() or flash_map) while an asynchronous erase/program is
+ *   in flight elsewhere, e.g. dual-bank parts with the slots in different
+ *   banks. The core still waits before reading the range being written.
+ *   Without it, every read first waits for the operation to complete.
+ */
+#define TMD_PORT_CAP_WRITE_FROM_PATCH 0x00000001u
+#define TMD_PORT_CAP_READ_WHILE_WRITE 0x00000002u
+
+/* flash_poll() results. */
+#define TMD_FLASH_IDLE   0   /**< Last operation completed successfully. */
+#define TMD_FLASH_BUSY   1   /**< Still in progress. */
+#define TMD_FLASH_ERROR  (-1) /**< Last operation failed. */
+
 /* --------------------------------------------------------------------------
  * Platform port interface
  * --------------------------------------------------------------------------
@@ -111,10 +164,45 @@ typedef struct {
   bool (*flash_read)(uint32_t addr, void* dst, uint32_t len);
       /**< Read len bytes from addr into dst. */
 
+  const uint8_t* flash_map;
+      /**< Optional: flash address 0 mapped into memory (XIP flash, or an
+           mmap'ed image on a host), NULL if not mapped. When set, the core
+           reads flash through it instead of flash_read(), and compares and
+           hashes slot contents in place without copying them into the
+           work buffer. Must cover every address in the layout and show
+           completed flash_write()/flash_erase() results. */
+
+  uint32_t caps;
+      /**< TMD_PORT_CAP_* flags. */
+
+#if TMD_FEAT_ASYNC_WRITE
+  bool (*flash_erase_async)(uint32_t addr, uint32_t len);
+      /**< Optional: start erasing len bytes at addr and return at once.
+           False if the operation could not be started. */
+
+  bool (*flash_write_async)(uint32_t addr, const void* src, uint32_t len);
+      /**< Optional: start programming len bytes at addr (e.g. QSPI/DMA).
+           The core leaves src untouched until flash_poll() reports the
+           operation done. */
+
+  int (*flash_poll)(void);
+      /**< Optional: state of the last started operation: TMD_FLASH_BUSY,
+           TMD_FLASH_IDLE or TMD_FLASH_ERROR. The core keeps at most one
+           operation in flight and calls this until it is no longer busy,
+           so a completion interrupt (callback) only has to record the
+           result, and the port may sleep here until it arrives. All three
+           set, or the core uses the synchronous calls above. */
+#endif
+
   /* -------------------- Integrity algorithms -------------------- */
 #if TMD_FEAT_CRC32
-  uint32_t (*crc32)(const void* buf, size_t len);
-      /**< Optional: CRC32 checksum used for chunk-level integrity. */
+  uint32_t (*crc32_init)(void);
+  uint32_t (*crc32_update)(uint32_t crc, const void* buf, size_t len);
+  uint32_t (*crc32_final)(uint32_t crc);
+      /**< Optional: incremental CRC32 (IEEE) for chunk-level integrity, e.g.
+           backed by a hardware CRC peripheral. The register value is passed
+           through so data can be fed as it streams in. Leave all three NULL
+           to use the core's software CRC (tinymldelta_crc32.h). */
 #endif
 
 #if TMD_FEAT_SHA256
@@ -139,6 +227,8 @@ typedef struct {
 
   /* -------------------- Crash-safe journal -------------------- */
 #if TMD_FEAT_JOURNAL
+  /* Optional: leave all three NULL to use the core's journal log in the
+   * layout's meta region, which needs no erase per commit. */
   bool (*journal_read)(tmd_journal_t* out);
       /**< Load journal state from flash (may be all zero if no journal). */
 
@@ -149,6 +239,13 @@ typedef struct {
       /**< Clear journal after a successful update. */
 #endif
 
+  /* -------------------- Optional instrumentation -------------------- */
+#if TMD_FEAT_STATS
+  uint32_t (*now_us)(void);
+      /**< Optional: free-running microsecond clock (wraps) for the phase
+           times of tmd_stats_t. NULL to only count bytes and operations. */
+#endif
+
   /* -------------------- Optional logging -------------------- */
 #if TMD_FEAT_LOG
   void (*log)(const char* fmt, ...);
@@ -161,7 +258,7 @@ typedef struct {
  * Returns the platform’s port table.
  *
  * Must be implemented by the platform (POSIX, MCU, Zephyr, Arduino, etc.).
- * The TinyMLDelta core calls tmd_ports()->flash_*(), tmd_ports()->crc32(), etc.
+ * The TinyMLDelta core calls tmd_ports()->flash_*(), tmd_ports()->crc32_*(), etc.
  * -------------------------------------------------------------------------- */
 const tmd_ports_t* tmd_ports(void);
 
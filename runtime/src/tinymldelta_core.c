@@ -5,9 +5,12 @@
  * @license Apache-2.0
  */
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include "tinymldelta.h"
 #include "tinymldelta_config.h"
+#include "tinymldelta_crc32.h"
 #include "tinymldelta_internal.h"
 #include "tinymldelta_ports.h"
 
@@ -33,142 +36,313 @@ typedef struct {
   uint32_t io_hash;
 } tmd_meta_state_t;
 
+#define TMD_FEAT_DIGEST (TMD_FEAT_VERIFY_BASE || TMD_FEAT_VERIFY_TARGET)
+
+#if TMD_FEAT_DIGEST
+/**
+ * @brief Running whole-image digest (the header's base_chk / target_chk).
+ */
+typedef struct {
+#if TMD_FEAT_SHA256
+  uint64_t ctx[(TMD_SHA256_CTX_SZ + 7) / 8]; /**< Port SHA-256 context. */
+#else
+  uint32_t crc;                              /**< CRC32 register. */
+#endif
+} tmd_digest_t;
+#endif
+
 /**
- * @brief Simple RLE decode: [count][byte], count==0 => 256.
+ * @brief Parser states of the streaming applier.
  *
- * Format:
- *   [c0][v0][c1][v1]...
+ * The patch is consumed strictly front to back:
  *
- * Where:
- *   - c == 0 encodes run length 256.
- *   - Otherwise, run length == c (1..255).
+ *   HDR -> (TLV_HDR -> TLV_VAL)* -> (CHUNK_HDR -> [CHUNK_CRC] -> PAYLOAD)* -> DONE
  *
- * @param in       Pointer to encoded input buffer.
- * @param in_len   Length of encoded input.
- * @param out      Destination buffer for decoded bytes.
- * @param out_cap  Capacity of @p out in bytes.
- * @param out_len  Receives decoded length on success.
+ * Fixed-size fields are accumulated into the context until complete, so input
+ * fragments may be split at any byte.
  *
- * @return 0 on success, -1 on error (e.g., overflow).
+ * PAYLOAD fragments are merged and may be programmed as they arrive, while
+ * the chunk CRC is only checked once the last payload byte is in. The CRC
+ * therefore guards the commit of the update (target digest, slot flip), not
+ * the writes or the journal commits made meanwhile: a chunk that fails it
+ * may already have changed the destination, which is then never activated.
  */
-static int tmd_rle_decode(const uint8_t* in, uint16_t in_len,
-                          uint8_t* out, uint32_t out_cap,
-                          uint32_t* out_len) {
-#if !TMD_FEAT_RLE
-  (void)in; (void)in_len; (void)out; (void)out_cap; (void)out_len;
-  return -1;
-#else
-  uint32_t o = 0;
-  uint16_t i = 0;
+enum {
+  TMD_ST_HDR = 0,    /**< Accumulating tmd_hdr_t. */
+  TMD_ST_TLV_HDR,    /**< Accumulating a tmd_meta_tlv_t. */
+  TMD_ST_TLV_VAL,    /**< Consuming a TLV value. */
+  TMD_ST_CHUNK_HDR,  /**< Accumulating a tmd_chunk_hdr_t. */
+  TMD_ST_CHUNK_CRC,  /**< Accumulating the optional per-chunk CRC32. */
+  TMD_ST_PAYLOAD,    /**< Consuming chunk payload bytes. */
+  TMD_ST_DONE,       /**< All chunks applied; waiting for finish. */
+  TMD_ST_CLOSED      /**< Finished or failed; no further input accepted. */
+};
+
+/**
+ * @brief Fixed part of the streaming context.
+ */
+typedef struct {
+  tmd_hdr_t           hdr;       /**< Copy of the patch header. */
+  tmd_chunk_hdr_t     ch;        /**< Header of the chunk being consumed. */
+  tmd_meta_tlv_t      tlv;       /**< Header of the TLV being consumed. */
+#if TMD_FEAT_GUARDRAILS
+  tmd_meta_state_t    meta;      /**< Parsed guardrail metadata. */
+#endif
+#if TMD_FEAT_JOURNAL
+  tmd_journal_t       j;         /**< Journal record (last commit). */
+  uint32_t            jlog_next; /**< Next free record of the journal log. */
+  uint32_t            jlog_seq;  /**< Sequence number of the next record. */
+#endif
+  const tmd_ports_t*  P;         /**< Ports vtable. */
+  const tmd_slot_t*   src;       /**< Active slot the patch is based on. */
+  const tmd_slot_t*   dst;       /**< Inactive slot being written. */
+#if TMD_FEAT_DIGEST
+  tmd_digest_t        dig_base;  /**< Digest of the active slot's base image. */
+  tmd_digest_t        dig_tgt;   /**< Digest of the image being written. */
+  uint32_t            base_pos;  /**< Source bytes folded into dig_base. */
+  uint32_t            tgt_pos;   /**< Dst bytes folded into dig_tgt. */
+  uint32_t            fold_base; /**< Up-front passes (tmd_begin_fold()): */
+  uint32_t            fold_tgt;  /**< fold the slots up to here, */
+  uint8_t             fold_chk;  /**< then check the base digest if 1. */
+#endif
+  tmd_status_t        status;    /**< Sticky status; first error wins. */
+  uint8_t             state;     /**< One of TMD_ST_*. */
+  uint8_t             inactive;  /**< Index of the slot being written. */
+#if TMD_FEAT_IN_PLACE
+  uint8_t             inplace;   /**< 1 if src and dst are the same slot. */
+#endif
+  uint8_t             rle_count; /**< RLE count byte awaiting its value. */
+  uint8_t             rle_half;  /**< 1 if rle_count is pending. */
+#if TMD_FEAT_LZ4TINY
+  uint8_t             lz_state;  /**< LZ4 parser state (TMD_LZ_*). */
+  uint8_t             lz_tok;    /**< Token of the current LZ4 sequence. */
+  uint16_t            lz_off;    /**< Match offset being assembled. */
+  uint32_t            lz_len;    /**< Literal/match length being consumed. */
+#endif
+#if TMD_FEAT_COPY
+  uint8_t             cp_arg[8]; /**< COPY payload: src offset, length. */
+#endif
+#if TMD_FEAT_DELTA
+  uint8_t             dl_op;     /**< TMD_ENC_F_XOR / _SUB of the chunk, or 0. */
+  uint32_t            dl_src;    /**< Source offset of the next delta byte. */
+#endif
+  uint8_t             skip;      /**< 1 if the current chunk was already applied. */
+  uint8_t             tlv_val[4];/**< Leading bytes of the current TLV value. */
+  uint16_t            chunk_idx; /**< Index of the chunk being consumed. */
+  uint16_t            meta_rem;  /**< TLV block bytes not yet consumed. */
+  uint32_t            have;      /**< Bytes accumulated for the current field. */
+  uint32_t            pay_rem;   /**< Payload bytes left in current chunk. */
+  uint32_t            cur;       /**< Dst bytes below this offset are final. */
+  uint32_t            fill;      /**< Merged bytes pending in buf at cur. */
+  uint32_t            out;       /**< Dst offset of the next chunk byte. */
+  uint32_t            crc_exp;   /**< CRC32 carried in the chunk record. */
+  uint32_t            crc_run;   /**< Running CRC32 register over payload. */
+  uint32_t            img_end;   /**< End of the last sector of the image. */
+#if TMD_FEAT_ASYNC_WRITE
+  uint32_t            busy_addr; /**< Flash range of the operation in flight */
+  uint32_t            busy_len;  /**< (valid while busy). */
+  uint32_t            erased;    /**< 1 + dst sector erased ahead of its first write. */
+  uint8_t             busy;      /**< 1 while an async erase/program is in flight. */
+  uint8_t             busy_ext;  /**< 1 if it programs from the caller's buffer. */
+  uint8_t             win;       /**< Merge window in use (0 or 1). */
+#endif
+#if TMD_FEAT_PREPARE
+  uint32_t            prep_end;  /**< Apply: tmd_prepare_slot() erased the
+                                      sectors below this that chunks write. */
+  uint32_t            prep_left; /**< tmd_prepare_slot(): erases left. */
+  uint32_t            prep_idx;  /**< tmd_prepare_slot(): chunk_idx at the
+                                      last sector end, where a stop resumes. */
+  uint8_t             prep;      /**< 1 if run by tmd_prepare_slot(). */
+#endif
+#if TMD_FEAT_STEP
+  const uint8_t*      sp_patch;  /**< tmd_apply_step(): the patch, */
+  size_t              sp_len;    /**< its length */
+  size_t              sp_off;    /**< and the bytes fed so far. */
+  uint32_t            sp_left;   /**< Work left in the current step. */
+  const uint8_t*      rs_data;   /**< Merge cut short by the budget: */
+  uint32_t            rs_arg;    /**< tmd_win_merge() arguments */
+  uint32_t            rs_n;      /**< (rs_n bytes left, 0: none). */
+  const uint8_t*      rs_in;     /**< Payload bytes not decoded yet. */
+  uint32_t            rs_in_n;   /**< Number of them. */
+  uint8_t             rs_kind;   /**< TMD_PUT_* of the cut merge. */
+  uint8_t             rs_hdr;    /**< 1: chunk header gap fill cut short. */
+  uint8_t             rs_end;    /**< 1: the chunk ends once the rest is in. */
+  uint8_t             step;      /**< 1 if run by tmd_apply_step(). */
+#endif
+#if TMD_FEAT_STATS
+  tmd_stats_t         stats;     /**< Counters for tmd_stream_stats(). */
+  uint32_t            t_mark;    /**< now_us() at the last phase change. */
+  uint8_t             phase;     /**< Phase being timed (TMD_PHASE_N: none). */
+#endif
+} tmd_stream_state_t;
 
-  TMD_LOG("TinyMLDelta: RLE decode start (in_len=%u)\n", (unsigned)in_len);
+/**
+ * @brief Private layout of tmd_stream_t: fixed state plus a work buffer that
+ *        takes up the rest of the TMD_SCRATCH_SZ budget.
+ *
+ * buf is the merge window: the pending bytes [cur, cur + fill) of the
+ * destination, assembled from source bytes and decoded chunk bytes before
+ * they are programmed. While the window is empty it doubles as the bounce
+ * buffer for sector compare and copy.
+ *
+ * With TMD_FEAT_ASYNC_WRITE buf holds two windows: the one being filled
+ * (win) and the one whose program may still be in flight.
+ */
+typedef struct {
+  tmd_stream_state_t st;
+  uint8_t            buf[TMD_SCRATCH_SZ - sizeof(tmd_stream_state_t)];
+} tmd_stream_impl_t;
 
-  while (i + 1 <= in_len) {
-    uint8_t count = in[i++];
-    uint8_t val   = in[i++];
-    uint32_t run = (count == 0) ? 256u : (uint32_t)count;
+_Static_assert(sizeof(tmd_stream_state_t) + 64 <= TMD_SCRATCH_SZ,
+               "TMD_SCRATCH_SZ too small for the streaming context");
+_Static_assert(sizeof(tmd_stream_impl_t) <= sizeof(tmd_stream_t),
+               "tmd_stream_t storage too small");
 
-    if (o + run > out_cap) {
-      TMD_LOG("TinyMLDelta: RLE overflow (o=%lu run=%lu cap=%lu)\n",
-              (unsigned long)o,
-              (unsigned long)run,
-              (unsigned long)out_cap);
-      return -1;
-    }
-    memset(out + o, val, run);
-    o += run;
-  }
-  *out_len = o;
+#define TMD_WORK_SZ ((uint32_t)sizeof(((tmd_stream_impl_t*)0)->buf))
+#if TMD_FEAT_ASYNC_WRITE
+/** Merge window size, a whole number of flash write units. */
+#define TMD_WIN_SZ  (TMD_WORK_SZ / 2u - (TMD_WORK_SZ / 2u) % (uint32_t)TMD_ALIGN_WRITE)
+/** Start of the merge window in use. */
+#define TMD_WIN(S)  ((S)->buf + (S)->st.win * TMD_WIN_SZ)
+_Static_assert(TMD_WORK_SZ / 2u >= 64u + TMD_ALIGN_WRITE,
+               "TMD_SCRATCH_SZ too small for two merge windows");
+#else
+#define TMD_WIN_SZ  (TMD_WORK_SZ - TMD_WORK_SZ % (uint32_t)TMD_ALIGN_WRITE)
+#define TMD_WIN(S)  ((S)->buf)
+#endif
 
-  TMD_LOG("TinyMLDelta: RLE decode done (out_len=%lu)\n", (unsigned long)o);
-  return 0;
+#if TMD_FEAT_PREPARE
+/** True if the context is run by tmd_prepare_slot(). */
+#define TMD_PREP(S) ((S)->st.prep != 0)
+#else
+#define TMD_PREP(S) false
+#endif
+
+#if TMD_FEAT_STEP
+/** True once the tmd_apply_step() call running @p S has spent its budget. */
+#define TMD_STEP_OUT(S) ((S)->st.step && (S)->st.sp_left == 0)
+#else
+#define TMD_STEP_OUT(S) false
 #endif
-}
 
+#if TMD_FEAT_CRC32
 /**
- * @brief Parse metadata TLV block from the patch header.
- *
- * Core understands the standard TLVs; vendor TLVs are ignored.
- *
- * @param buf       Pointer to TLV blob.
- * @param meta_len  Length of TLV blob in bytes.
- * @param meta      Output: parsed metadata state.
- *
- * @return TMD_STATUS_OK on success, error status otherwise.
+ * @brief CRC32 register helpers: the port's CRC hooks when it provides them
+ *        (e.g. a hardware CRC unit), the software CRC module otherwise.
  */
-static tmd_status_t tmd_parse_meta(const uint8_t* buf,
-                                   uint16_t meta_len,
-                                   tmd_meta_state_t* meta) {
-  memset(meta, 0, sizeof(*meta));
-  uint16_t off = 0;
+static uint32_t tmd_crc_init(const tmd_ports_t* P) {
+  return P->crc32_init ? P->crc32_init() : tmd_crc32_init();
+}
 
-  TMD_LOG("TinyMLDelta: parsing meta TLVs (meta_len=%u)\n",
-          (unsigned)meta_len);
+static uint32_t tmd_crc_update(const tmd_ports_t* P, uint32_t crc,
+                               const uint8_t* p, size_t n) {
+  return P->crc32_update ? P->crc32_update(crc, p, n)
+                         : tmd_crc32_update(crc, p, n);
+}
 
-  while (off + sizeof(tmd_meta_tlv_t) <= meta_len) {
-    const tmd_meta_tlv_t* tlv = (const tmd_meta_tlv_t*)(buf + off);
-    uint16_t val_off = off + sizeof(tlv->tag) + sizeof(tlv->len);
-    uint16_t avail   = (uint16_t)(meta_len - val_off);
+static uint32_t tmd_crc_final(const tmd_ports_t* P, uint32_t crc) {
+  return P->crc32_final ? P->crc32_final(crc) : tmd_crc32_final(crc);
+}
+#endif
 
-    if (tlv->len > avail) {
-      TMD_LOG("TinyMLDelta: TLV length exceed (tag=%u len=%u avail=%u)\n",
-              (unsigned)tlv->tag,
-              (unsigned)tlv->len,
-              (unsigned)avail);
-      return TMD_STATUS_ERR_HDR;
-    }
+#if TMD_FEAT_DIGEST
+static void tmd_dig_init(const tmd_ports_t* P, tmd_digest_t* d) {
+#if TMD_FEAT_SHA256
+  P->sha256_init(d->ctx);
+#else
+  d->crc = tmd_crc_init(P);
+#endif
+}
 
-    const uint8_t* val = buf + val_off;
-    switch (tlv->tag) {
-      case TMD_META_REQ_ARENA_BYTES:
-        if (tlv->len == 4) {
-          meta->req_arena_bytes = (uint32_t)val[0] |
-                                  ((uint32_t)val[1] << 8) |
-                                  ((uint32_t)val[2] << 16) |
-                                  ((uint32_t)val[3] << 24);
-          TMD_LOG("TinyMLDelta: meta.req_arena_bytes=%lu\n",
-                  (unsigned long)meta->req_arena_bytes);
-        }
-        break;
-      case TMD_META_TFLM_ABI:
-        if (tlv->len == 2) {
-          meta->tflm_abi = (uint16_t)val[0] | ((uint16_t)val[1] << 8);
-          TMD_LOG("TinyMLDelta: meta.tflm_abi=%u\n",
-                  (unsigned)meta->tflm_abi);
-        }
-        break;
-      case TMD_META_OPSET_HASH:
-        if (tlv->len == 4) {
-          meta->opset_hash = (uint32_t)val[0] |
-                             ((uint32_t)val[1] << 8) |
-                             ((uint32_t)val[2] << 16) |
-                             ((uint32_t)val[3] << 24);
-          TMD_LOG("TinyMLDelta: meta.opset_hash=0x%08lx\n",
-                  (unsigned long)meta->opset_hash);
-        }
-        break;
-      case TMD_META_IO_HASH:
-        if (tlv->len == 4) {
-          meta->io_hash = (uint32_t)val[0] |
-                          ((uint32_t)val[1] << 8) |
-                          ((uint32_t)val[2] << 16) |
-                          ((uint32_t)val[3] << 24);
-          TMD_LOG("TinyMLDelta: meta.io_hash=0x%08lx\n",
-                  (unsigned long)meta->io_hash);
-        }
-        break;
-      default:
-        /* Vendor / unknown TLVs are ignored by core. */
-        TMD_LOG("TinyMLDelta: meta TLV ignored (tag=%u len=%u)\n",
-                (unsigned)tlv->tag,
-                (unsigned)tlv->len);
-        break;
-    }
+static void tmd_dig_update(const tmd_ports_t* P, tmd_digest_t* d,
+                           const uint8_t* p, size_t n) {
+#if TMD_FEAT_SHA256
+  P->sha256_update(d->ctx, p, n);
+#else
+  d->crc = tmd_crc_update(P, d->crc, p, n);
+#endif
+}
 
-    off = (uint16_t)(val_off + tlv->len);
-  }
+/**
+ * @brief Finalize @p d and compare it with a 32-byte header digest field
+ *        (CRC32: little-endian in the first 4 bytes, rest zero).
+ */
+static int tmd_dig_match(const tmd_ports_t* P, tmd_digest_t* d,
+                         const uint8_t expect[32]) {
+  uint8_t got[32];
+  memset(got, 0, sizeof(got));
+#if TMD_FEAT_SHA256
+  P->sha256_final(d->ctx, got);
+#else
+  uint32_t c = tmd_crc_final(P, d->crc);
+  got[0] = (uint8_t)c;
+  got[1] = (uint8_t)(c >> 8);
+  got[2] = (uint8_t)(c >> 16);
+  got[3] = (uint8_t)(c >> 24);
+#endif
+  return memcmp(got, expect, sizeof(got)) == 0;
+}
+#endif
 
-  return TMD_STATUS_OK;
+#if TMD_FEAT_GUARDRAILS || TMD_FEAT_COPY
+/**
+ * @brief Read a little-endian u32 from an unaligned byte pointer.
+ */
+static uint32_t tmd_rd_u32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+#endif
+
+#if TMD_FEAT_GUARDRAILS
+/**
+ * @brief Decode one standard metadata TLV value into @p meta.
+ *
+ * Core understands the standard TLVs; vendor TLVs are ignored.
+ *
+ * @param meta Parsed metadata state to update.
+ * @param tag  TLV tag.
+ * @param len  TLV value length.
+ * @param val  Leading bytes of the value (at least min(len, 4)).
+ */
+static void tmd_meta_apply(tmd_meta_state_t* meta, uint8_t tag, uint8_t len,
+                           const uint8_t* val) {
+  switch (tag) {
+    case TMD_META_REQ_ARENA_BYTES:
+      if (len == 4) {
+        meta->req_arena_bytes = tmd_rd_u32(val);
+        TMD_LOG("TinyMLDelta: meta.req_arena_bytes=%lu\n",
+                (unsigned long)meta->req_arena_bytes);
+      }
+      break;
+    case TMD_META_TFLM_ABI:
+      if (len == 2) {
+        meta->tflm_abi = (uint16_t)val[0] | ((uint16_t)val[1] << 8);
+        TMD_LOG("TinyMLDelta: meta.tflm_abi=%u\n",
+                (unsigned)meta->tflm_abi);
+      }
+      break;
+    case TMD_META_OPSET_HASH:
+      if (len == 4) {
+        meta->opset_hash = tmd_rd_u32(val);
+        TMD_LOG("TinyMLDelta: meta.opset_hash=0x%08lx\n",
+                (unsigned long)meta->opset_hash);
+      }
+      break;
+    case TMD_META_IO_HASH:
+      if (len == 4) {
+        meta->io_hash = tmd_rd_u32(val);
+        TMD_LOG("TinyMLDelta: meta.io_hash=0x%08lx\n",
+                (unsigned long)meta->io_hash);
+      }
+      break;
+    default:
+      /* Vendor / unknown TLVs are ignored by core. */
+      TMD_LOG("TinyMLDelta: meta TLV ignored (tag=%u len=%u)\n",
+              (unsigned)tag,
+              (unsigned)len);
+      break;
+  }
 }
 
 /**
@@ -231,325 +405,3110 @@ static tmd_status_t tmd_check_guardrails(const tmd_meta_state_t* meta) {
 #endif
   return TMD_STATUS_OK;
 }
+#else
+/* Guardrails compiled out: TLVs are consumed unread and nothing is checked. */
+#define tmd_meta_apply(meta, tag, len, val) ((void)(tag), (void)(len), (void)(val))
+#define tmd_check_guardrails(meta)          TMD_STATUS_OK
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Streaming applier                                                          */
+/* -------------------------------------------------------------------------- */
+
+static tmd_stream_impl_t* tmd_impl(tmd_stream_t* s) {
+  return (tmd_stream_impl_t*)(void*)s;
+}
 
+/* -------------------------------------------------------------------------- */
+/* Instrumentation                                                            */
+/* -------------------------------------------------------------------------- */
+
+#if TMD_FEAT_STATS
 /**
- * @brief Copy an entire slot from src to dst using the ports interface.
- *
- * This is used to clone the currently-active slot into the inactive slot
- * before applying chunk-level modifications.
+ * @brief Charge the time since the last change to the current phase and
+ *        switch to @p ph (TMD_PHASE_N: outside the core, not timed).
  *
- * @param P   Ports vtable.
- * @param src Source slot.
- * @param dst Destination slot.
- *
- * @return TMD_STATUS_OK on success, error code otherwise.
+ * @return The phase that was current, for restoring it afterwards.
  */
-static tmd_status_t tmd_copy_slot(const tmd_ports_t* P,
-                                  const tmd_slot_t* src,
-                                  const tmd_slot_t* dst) {
-  uint8_t buf[TMD_SCRATCH_SZ];
-  uint32_t remaining = src->size;
-  uint32_t src_off = 0;
-  uint32_t dst_off = 0;
-
-  TMD_LOG("TinyMLDelta: copy_slot src=0x%08lx dst=0x%08lx size=%lu\n",
-          (unsigned long)src->addr,
-          (unsigned long)dst->addr,
-          (unsigned long)src->size);
-
-  /* Erase destination range. */
-  if (!P->flash_erase(dst->addr, dst->size)) {
-    TMD_LOG("TinyMLDelta: flash_erase failed @0x%08lx size=%lu\n",
-            (unsigned long)dst->addr,
-            (unsigned long)dst->size);
-    return TMD_STATUS_ERR_FLASH;
+static uint8_t tmd_phase(tmd_stream_impl_t* S, uint8_t ph) {
+  uint8_t prev = S->st.phase;
+  if (ph != prev) {
+    if (S->st.P->now_us) {
+      uint32_t now = S->st.P->now_us();
+      if (prev < TMD_PHASE_N) {
+        S->st.stats.phase_us[prev] += now - S->st.t_mark;
+      }
+      S->st.t_mark = now;
+    }
+    S->st.phase = ph;
   }
+  return prev;
+}
 
-  while (remaining > 0) {
-    uint32_t chunk = (remaining > TMD_SCRATCH_SZ) ? TMD_SCRATCH_SZ : remaining;
+/**
+ * @brief Count a flash_write() of @p n bytes in its write_hist size class.
+ */
+static void tmd_stat_write(tmd_stream_impl_t* S, uint32_t n) {
+  uint32_t lim = 16;
+  uint8_t  b = 0;
+  while (b < TMD_STATS_HIST_N - 1 && n > lim) {
+    ++b;
+    lim <<= 2;
+  }
+  S->st.stats.write_hist[b]++;
+  S->st.stats.bytes_written += n;
+}
 
-    TMD_LOG("TinyMLDelta:  copy chunk src_off=%lu dst_off=%lu len=%lu\n",
-            (unsigned long)src_off,
-            (unsigned long)dst_off,
-            (unsigned long)chunk);
+#define TMD_STAT_ADD(S, f, n)     ((S)->st.stats.f += (uint32_t)(n))
+#define TMD_PHASE_SET(S, ph)      ((void)tmd_phase((S), (uint8_t)(ph)))
+#define TMD_PHASE_ENTER(S, v, ph) uint8_t v = tmd_phase((S), (uint8_t)(ph))
+#define TMD_PHASE_LEAVE(S, v)     ((void)tmd_phase((S), (v)))
+#else
+#define TMD_STAT_ADD(S, f, n)     ((void)0)
+#define TMD_PHASE_SET(S, ph)      ((void)0)
+#define TMD_PHASE_ENTER(S, v, ph) ((void)0)
+#define TMD_PHASE_LEAVE(S, v)     ((void)0)
+#endif
 
-    if (!P->flash_read(src->addr + src_off, buf, chunk)) {
-      TMD_LOG("TinyMLDelta: flash_read failed @0x%08lx len=%lu\n",
-              (unsigned long)(src->addr + src_off),
-              (unsigned long)chunk);
-      return TMD_STATUS_ERR_FLASH;
-    }
-    if (!P->flash_write(dst->addr + dst_off, buf, chunk)) {
-      TMD_LOG("TinyMLDelta: flash_write failed @0x%08lx len=%lu\n",
-              (unsigned long)(dst->addr + dst_off),
-              (unsigned long)chunk);
-      return TMD_STATUS_ERR_FLASH;
-    }
-    remaining -= chunk;
-    src_off   += chunk;
-    dst_off   += chunk;
-  }
+/* -------------------------------------------------------------------------- */
+/* Asynchronous flash operations                                              */
+/* -------------------------------------------------------------------------- */
 
-  TMD_LOG("TinyMLDelta: copy_slot done\n");
-  return TMD_STATUS_OK;
+#if TMD_FEAT_ASYNC_WRITE
+/**
+ * @brief True if the port provides the asynchronous flash hooks.
+ */
+static bool tmd_async(const tmd_stream_impl_t* S) {
+  const tmd_ports_t* P = S->st.P;
+  return P->flash_erase_async && P->flash_write_async && P->flash_poll;
 }
 
 /**
- * @brief Apply a TinyMLDelta patch already resident in memory.
- *
- * Typical flow:
- *   1. Parse and validate header.
- *   2. Parse metadata TLVs and enforce guardrails.
- *   3. Clone active slot into inactive slot.
- *   4. Apply each chunk into the inactive slot.
- *   5. Flip active slot to the updated one.
+ * @brief Wait for the flash operation in flight, if any, to complete.
  *
- * @param patch      Pointer to patch bytes.
- * @param patch_len  Length of patch in bytes.
+ * Timed as TMD_PHASE_WRITE (JOURNAL while committing): this is the erase /
+ * program time that decoding could not hide.
  *
- * @return TMD_STATUS_OK on success, error code otherwise.
+ * @return false if the operation failed.
  */
-tmd_status_t tmd_apply_patch_from_memory(const uint8_t* patch, size_t patch_len) {
-  const tmd_ports_t*   P = tmd_ports();
-  const tmd_layout_t*  L = tmd_layout();
-  if (!P || !L || !patch || patch_len < sizeof(tmd_hdr_t)) {
-    TMD_LOG("TinyMLDelta: invalid params (P=%p L=%p patch=%p len=%lu)\n",
-            (const void*)P,
-            (const void*)L,
-            (const void*)patch,
-            (unsigned long)patch_len);
-    return TMD_STATUS_ERR_PARAM;
+static bool tmd_flash_wait(tmd_stream_impl_t* S) {
+  if (!S->st.busy) {
+    return true;
+  }
+#if TMD_FEAT_STATS
+  uint8_t ph = tmd_phase(S, (S->st.phase == TMD_PHASE_JOURNAL)
+                                ? TMD_PHASE_JOURNAL : TMD_PHASE_WRITE);
+#endif
+  int r;
+  while ((r = S->st.P->flash_poll()) == TMD_FLASH_BUSY) {
   }
+  TMD_PHASE_LEAVE(S, ph);
+  S->st.busy = 0;
+  S->st.busy_ext = 0;
+  if (r != TMD_FLASH_IDLE) {
+    TMD_LOG("TinyMLDelta: async flash operation failed @0x%08lx len=%lu\n",
+            (unsigned long)S->st.busy_addr,
+            (unsigned long)S->st.busy_len);
+    return false;
+  }
+  return true;
+}
 
-  const tmd_hdr_t* hdr = (const tmd_hdr_t*)patch;
+/**
+ * @brief Make [addr, addr + len) safe to read: wait for the operation in
+ *        flight unless the port reads while writing
+ *        (TMD_PORT_CAP_READ_WHILE_WRITE) and the range is not being written.
+ */
+static bool tmd_flash_readable(tmd_stream_impl_t* S, uint32_t addr,
+                               uint32_t len) {
+  if (S->st.busy &&
+      ((S->st.P->caps & TMD_PORT_CAP_READ_WHILE_WRITE) == 0 ||
+       (addr < S->st.busy_addr + S->st.busy_len &&
+        S->st.busy_addr < addr + len))) {
+    return tmd_flash_wait(S);
+  }
+  return true;
+}
+#else
+#define tmd_flash_wait(S)           (true)
+#define tmd_flash_readable(S, a, n) (true)
+#endif
 
-  /* Patch header debug. */
-  TMD_LOG("TinyMLDelta: ---- Patch Header ----\n");
-  TMD_LOG("TinyMLDelta: v=%u algo=%u chunks_n=%u\n",
-          (unsigned)hdr->v,
-          (unsigned)hdr->algo,
-          (unsigned)hdr->chunks_n);
-  TMD_LOG("TinyMLDelta: base_len=%lu target_len=%lu\n",
-          (unsigned long)hdr->base_len,
-          (unsigned long)hdr->target_len);
-  TMD_LOG("TinyMLDelta: meta_len=%u flags=0x%04x\n",
-          (unsigned)hdr->meta_len,
-          (unsigned)hdr->flags);
+/**
+ * @brief Record a failure; the context rejects all further input.
+ *
+ * No flash operation is left in flight.
+ */
+static tmd_status_t tmd_fail(tmd_stream_impl_t* S, tmd_status_t st) {
+  (void)tmd_flash_wait(S);
+  TMD_PHASE_SET(S, TMD_PHASE_N);
+  S->st.status = st;
+  S->st.state = TMD_ST_CLOSED;
+  return st;
+}
 
-  if (hdr->v != 1) {
-    TMD_LOG("TinyMLDelta: unsupported patch version %u\n",
-            (unsigned)hdr->v);
-    return TMD_STATUS_ERR_HDR;
+/* -------------------------------------------------------------------------- */
+/* Flash access                                                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Read @p len bytes at flash address @p addr: a plain copy when the
+ *        port maps flash into memory (tmd_ports_t::flash_map), the port's
+ *        flash_read() otherwise.
+ */
+static bool tmd_read(tmd_stream_impl_t* S, uint32_t addr, void* dst,
+                     uint32_t len) {
+  const tmd_ports_t* P = S->st.P;
+  if (!tmd_flash_readable(S, addr, len)) {
+    return false;
+  }
+  TMD_STAT_ADD(S, reads, 1);
+  TMD_STAT_ADD(S, bytes_read, len);
+  if (P->flash_map != NULL) {
+    memcpy(dst, P->flash_map + addr, len);
+    return true;
   }
+  return P->flash_read(addr, dst, len);
+}
 
-#if TMD_USE_CRC32
-  if (hdr->algo != 1) {
-    TMD_LOG("TinyMLDelta: algo=%u not supported (expected CRC32=1)\n",
-            (unsigned)hdr->algo);
-    return TMD_STATUS_ERR_UNSUPPORTED;
+/**
+ * @brief flash_write(), timed as TMD_PHASE_WRITE (or JOURNAL for commits).
+ */
+static bool tmd_write(tmd_stream_impl_t* S, uint32_t addr, const void* src,
+                      uint32_t len) {
+  if (!tmd_flash_wait(S)) {
+    return false;
   }
-#else
-  (void)hdr;
+#if TMD_FEAT_STATS
+  uint8_t ph = tmd_phase(S, (S->st.phase == TMD_PHASE_JOURNAL)
+                                ? TMD_PHASE_JOURNAL : TMD_PHASE_WRITE);
+  tmd_stat_write(S, len);
 #endif
+  bool ok = S->st.P->flash_write(addr, src, len);
+  TMD_PHASE_LEAVE(S, ph);
+  return ok;
+}
 
-  size_t off = sizeof(tmd_hdr_t);
-  if (off + hdr->meta_len > patch_len) {
-    TMD_LOG("TinyMLDelta: meta_len out of range (off=%lu meta_len=%u len=%lu)\n",
-            (unsigned long)off,
-            (unsigned)hdr->meta_len,
-            (unsigned long)patch_len);
-    return TMD_STATUS_ERR_HDR;
+/**
+ * @brief flash_erase(), timed like tmd_write().
+ */
+static bool tmd_erase(tmd_stream_impl_t* S, uint32_t addr, uint32_t len) {
+  if (!tmd_flash_wait(S)) {
+    return false;
   }
+#if TMD_FEAT_STATS
+  uint8_t ph = tmd_phase(S, (S->st.phase == TMD_PHASE_JOURNAL)
+                                ? TMD_PHASE_JOURNAL : TMD_PHASE_WRITE);
+  TMD_STAT_ADD(S, erases, 1);
+  TMD_STAT_ADD(S, bytes_erased, len);
+#endif
+  bool ok = S->st.P->flash_erase(addr, len);
+  TMD_PHASE_LEAVE(S, ph);
+  return ok;
+}
 
-  /* Parse metadata TLVs. */
-  tmd_meta_state_t meta;
-  tmd_status_t st = tmd_parse_meta(patch + off, hdr->meta_len, &meta);
-  if (st != TMD_STATUS_OK) {
-    TMD_LOG("TinyMLDelta: tmd_parse_meta failed (%d)\n", (int)st);
-    return st;
+/**
+ * @brief Start programming @p len bytes at @p addr and return: through
+ *        flash_write_async() if the port has it, else tmd_write().
+ *
+ * @p src must stay untouched until the next tmd_flash_wait(); @p ext marks
+ * it as the caller's buffer, which is only valid during tmd_stream_feed().
+ */
+static bool tmd_write_start(tmd_stream_impl_t* S, uint32_t addr,
+                            const void* src, uint32_t len, bool ext) {
+#if TMD_FEAT_ASYNC_WRITE
+  if (tmd_async(S)) {
+    if (!tmd_flash_wait(S)) {
+      return false;
+    }
+#if TMD_FEAT_STATS
+    uint8_t ph = tmd_phase(S, TMD_PHASE_WRITE);
+    tmd_stat_write(S, len);
+#endif
+    bool ok = S->st.P->flash_write_async(addr, src, len);
+    TMD_PHASE_LEAVE(S, ph);
+    S->st.busy = ok ? 1u : 0u;
+    S->st.busy_ext = (ok && ext) ? 1u : 0u;
+    S->st.busy_addr = addr;
+    S->st.busy_len = len;
+    return ok;
   }
+#endif
+  (void)ext;
+  return tmd_write(S, addr, src, len);
+}
 
-  /* Guardrail checks. */
-  st = tmd_check_guardrails(&meta);
-  if (st != TMD_STATUS_OK) {
-    TMD_LOG("TinyMLDelta: guardrail check failed (%d)\n", (int)st);
-    return st;
+/**
+ * @brief Start erasing @p len bytes at @p addr, like tmd_write_start().
+ */
+static bool tmd_erase_start(tmd_stream_impl_t* S, uint32_t addr, uint32_t len) {
+#if TMD_FEAT_ASYNC_WRITE
+  if (tmd_async(S)) {
+    if (!tmd_flash_wait(S)) {
+      return false;
+    }
+#if TMD_FEAT_STATS
+    uint8_t ph = tmd_phase(S, TMD_PHASE_WRITE);
+    TMD_STAT_ADD(S, erases, 1);
+    TMD_STAT_ADD(S, bytes_erased, len);
+#endif
+    bool ok = S->st.P->flash_erase_async(addr, len);
+    TMD_PHASE_LEAVE(S, ph);
+    S->st.busy = ok ? 1u : 0u;
+    S->st.busy_addr = addr;
+    S->st.busy_len = len;
+    return ok;
   }
+#endif
+  return tmd_erase(S, addr, len);
+}
 
-  off += hdr->meta_len;
+/* -------------------------------------------------------------------------- */
+/* Journal storage                                                            */
+/* -------------------------------------------------------------------------- */
 
-  uint8_t active   = P->get_active_slot();
-  uint8_t inactive = (active == 0) ? 1 : 0;
-  const tmd_slot_t* slot_src = (active == 0) ? &L->slotA : &L->slotB;
-  const tmd_slot_t* slot_dst = (inactive == 0) ? &L->slotA : &L->slotB;
+#if TMD_FEAT_JOURNAL
+/**
+ * @brief FNV-1a over @p n bytes; used for patch IDs and journal records.
+ */
+static uint32_t tmd_fnv1a(const void* p, size_t n) {
+  const uint8_t* b = (const uint8_t*)p;
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= b[i];
+    h *= 16777619u;
+  }
+  return h;
+}
 
-  TMD_LOG("TinyMLDelta: active slot=%u inactive=%u\n",
-          (unsigned)active,
-          (unsigned)inactive);
-  TMD_LOG("TinyMLDelta: slotA addr=0x%08lx size=%lu\n",
-          (unsigned long)L->slotA.addr,
-          (unsigned long)L->slotA.size);
-  TMD_LOG("TinyMLDelta: slotB addr=0x%08lx size=%lu\n",
-          (unsigned long)L->slotB.addr,
-          (unsigned long)L->slotB.size);
+/**
+ * @brief Record of the core-managed journal log.
+ *
+ * Used when the port leaves the journal hooks NULL. Records are appended to
+ * erased space in the layout's meta region, so a commit is a single small
+ * write. A log of two or more sectors is written round-robin, one sector
+ * (page) at a time: a page is only erased when the log moves on to it, and
+ * the newest record then sits in the page before, so a power cut during
+ * the erase loses nothing. The valid record with the highest sequence
+ * number wins, which also makes a torn record harmless. Clearing appends a
+ * record with magic 0 rather than erasing. A log smaller than two sectors is
+ * a single page, erased when full; an interruption right after that erase
+ * loses the recorded progress, which A/B applies survive by starting over
+ * and in-place applies do not (tmd_stream_begin() refuses them).
+ */
+typedef struct {
+  tmd_journal_t j;
+  uint32_t      seq;     /**< Write order, newest wins. */
+  uint32_t      check;   /**< tmd_fnv1a() over j and seq. */
+} tmd_jrec_t;
 
-  if (slot_src->size != slot_dst->size) {
-    TMD_LOG("TinyMLDelta: slot size mismatch (src=%lu dst=%lu)\n",
-            (unsigned long)slot_src->size,
-            (unsigned long)slot_dst->size);
-    return TMD_STATUS_ERR_PARAM;
-  }
+/** Bytes of a record covered by its check word. */
+#define TMD_JREC_CHECKED ((uint32_t)offsetof(tmd_jrec_t, check))
 
-  /* Copy active slot to inactive slot. */
-  st = tmd_copy_slot(P, slot_src, slot_dst);
-  if (st != TMD_STATUS_OK) {
-    TMD_LOG("TinyMLDelta: tmd_copy_slot failed (%d)\n", (int)st);
-    return st;
-  }
+/** Record pitch in the meta region, a whole number of write units. */
+#define TMD_JREC_SZ \
+  ((((uint32_t)sizeof(tmd_jrec_t) + TMD_ALIGN_WRITE - 1u) / TMD_ALIGN_WRITE) * \
+   TMD_ALIGN_WRITE)
 
-#if TMD_FEAT_JOURNAL
-  tmd_journal_t j = {0};
-  if (!P->journal_read(&j) || j.magic != TMD_JOURNAL_MAGIC) {
-    memset(&j, 0, sizeof(j));
-    j.magic = TMD_JOURNAL_MAGIC;
-    j.patch_id = 0; /* local-only; could be derived from header digest */
-    j.next_chunk_idx = 0;
-    j.target_slot = inactive;
-    TMD_LOG("TinyMLDelta: journal init (target_slot=%u)\n",
-            (unsigned)inactive);
-  } else {
-    TMD_LOG("TinyMLDelta: journal resume (next_chunk=%lu target_slot=%u)\n",
-            (unsigned long)j.next_chunk_idx,
-            (unsigned)j.target_slot);
+/**
+ * @brief Start of the journal log: the meta region, after the swap sector
+ *        in in-place mode.
+ */
+static uint32_t tmd_jlog_addr(void) {
+  const tmd_layout_t* L = tmd_layout();
+#if TMD_FEAT_IN_PLACE
+  if (L->in_place) {
+    return L->meta_addr + (uint32_t)TMD_SECTOR_SZ;
   }
-#else
-  uint32_t next_chunk_idx = 0;
-  (void)next_chunk_idx;
 #endif
+  return L->meta_addr;
+}
 
-  uint8_t scratch[TMD_SCRATCH_SZ];
-
-  /* Apply chunks. */
-  for (uint32_t idx = 0; idx < hdr->chunks_n; ++idx) {
-    if (off + sizeof(tmd_chunk_hdr_t) > patch_len) {
-      TMD_LOG("TinyMLDelta: not enough data for chunk hdr idx=%lu\n",
-              (unsigned long)idx);
-      return TMD_STATUS_ERR_HDR;
-    }
-    const tmd_chunk_hdr_t* ch = (const tmd_chunk_hdr_t*)(patch + off);
-    off += sizeof(tmd_chunk_hdr_t);
+/**
+ * @brief Size of the journal log region in bytes.
+ */
+static uint32_t tmd_jlog_size(void) {
+  const tmd_layout_t* L = tmd_layout();
+  uint32_t used = tmd_jlog_addr() - L->meta_addr;
+  return (L->meta_size > used) ? L->meta_size - used : 0;
+}
 
-    TMD_LOG("TinyMLDelta: chunk[%lu]: off=%lu len=%u enc=%u has_crc=%u\n",
-            (unsigned long)idx,
-            (unsigned long)ch->off,
-            (unsigned)ch->len,
-            (unsigned)ch->enc,
-            (unsigned)ch->has_crc);
+/**
+ * @brief Size of one journal log page: a sector when the log has two or
+ *        more, else the whole log.
+ */
+static uint32_t tmd_jlog_page(void) {
+  uint32_t size = tmd_jlog_size();
+  return (size >= 2u * (uint32_t)TMD_SECTOR_SZ) ? (uint32_t)TMD_SECTOR_SZ
+                                                : size;
+}
 
-    uint32_t crc_val = 0;
-#if TMD_FEAT_CRC32
-    if (ch->has_crc) {
-      if (off + 4 > patch_len) {
-        TMD_LOG("TinyMLDelta: not enough data for chunk CRC idx=%lu\n",
-                (unsigned long)idx);
-        return TMD_STATUS_ERR_HDR;
-      }
-      crc_val = (uint32_t)patch[off] |
-                ((uint32_t)patch[off+1] << 8) |
-                ((uint32_t)patch[off+2] << 16) |
-                ((uint32_t)patch[off+3] << 24);
-      off += 4;
-
-      TMD_LOG("TinyMLDelta:  chunk[%lu] file_crc=0x%08lx\n",
-              (unsigned long)idx,
-              (unsigned long)crc_val);
-    }
-#endif
-    if (off + ch->len > patch_len) {
-      TMD_LOG("TinyMLDelta: chunk payload exceeds patch len idx=%lu\n",
-              (unsigned long)idx);
-      return TMD_STATUS_ERR_HDR;
+/**
+ * @brief Number of journal records one log page holds.
+ */
+static uint32_t tmd_jlog_per_page(void) {
+  return tmd_jlog_page() / TMD_JREC_SZ;
+}
+
+/**
+ * @brief Number of journal records the meta region holds (0 = no log).
+ */
+static uint32_t tmd_jlog_cap(void) {
+  uint32_t page = tmd_jlog_page();
+  return page ? (tmd_jlog_size() / page) * tmd_jlog_per_page() : 0;
+}
+
+/**
+ * @brief Flash address of journal log record @p i.
+ */
+static uint32_t tmd_jlog_rec_addr(uint32_t i) {
+  uint32_t per = tmd_jlog_per_page();
+  return tmd_jlog_addr() + (i / per) * tmd_jlog_page() +
+         (i % per) * TMD_JREC_SZ;
+}
+
+/**
+ * @brief Check a record's check word.
+ */
+static bool tmd_jrec_valid(const tmd_jrec_t* r) {
+  return r->check == tmd_fnv1a(r, TMD_JREC_CHECKED);
+}
+
+/**
+ * @brief True if the record at @p addr reads back fully erased.
+ */
+static bool tmd_jlog_blank(tmd_stream_impl_t* S, uint32_t addr) {
+  uint8_t rec[TMD_JREC_SZ];
+  if (!tmd_read(S, addr, rec, sizeof(rec))) {
+    return false;
+  }
+  for (uint32_t i = 0; i < sizeof(rec); ++i) {
+    if (rec[i] != 0xFFu) {
+      return false;
     }
-    const uint8_t* enc_data = patch + off;
-    off += ch->len;
+  }
+  return true;
+}
 
-#if TMD_FEAT_CRC32
-    if (ch->has_crc && P->crc32) {
-      uint32_t got = P->crc32(enc_data, ch->len);
-      if (got != crc_val) {
-        TMD_LOG("TinyMLDelta: chunk CRC mismatch idx=%lu got=0x%08lx exp=0x%08lx\n",
-                (unsigned long)idx,
-                (unsigned long)got,
-                (unsigned long)crc_val);
-        return TMD_STATUS_ERR_INTEGRITY;
+/**
+ * @brief Load the newest journal record and locate the log's free space:
+ *        after the last record written to the newest record's page.
+ */
+static bool tmd_jlog_read(tmd_stream_impl_t* S, tmd_journal_t* out) {
+  uint32_t cap = tmd_jlog_cap();
+  uint32_t per = tmd_jlog_per_page();
+  bool found = false;
+  bool ok = true;
+  uint32_t best = 0;
+  tmd_jrec_t r;
+
+  S->st.jlog_next = 0;
+  for (uint32_t pg = 0; pg < cap; pg += per) {
+    bool newest = false;
+    uint32_t i = pg;
+    for (; i < pg + per; ++i) {
+      if (!tmd_read(S, tmd_jlog_rec_addr(i), &r, sizeof(r))) {
+        /* Keep scanning, so the next record still outranks older ones. */
+        TMD_LOG("TinyMLDelta: journal log read failed @%lu\n",
+                (unsigned long)i);
+        ok = false;
+        continue;
+      }
+      if (r.j.magic == 0xFFFFFFFFu && r.seq == 0xFFFFFFFFu &&
+          r.check == 0xFFFFFFFFu) {
+        break; /* erased: end of this page */
+      }
+      if (tmd_jrec_valid(&r) && (!found || (int32_t)(r.seq - best) > 0)) {
+        *out = r.j;
+        best = r.seq;
+        found = true;
+        newest = true;
+      }
+    }
+    if (newest) {
+      S->st.jlog_next = i;
+    }
+  }
+  S->st.jlog_seq = found ? best + 1u : 0u;
+  return found && ok;
+}
+
+/**
+ * @brief Append one journal record. Moving on to a new page erases it
+ *        first unless it is blank; the newest record stays in the page
+ *        before.
+ */
+static bool tmd_jlog_write(tmd_stream_impl_t* S, const tmd_journal_t* in) {
+  uint32_t per = tmd_jlog_per_page();
+  uint8_t rec[TMD_JREC_SZ];
+  tmd_jrec_t r;
+
+  if (S->st.jlog_next >= tmd_jlog_cap()) {
+    S->st.jlog_next = 0;
+  }
+  if (S->st.jlog_next % per == 0) {
+    uint32_t page = tmd_jlog_rec_addr(S->st.jlog_next);
+    bool blank = true;
+    for (uint32_t i = 0; i < per && blank; ++i) {
+      blank = tmd_jlog_blank(S, page + i * TMD_JREC_SZ);
+    }
+    if (!blank && !tmd_erase(S, page, tmd_jlog_page())) {
+      return false;
+    }
+  }
+  memset(&r, 0, sizeof(r));
+  r.j = *in;
+  r.seq = S->st.jlog_seq;
+  r.check = tmd_fnv1a(&r, TMD_JREC_CHECKED);
+  memset(rec, 0xFF, sizeof(rec));
+  memcpy(rec, &r, sizeof(r));
+  if (!tmd_write(S, tmd_jlog_rec_addr(S->st.jlog_next), rec, TMD_JREC_SZ)) {
+    return false;
+  }
+  S->st.jlog_next++;
+  S->st.jlog_seq++;
+  return true;
+}
+
+/**
+ * @brief Journal backends: the port's hooks if it has them, else the log.
+ */
+static bool tmd_journal_load(tmd_stream_impl_t* S, tmd_journal_t* out) {
+  const tmd_ports_t* P = S->st.P;
+  TMD_PHASE_ENTER(S, ph, TMD_PHASE_JOURNAL);
+  bool ok = tmd_flash_wait(S) &&
+            (P->journal_read ? P->journal_read(out)
+                             : (tmd_jlog_cap() > 0 && tmd_jlog_read(S, out)));
+  TMD_PHASE_LEAVE(S, ph);
+  return ok;
+}
+
+static bool tmd_journal_store(tmd_stream_impl_t* S, const tmd_journal_t* in) {
+  const tmd_ports_t* P = S->st.P;
+  TMD_PHASE_ENTER(S, ph, TMD_PHASE_JOURNAL);
+  bool ok = tmd_flash_wait(S) &&
+            (P->journal_write ? P->journal_write(in)
+                              : (tmd_jlog_cap() == 0 || tmd_jlog_write(S, in)));
+  TMD_PHASE_LEAVE(S, ph);
+  return ok;
+}
+
+static bool tmd_journal_erase(tmd_stream_impl_t* S) {
+  const tmd_ports_t* P = S->st.P;
+  tmd_journal_t zero;
+  memset(&zero, 0, sizeof(zero));
+  TMD_PHASE_ENTER(S, ph, TMD_PHASE_JOURNAL);
+  bool ok = tmd_flash_wait(S) &&
+            (P->journal_clear ? P->journal_clear()
+                              : (tmd_jlog_cap() == 0 || tmd_jlog_write(S, &zero)));
+  TMD_PHASE_LEAVE(S, ph);
+  return ok;
+}
+#endif /* TMD_FEAT_JOURNAL */
+
+/**
+ * @brief Number of bytes of sector @p k that lie inside @p slot.
+ */
+static uint32_t tmd_sector_len(const tmd_slot_t* slot, uint32_t k) {
+  uint32_t off = k * (uint32_t)TMD_SECTOR_SZ;
+  uint32_t rem = slot->size - off;
+  return (rem < TMD_SECTOR_SZ) ? rem : (uint32_t)TMD_SECTOR_SZ;
+}
+
+/**
+ * @brief Erase dst sector @p k.
+ */
+static tmd_status_t tmd_sector_erase(tmd_stream_impl_t* S, uint32_t k) {
+  uint32_t addr = S->st.dst->addr + k * (uint32_t)TMD_SECTOR_SZ;
+  uint32_t len = tmd_sector_len(S->st.dst, k);
+
+  if (!tmd_erase_start(S, addr, len)) {
+    TMD_LOG("TinyMLDelta: flash_erase failed @0x%08lx size=%lu\n",
+            (unsigned long)addr,
+            (unsigned long)len);
+    return TMD_STATUS_ERR_FLASH;
+  }
+  return TMD_STATUS_OK;
+}
+
+#if TMD_FEAT_PREPARE
+/**
+ * @brief tmd_prepare_slot(): take one sector erase from the call's budget.
+ *
+ * @return TMD_STATUS_PENDING once the budget is spent.
+ */
+static tmd_status_t tmd_prep_erase(tmd_stream_impl_t* S) {
+  if (S->st.prep_left == 0) {
+    return TMD_STATUS_PENDING;
+  }
+  S->st.prep_left--;
+  return TMD_STATUS_OK;
+}
+#endif
+
+#if TMD_FEAT_STEP
+/**
+ * @brief tmd_apply_step(): charge @p n bytes of work to the call's budget.
+ */
+static void tmd_step_spend(tmd_stream_impl_t* S, uint32_t n) {
+  S->st.sp_left = (n < S->st.sp_left) ? S->st.sp_left - n : 0;
+}
+
+#if TMD_FEAT_DIGEST
+/**
+ * @brief Clamp @p n bytes of work to what the current step has left.
+ */
+static uint32_t tmd_step_cap(const tmd_stream_impl_t* S, uint32_t n) {
+  return (S->st.step && n > S->st.sp_left) ? S->st.sp_left : n;
+}
+#endif
+
+#if TMD_FEAT_RLE || TMD_FEAT_LZ4TINY
+/**
+ * @brief Keep payload bytes a decoder stopped short of, when @p st is
+ *        TMD_STATUS_PENDING, for the next tmd_apply_step() call.
+ *
+ * @return @p st.
+ */
+static tmd_status_t tmd_defer_input(tmd_stream_impl_t* S, const uint8_t* in,
+                                    uint32_t n, tmd_status_t st) {
+  if (st == TMD_STATUS_PENDING) {
+    S->st.rs_in = in;
+    S->st.rs_in_n = n;
+  }
+  return st;
+}
+#endif
+#else
+#define tmd_step_spend(S, n)         ((void)0)
+#define tmd_step_cap(S, n)           (n)
+#define tmd_defer_input(S, i, n, st) (st)
+#endif
+
+/**
+ * @brief Read @p n source image bytes from slot offset @p off.
+ *
+ * In place, the original of the sector being rewritten comes from the swap
+ * sector, and earlier sectors no longer hold source bytes at all; a patch
+ * built with TMD_HDR_F_IN_PLACE never asks for them.
+ *
+ * @return TMD_STATUS_OK on success, error code otherwise.
+ */
+static tmd_status_t tmd_src_read(tmd_stream_impl_t* S, uint32_t off,
+                                 uint8_t* p, uint32_t n) {
+#if TMD_FEAT_IN_PLACE
+  if (S->st.inplace && S->st.j.swap_sector > 0) {
+    uint32_t k  = S->st.j.swap_sector - 1u;
+    uint32_t lo = k * (uint32_t)TMD_SECTOR_SZ;
+    uint32_t hi = lo + tmd_sector_len(S->st.src, k);
+    if (off < lo) {
+      TMD_LOG("TinyMLDelta: in-place source read @%lu below swap sector %lu\n",
+              (unsigned long)off,
+              (unsigned long)k);
+      return TMD_STATUS_ERR_HDR;
+    }
+    if (off < hi) {
+      uint32_t m = (n < hi - off) ? n : hi - off;
+      uint32_t from = tmd_layout()->meta_addr + (off - lo);
+      if (!tmd_read(S, from, p, m)) {
+        TMD_LOG("TinyMLDelta: flash_read failed @0x%08lx len=%lu\n",
+                (unsigned long)from,
+                (unsigned long)m);
+        return TMD_STATUS_ERR_FLASH;
       }
+      off += m;
+      p += m;
+      n -= m;
     }
+  }
+#endif
+  if (n > 0 && !tmd_read(S, S->st.src->addr + off, p, n)) {
+    TMD_LOG("TinyMLDelta: flash_read failed @0x%08lx len=%lu\n",
+            (unsigned long)(S->st.src->addr + off),
+            (unsigned long)n);
+    return TMD_STATUS_ERR_FLASH;
+  }
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Fold source bytes [pos, pos+n) into the base digest.
+ *
+ * Digests are built strictly in order; bytes before base_pos were already
+ * folded and bytes past base_len are not part of the base image. Every
+ * source byte the merge pass reads goes through here, so the base digest
+ * costs no extra flash pass.
+ */
+static void tmd_fold_src(tmd_stream_impl_t* S, uint32_t pos,
+                         const uint8_t* p, uint32_t n) {
+#if TMD_FEAT_VERIFY_BASE
+  uint32_t end = (n > S->st.hdr.base_len - pos || pos > S->st.hdr.base_len)
+                     ? S->st.hdr.base_len : pos + n;
+  if (pos <= S->st.base_pos && end > S->st.base_pos) {
+    TMD_PHASE_ENTER(S, ph, TMD_PHASE_CRC);
+    tmd_dig_update(S->st.P, &S->st.dig_base, p + (S->st.base_pos - pos),
+                   end - S->st.base_pos);
+    TMD_PHASE_LEAVE(S, ph);
+    S->st.base_pos = end;
+  }
+#else
+  (void)S; (void)pos; (void)p; (void)n;
 #endif
+}
 
-    const uint8_t* data = NULL;
-    uint32_t data_len = 0;
+/**
+ * @brief Fold final dst bytes [pos, pos+n) into the target digest.
+ */
+static void tmd_fold_dst(tmd_stream_impl_t* S, uint32_t pos,
+                         const uint8_t* p, uint32_t n) {
+#if TMD_FEAT_VERIFY_TARGET
+  uint32_t end = (n > S->st.hdr.target_len - pos || pos > S->st.hdr.target_len)
+                     ? S->st.hdr.target_len : pos + n;
+  if (pos <= S->st.tgt_pos && end > S->st.tgt_pos) {
+    TMD_PHASE_ENTER(S, ph, TMD_PHASE_CRC);
+    tmd_dig_update(S->st.P, &S->st.dig_tgt, p + (S->st.tgt_pos - pos),
+                   end - S->st.tgt_pos);
+    TMD_PHASE_LEAVE(S, ph);
+    S->st.tgt_pos = end;
+  }
+#else
+  (void)S; (void)pos; (void)p; (void)n;
+#endif
+}
 
-    if (ch->enc == 0) { /* RAW */
-      data = enc_data;
-      data_len = ch->len;
-      TMD_LOG("TinyMLDelta:  chunk[%lu] RAW len=%lu\n",
-              (unsigned long)idx,
-              (unsigned long)data_len);
-    } else if (ch->enc == 1) { /* RLE */
-      if (tmd_rle_decode(enc_data, ch->len,
-                         scratch, sizeof(scratch),
-                         &data_len) != 0) {
-        TMD_LOG("TinyMLDelta: RLE decode failed idx=%lu\n",
-                (unsigned long)idx);
-        return TMD_STATUS_ERR_HDR;
+#if TMD_FEAT_DIGEST
+/**
+ * @brief Read [from, to) of the source (or, with @p tgt, the destination)
+ *        slot through the (empty) window and fold it into its digest.
+ *
+ * Only used for bytes the merge pass itself never reads: the slot prefix
+ * skipped by a journal resume, and a base image longer than the target.
+ */
+static tmd_status_t tmd_fold_range(tmd_stream_impl_t* S, bool tgt,
+                                   uint32_t from, uint32_t to) {
+  const tmd_slot_t* slot = tgt ? S->st.dst : S->st.src;
+  const uint8_t* map = S->st.P->flash_map;
+  while (from < to) {
+    uint32_t n = to - from;
+    const uint8_t* p = TMD_WIN(S);
+    if (map != NULL) {
+      if (!tmd_flash_readable(S, slot->addr + from, n)) {
+        return TMD_STATUS_ERR_FLASH;
       }
-      data = scratch;
-      TMD_LOG("TinyMLDelta:  chunk[%lu] RLE decoded len=%lu\n",
-              (unsigned long)idx,
-              (unsigned long)data_len);
+      p = map + slot->addr + from; /* fold straight from the mapping */
+      TMD_STAT_ADD(S, reads, 1);
+      TMD_STAT_ADD(S, bytes_read, n);
     } else {
-      TMD_LOG("TinyMLDelta: unsupported encoding %u\n", (unsigned)ch->enc);
-      return TMD_STATUS_ERR_UNSUPPORTED;
+      if (n > TMD_WIN_SZ) {
+        n = TMD_WIN_SZ;
+      }
+      if (!tmd_read(S, slot->addr + from, TMD_WIN(S), n)) {
+        TMD_LOG("TinyMLDelta: flash_read failed @0x%08lx len=%lu\n",
+                (unsigned long)(slot->addr + from),
+                (unsigned long)n);
+        return TMD_STATUS_ERR_FLASH;
+      }
     }
+    if (tgt) {
+      tmd_fold_dst(S, from, p, n);
+    } else {
+      tmd_fold_src(S, from, p, n);
+    }
+    from += n;
+  }
+  return TMD_STATUS_OK;
+}
 
-    if (ch->off + data_len > slot_dst->size) {
-      TMD_LOG("TinyMLDelta: chunk out of range (off=%lu,len=%lu,size=%lu)\n",
-              (unsigned long)ch->off,
-              (unsigned long)data_len,
-              (unsigned long)slot_dst->size);
-      return TMD_STATUS_ERR_PARAM;
+/**
+ * @brief Fold the source slot up to @p base_to and the destination slot up
+ *        to @p tgt_to into their digests (whichever are verified).
+ *
+ * Under tmd_apply_step() this works in slices of the budget; calling it
+ * again carries on.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if the step budget
+ *         ran out, error code otherwise.
+ */
+static tmd_status_t tmd_fold_upto(tmd_stream_impl_t* S, uint32_t base_to,
+                                  uint32_t tgt_to) {
+  if (!TMD_FEAT_VERIFY_BASE || base_to > S->st.hdr.base_len) {
+    base_to = TMD_FEAT_VERIFY_BASE ? S->st.hdr.base_len : 0;
+  }
+  if (!TMD_FEAT_VERIFY_TARGET || tgt_to > S->st.hdr.target_len) {
+    tgt_to = TMD_FEAT_VERIFY_TARGET ? S->st.hdr.target_len : 0;
+  }
+  while (S->st.base_pos < base_to || S->st.tgt_pos < tgt_to) {
+    if (TMD_STEP_OUT(S)) {
+      return TMD_STATUS_PENDING;
     }
+    bool tgt = (S->st.base_pos >= base_to);
+    uint32_t from = tgt ? S->st.tgt_pos : S->st.base_pos;
+    uint32_t n = tmd_step_cap(S, (tgt ? tgt_to : base_to) - from);
+    tmd_status_t st = tmd_fold_range(S, tgt, from, from + n);
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+    tmd_step_spend(S, n);
+  }
+  return TMD_STATUS_OK;
+}
 
-    uint32_t addr = slot_dst->addr + ch->off;
-    TMD_LOG("TinyMLDelta:  flash_write addr=0x%08lx len=%lu\n",
-            (unsigned long)addr,
-            (unsigned long)data_len);
+/**
+ * @brief Run the digest passes tmd_stream_begin() set up (fold_base,
+ *        fold_tgt, fold_chk) before the first chunk is merged.
+ *
+ * A no-op once they are done, so tmd_step_resume() simply calls it again.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if the step budget
+ *         ran out, error code otherwise.
+ */
+static tmd_status_t tmd_begin_fold(tmd_stream_impl_t* S) {
+  tmd_status_t st = tmd_fold_upto(S, S->st.fold_base, S->st.fold_tgt);
+  if (st != TMD_STATUS_OK || !S->st.fold_chk) {
+    return st;
+  }
+  S->st.fold_chk = 0;
+#if TMD_FEAT_VERIFY_BASE
+  if (!tmd_dig_match(S->st.P, &S->st.dig_base, S->st.hdr.base_chk)) {
+    TMD_LOG("TinyMLDelta: base digest mismatch: patch is for a different model\n");
+    return TMD_STATUS_ERR_INTEGRITY;
+  }
+  TMD_LOG("TinyMLDelta: base digest OK (%lu bytes)\n",
+          (unsigned long)S->st.base_pos);
+#endif
+  return TMD_STATUS_OK;
+}
+#endif
 
-    if (!P->flash_write(addr, data, data_len)) {
+/**
+ * @brief Bring an untouched dst sector in line with the source sector.
+ *
+ * No chunk writes into this sector, so its final content is the source
+ * content. The sectors are compared first; the erase + copy is only paid if
+ * the inactive slot holds something different (e.g. an older model).
+ *
+ * Only called with an empty merge window, so the whole window is free.
+ *
+ * @return TMD_STATUS_OK on success, error code otherwise.
+ */
+static tmd_status_t tmd_sector_sync(tmd_stream_impl_t* S, uint32_t k) {
+  const tmd_ports_t* P = S->st.P;
+  const uint32_t half = TMD_WIN_SZ / 2u;
+  uint8_t* w = TMD_WIN(S);
+  uint32_t src = S->st.src->addr + k * (uint32_t)TMD_SECTOR_SZ;
+  uint32_t dst = S->st.dst->addr + k * (uint32_t)TMD_SECTOR_SZ;
+  uint32_t len = tmd_sector_len(S->st.dst, k);
+  uint32_t base = k * (uint32_t)TMD_SECTOR_SZ;
+  uint32_t off = 0;
+
+#if TMD_FEAT_IN_PLACE
+  /* In place the sector already is the source: only the digest needs it. */
+  if (S->st.inplace) {
+#if TMD_FEAT_VERIFY_TARGET
+    return tmd_fold_range(S, true, base, base + len);
+#else
+    return TMD_STATUS_OK;
+#endif
+  }
+#endif
+
+  for (; off < len; ) {
+    uint32_t n = len - off;
+    const uint8_t* a = w;
+    const uint8_t* b = w + half;
+    if (P->flash_map != NULL) {
+      /* Compare and fold straight from the mapping, no copies. */
+      if (!tmd_flash_readable(S, src + off, n) ||
+          !tmd_flash_readable(S, dst + off, n)) {
+        return TMD_STATUS_ERR_FLASH;
+      }
+      a = P->flash_map + src + off;
+      b = P->flash_map + dst + off;
+      TMD_STAT_ADD(S, reads, 2);
+      TMD_STAT_ADD(S, bytes_read, 2u * n);
+    } else {
+      if (n > half) {
+        n = half;
+      }
+      if (!tmd_read(S, src + off, w, n) ||
+          !tmd_read(S, dst + off, w + half, n)) {
+        TMD_LOG("TinyMLDelta: flash_read failed in sector %lu\n",
+                (unsigned long)k);
+        return TMD_STATUS_ERR_FLASH;
+      }
+    }
+    if (memcmp(a, b, n) != 0) {
+      break;
+    }
+    tmd_fold_src(S, base + off, a, n);
+    tmd_fold_dst(S, base + off, a, n);
+    off += n;
+  }
+  if (off == len) {
+    return TMD_STATUS_OK;
+  }
+
+  tmd_status_t st = TMD_STATUS_OK;
+#if TMD_FEAT_PREPARE
+  if (S->st.prep) {
+    st = tmd_prep_erase(S);
+  }
+#endif
+  if (st == TMD_STATUS_OK) {
+    TMD_LOG("TinyMLDelta: sector %lu stale, erase+copy\n", (unsigned long)k);
+    st = tmd_sector_erase(S, k);
+  }
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+  for (off = 0; off < len; ) {
+    uint32_t n = len - off;
+    if (n > TMD_WIN_SZ) {
+      n = TMD_WIN_SZ;
+    }
+    if (!tmd_read(S, src + off, w, n)) {
+      TMD_LOG("TinyMLDelta: flash_read failed @0x%08lx len=%lu\n",
+              (unsigned long)(src + off),
+              (unsigned long)n);
+      return TMD_STATUS_ERR_FLASH;
+    }
+    if (!tmd_write(S, dst + off, w, n)) {
       TMD_LOG("TinyMLDelta: flash_write failed @0x%08lx len=%lu\n",
-              (unsigned long)addr,
-              (unsigned long)data_len);
+              (unsigned long)(dst + off),
+              (unsigned long)n);
       return TMD_STATUS_ERR_FLASH;
     }
+    tmd_fold_src(S, base + off, w, n);
+    tmd_fold_dst(S, base + off, w, n);
+    off += n;
+  }
+  return TMD_STATUS_OK;
+}
 
+/**
+ * @brief Record resume progress once a sector of the image is final.
+ *
+ * Called with an empty window, so every dst byte below cur is in flash and
+ * every chunk before chunk_idx has been fully emitted. A resume restarts at
+ * chunk_idx and drops whatever that chunk decodes below cur.
+ *
+ * Commits are batched per TMD_JOURNAL_COMMIT_BYTES / _CHUNKS.
+ */
+static void tmd_journal_commit(tmd_stream_impl_t* S) {
 #if TMD_FEAT_JOURNAL
-    j.next_chunk_idx = idx + 1;
-    P->journal_write(&j);
+  uint32_t* off = &S->st.j.dst_off;
+  uint32_t* idx = &S->st.j.next_chunk_idx;
+#if TMD_FEAT_PREPARE
+  if (S->st.prep) {
+    off = &S->st.j.prep_off; /* tmd_prepare_slot() progress */
+    idx = &S->st.j.prep_chunk_idx;
+    S->st.prep_idx = S->st.chunk_idx;
+  }
+#endif
+  int due = (S->st.cur - *off >= (uint32_t)TMD_JOURNAL_COMMIT_BYTES);
+#if TMD_JOURNAL_COMMIT_CHUNKS > 0
+  due |= (S->st.chunk_idx - *idx >= (uint32_t)TMD_JOURNAL_COMMIT_CHUNKS);
 #endif
+  if (!due) {
+    return;
   }
-
-#if TMD_FEAT_JOURNAL
-  TMD_LOG("TinyMLDelta: clearing journal\n");
-  P->journal_clear();
+  *idx = S->st.chunk_idx;
+  *off = S->st.cur;
+  if (!tmd_journal_store(S, &S->st.j)) {
+    TMD_LOG("TinyMLDelta: journal_write failed (dst_off=%lu)\n",
+            (unsigned long)S->st.cur);
+  }
+#else
+  (void)S;
 #endif
+}
 
-  if (!P->set_active_slot(inactive)) {
-    TMD_LOG("TinyMLDelta: set_active_slot(%u) failed\n",
-            (unsigned)inactive);
-    return TMD_STATUS_ERR_FLASH;
+#if TMD_FEAT_IN_PLACE
+/**
+ * @brief In place: save the original of the sector at the cursor to the
+ *        swap sector before the window starts on it.
+ *
+ * The journal first records progress up to the cursor, so the previous
+ * sector's original is no longer needed, then records that swap holds this
+ * sector. A resume therefore always finds the original of a partly
+ * rewritten sector in swap. Called with an empty window.
+ *
+ * @return TMD_STATUS_OK on success, error code otherwise.
+ */
+static tmd_status_t tmd_swap_enter(tmd_stream_impl_t* S) {
+  uint32_t k = S->st.cur / (uint32_t)TMD_SECTOR_SZ;
+  if (!S->st.inplace || S->st.fill != 0 ||
+      S->st.cur % (uint32_t)TMD_SECTOR_SZ != 0 ||
+      S->st.j.swap_sector == k + 1u) {
+    return TMD_STATUS_OK;
   }
 
-  TMD_LOG("TinyMLDelta: patch applied OK, new active slot=%u\n",
-          (unsigned)inactive);
+  uint32_t swap = tmd_layout()->meta_addr;
+  uint32_t src = S->st.src->addr + S->st.cur;
+  uint32_t len = tmd_sector_len(S->st.src, k);
+
+  TMD_PHASE_ENTER(S, ph, TMD_PHASE_COPY);
+  S->st.j.next_chunk_idx = S->st.chunk_idx;
+  S->st.j.dst_off = S->st.cur;
+  if (!tmd_journal_store(S, &S->st.j)) {
+    TMD_LOG("TinyMLDelta: journal_write failed (dst_off=%lu)\n",
+            (unsigned long)S->st.cur);
+    return TMD_STATUS_ERR_FLASH;
+  }
+  TMD_LOG("TinyMLDelta: sector %lu -> swap\n", (unsigned long)k);
+  if (!tmd_erase(S, swap, (uint32_t)TMD_SECTOR_SZ)) {
+    TMD_LOG("TinyMLDelta: flash_erase failed @0x%08lx size=%lu\n",
+            (unsigned long)swap,
+            (unsigned long)TMD_SECTOR_SZ);
+    return TMD_STATUS_ERR_FLASH;
+  }
+  for (uint32_t off = 0; off < len; ) {
+    uint32_t n = len - off;
+    if (n > TMD_WIN_SZ) {
+      n = TMD_WIN_SZ;
+    }
+    if (!tmd_read(S, src + off, TMD_WIN(S), n) ||
+        !tmd_write(S, swap + off, TMD_WIN(S), n)) {
+      TMD_LOG("TinyMLDelta: swap copy failed in sector %lu\n",
+              (unsigned long)k);
+      return TMD_STATUS_ERR_FLASH;
+    }
+    off += n;
+  }
+  S->st.j.swap_sector = k + 1u;
+  if (!tmd_journal_store(S, &S->st.j)) {
+    TMD_LOG("TinyMLDelta: journal_write failed (swap_sector=%lu)\n",
+            (unsigned long)k);
+    return TMD_STATUS_ERR_FLASH;
+  }
+  TMD_PHASE_LEAVE(S, ph);
   return TMD_STATUS_OK;
 }
+#else
+#define tmd_swap_enter(S) TMD_STATUS_OK
+#endif
+
+/**
+ * @brief True if dst sector @p k, about to get its first chunk write, is
+ *        erased already: ahead of the window (tmd_win_begin()) or by
+ *        tmd_prepare_slot().
+ */
+static bool tmd_sector_erased(const tmd_stream_impl_t* S, uint32_t k) {
+#if TMD_FEAT_ASYNC_WRITE
+  if (S->st.erased == k + 1u) {
+    return true;
+  }
+#endif
+#if TMD_FEAT_PREPARE
+  if (k * (uint32_t)TMD_SECTOR_SZ < S->st.prep_end) {
+    return true;
+  }
+#endif
+  (void)S; (void)k;
+  return false;
+}
+
+#if TMD_FEAT_ASYNC_WRITE
+/**
+ * @brief Start erasing the dst sector at the cursor when the window starts
+ *        on it, so the erase runs while the window is merged.
+ *
+ * Called with an empty window, after tmd_swap_enter().
+ *
+ * @return TMD_STATUS_OK on success, error code otherwise.
+ */
+static tmd_status_t tmd_win_begin(tmd_stream_impl_t* S) {
+  uint32_t k = S->st.cur / (uint32_t)TMD_SECTOR_SZ;
+  if (!tmd_async(S) || S->st.fill != 0 ||
+      S->st.cur % (uint32_t)TMD_SECTOR_SZ != 0 ||
+      S->st.cur >= S->st.dst->size || tmd_sector_erased(S, k)) {
+    return TMD_STATUS_OK;
+  }
+#if TMD_FEAT_PREPARE
+  if (S->st.prep) {
+    return TMD_STATUS_OK; /* erases are budgeted in tmd_win_write() */
+  }
+#endif
+#if TMD_FEAT_IN_PLACE
+  if (S->st.inplace && S->st.j.swap_sector != k + 1u) {
+    return TMD_STATUS_OK; /* never erase an unsaved sector */
+  }
+#endif
+  TMD_LOG("TinyMLDelta: sector %lu touched, erase ahead\n", (unsigned long)k);
+  S->st.erased = k + 1u;
+  return tmd_sector_erase(S, k);
+}
+#else
+#define tmd_win_begin(S) TMD_STATUS_OK
+#endif
+
+/**
+ * @brief Program @p n final bytes at the cursor and advance past it.
+ *
+ * Callers never straddle a sector, and the first write into a sector always
+ * starts at its base, which is when the sector is erased. Every dst byte is
+ * therefore programmed exactly once after its erase.
+ *
+ * Run by tmd_prepare_slot(), only the erase is done: the bytes are dropped.
+ *
+ * @param S Streaming context.
+ * @param p The bytes: the merge window, or patch bytes on the zero-copy path.
+ * @param n Number of bytes.
+ *
+ * @return TMD_STATUS_OK on success, error code otherwise.
+ */
+static tmd_status_t tmd_win_write(tmd_stream_impl_t* S, const uint8_t* p,
+                                  uint32_t n) {
+  uint32_t k = S->st.cur / (uint32_t)TMD_SECTOR_SZ;
+  if (S->st.cur % (uint32_t)TMD_SECTOR_SZ == 0 && !tmd_sector_erased(S, k)) {
+#if TMD_FEAT_IN_PLACE
+    if (S->st.inplace && S->st.j.swap_sector != k + 1u) {
+      return TMD_STATUS_ERR_INTERNAL; /* never erase an unsaved sector */
+    }
+#endif
+#if TMD_FEAT_PREPARE
+    if (S->st.prep) {
+      tmd_status_t st = tmd_prep_erase(S);
+      if (st != TMD_STATUS_OK) {
+        return st;
+      }
+    }
+#endif
+    TMD_LOG("TinyMLDelta: sector %lu touched, erase+merge\n", (unsigned long)k);
+#if TMD_FEAT_ASYNC_WRITE
+    S->st.erased = k + 1u;
+#endif
+    tmd_status_t st = tmd_sector_erase(S, k);
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+  }
+#if TMD_FEAT_PREPARE
+  if (S->st.prep) {
+    S->st.cur += n;
+    if (S->st.cur % (uint32_t)TMD_SECTOR_SZ == 0 || S->st.cur == S->st.dst->size) {
+      tmd_journal_commit(S);
+    }
+    return TMD_STATUS_OK;
+  }
+#endif
+
+  uint32_t addr = S->st.dst->addr + S->st.cur;
+  TMD_LOG("TinyMLDelta:  flash_write addr=0x%08lx len=%lu\n",
+          (unsigned long)addr,
+          (unsigned long)n);
+  if (!tmd_write_start(S, addr, p, n, p != TMD_WIN(S))) {
+    TMD_LOG("TinyMLDelta: flash_write failed @0x%08lx len=%lu\n",
+            (unsigned long)addr,
+            (unsigned long)n);
+    return TMD_STATUS_ERR_FLASH;
+  }
+  tmd_fold_dst(S, S->st.cur, p, n);
+  S->st.cur += n;
+  if (S->st.cur % (uint32_t)TMD_SECTOR_SZ == 0 || S->st.cur == S->st.dst->size) {
+    tmd_journal_commit(S);
+  }
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Program the merge window at the cursor and empty it.
+ *
+ * If the program is still in flight, merging continues in the other window.
+ */
+static tmd_status_t tmd_win_flush(tmd_stream_impl_t* S) {
+  uint32_t n = S->st.fill;
+  if (n == 0) {
+    return TMD_STATUS_OK;
+  }
+  S->st.fill = 0;
+  tmd_status_t st = tmd_win_write(S, TMD_WIN(S), n);
+#if TMD_FEAT_ASYNC_WRITE
+  if (S->st.busy) {
+    S->st.win ^= 1u;
+  }
+#endif
+  return st;
+}
+
+/**
+ * @brief Bytes that can still be merged into the window before it must be
+ *        flushed (window full, or end of the current sector reached).
+ */
+static uint32_t tmd_win_room(const tmd_stream_impl_t* S) {
+  uint32_t pos = S->st.cur + S->st.fill;
+  uint32_t sec_end = (S->st.cur / (uint32_t)TMD_SECTOR_SZ + 1u) * (uint32_t)TMD_SECTOR_SZ;
+  if (sec_end > S->st.dst->size) {
+    sec_end = S->st.dst->size;
+  }
+  uint32_t room = TMD_WIN_SZ - S->st.fill;
+  return (sec_end - pos < room) ? sec_end - pos : room;
+}
+
+/**
+ * @brief Carry source bytes into the destination up to slot offset @p upto.
+ *
+ * This is the gap between chunks. Whole untouched sectors are synced without
+ * going through the window; partial gaps are read from the source slot into
+ * the window, where they are merged with the chunk bytes that follow.
+ *
+ * Under tmd_apply_step() this stops once the budget is spent; calling it
+ * again with the same @p upto carries on.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if the step budget
+ *         ran out, error code otherwise.
+ */
+static tmd_status_t tmd_fill_source(tmd_stream_impl_t* S, uint32_t upto) {
+  while (S->st.cur + S->st.fill < upto) {
+    uint32_t pos = S->st.cur + S->st.fill;
+    uint32_t k = pos / (uint32_t)TMD_SECTOR_SZ;
+    tmd_status_t st;
+
+    if (TMD_STEP_OUT(S)) {
+      return TMD_STATUS_PENDING;
+    }
+
+    if (S->st.fill == 0 && pos % (uint32_t)TMD_SECTOR_SZ == 0 &&
+        upto - pos >= tmd_sector_len(S->st.dst, k)) {
+      TMD_PHASE_ENTER(S, ph, TMD_PHASE_COPY);
+      st = tmd_sector_sync(S, k);
+      TMD_PHASE_LEAVE(S, ph);
+      if (st != TMD_STATUS_OK) {
+        return st;
+      }
+      S->st.cur += tmd_sector_len(S->st.dst, k);
+      tmd_step_spend(S, tmd_sector_len(S->st.dst, k));
+      tmd_journal_commit(S);
+      continue;
+    }
+
+    st = tmd_swap_enter(S);
+    if (st == TMD_STATUS_OK) {
+      st = tmd_win_begin(S);
+    }
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+    uint32_t n = tmd_win_room(S);
+    if (n > upto - pos) {
+      n = upto - pos;
+    }
+    TMD_PHASE_ENTER(S, ph, TMD_PHASE_COPY);
+    st = tmd_src_read(S, pos, TMD_WIN(S) + S->st.fill, n);
+    TMD_PHASE_LEAVE(S, ph);
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+    tmd_fold_src(S, pos, TMD_WIN(S) + S->st.fill, n);
+    S->st.fill += n;
+    tmd_step_spend(S, n);
+    if (tmd_win_room(S) == 0) {
+      st = tmd_win_flush(S);
+      if (st != TMD_STATUS_OK) {
+        return st;
+      }
+    }
+  }
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Where tmd_win_put() takes the bytes it merges from.
+ */
+enum {
+  TMD_PUT_BYTES = 0, /**< Verbatim bytes from the patch (RAW, LZ4 literals). */
+  TMD_PUT_FILL,      /**< arg copies of one byte value (RLE). */
+  TMD_PUT_MATCH,     /**< Target bytes arg bytes back (LZ4 match). */
+  TMD_PUT_SOURCE     /**< Source slot bytes from offset arg on (COPY). */
+};
+
+/**
+ * @brief Write @p n delta-chunk bytes to @p d: source bytes from dl_src on,
+ *        combined with the residual (@p res, or @p fill repeated if NULL).
+ */
+static tmd_status_t tmd_delta_merge(tmd_stream_impl_t* S, uint8_t* d,
+                                    const uint8_t* res, uint8_t fill,
+                                    uint32_t n) {
+#if !TMD_FEAT_DELTA
+  (void)S; (void)d; (void)res; (void)fill; (void)n;
+  return TMD_STATUS_ERR_UNSUPPORTED;
+#else
+  tmd_status_t st = tmd_src_read(S, S->st.dl_src, d, n);
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+  S->st.dl_src += n;
+  for (uint32_t i = 0; i < n; ++i) {
+    uint8_t r = res ? res[i] : fill;
+    d[i] = (S->st.dl_op == TMD_ENC_F_XOR) ? (uint8_t)(d[i] ^ r)
+                                          : (uint8_t)(d[i] + r);
+  }
+  return TMD_STATUS_OK;
+#endif
+}
+
+/**
+ * @brief The merge loop of tmd_win_put(), once the bytes are known to fit.
+ *
+ * Under tmd_apply_step() it stops when the budget is spent and keeps the
+ * rest of the merge in the context (rs_*); tmd_step_resume() calls it again
+ * with those bytes.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if the step budget
+ *         ran out, error code otherwise.
+ */
+static tmd_status_t tmd_win_merge(tmd_stream_impl_t* S, uint8_t kind,
+                                  const uint8_t* data, uint32_t arg,
+                                  uint32_t n) {
+  bool delta = false;
+#if TMD_FEAT_DELTA
+  delta = S->st.dl_op != 0 && (kind == TMD_PUT_BYTES || kind == TMD_PUT_FILL);
+#endif
+
+  while (n > 0) {
+#if TMD_FEAT_STEP
+    if (TMD_STEP_OUT(S)) {
+      S->st.rs_kind = kind;
+      S->st.rs_data = data;
+      S->st.rs_arg = arg;
+      S->st.rs_n = n;
+      return TMD_STATUS_PENDING;
+    }
+#endif
+    tmd_status_t st = tmd_swap_enter(S);
+    if (st == TMD_STATUS_OK) {
+      st = tmd_win_begin(S);
+    }
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+    uint32_t at = S->st.cur + S->st.fill;
+    uint32_t take;
+
+    /*
+     * Zero-copy: once the output is on a program unit, whole units of patch
+     * bytes go straight from the caller's buffer to flash, provided there
+     * are at least TMD_ZERO_COPY_MIN of them. The merged bytes before them
+     * (also whole units) are flushed first. Patches built for
+     * the device's write alignment (TMD_HDR_F_ALIGNED) hit this for every
+     * RAW chunk. Needs TMD_PORT_CAP_WRITE_FROM_PATCH.
+     */
+    if (kind == TMD_PUT_BYTES && !delta &&
+        (S->st.P->caps & TMD_PORT_CAP_WRITE_FROM_PATCH) != 0 &&
+        n >= (uint32_t)TMD_ALIGN_WRITE &&
+        n >= (uint32_t)TMD_ZERO_COPY_MIN &&
+        at % (uint32_t)TMD_ALIGN_WRITE == 0 &&
+        S->st.cur % (uint32_t)TMD_ALIGN_WRITE == 0) {
+      st = tmd_win_flush(S);
+      if (st == TMD_STATUS_OK) {
+        st = tmd_swap_enter(S);
+      }
+      if (st != TMD_STATUS_OK) {
+        return st;
+      }
+      uint32_t sec_end = (at / (uint32_t)TMD_SECTOR_SZ + 1u) *
+                         (uint32_t)TMD_SECTOR_SZ;
+      if (sec_end > S->st.dst->size) {
+        sec_end = S->st.dst->size;
+      }
+      take = sec_end - at;
+      if (take > n) {
+        take = n - n % (uint32_t)TMD_ALIGN_WRITE;
+      }
+      if (take > 0) {
+#if TMD_FEAT_VERIFY_BASE
+        if (at + take > S->st.base_pos && at < S->st.hdr.base_len) {
+          st = tmd_fold_range(S, false, at, at + take);
+        }
+#endif
+        if (st == TMD_STATUS_OK) {
+          st = tmd_win_write(S, data, take);
+        }
+        if (st != TMD_STATUS_OK) {
+          return st;
+        }
+        data += take;
+        n -= take;
+        tmd_step_spend(S, take);
+        continue;
+      }
+    }
+
+    take = tmd_win_room(S);
+    if (take > n) {
+      take = n;
+    }
+    if (kind == TMD_PUT_MATCH && at - arg < S->st.cur &&
+        take > S->st.cur - (at - arg)) {
+      take = S->st.cur - (at - arg); /* flash part of the match first */
+    }
+#if TMD_FEAT_VERIFY_BASE
+    /* The base digest also covers the bytes this chunk replaces. */
+    if (at + take > S->st.base_pos && at < S->st.hdr.base_len) {
+      st = tmd_src_read(S, at, TMD_WIN(S) + S->st.fill, take);
+      if (st != TMD_STATUS_OK) {
+        return st;
+      }
+      tmd_fold_src(S, at, TMD_WIN(S) + S->st.fill, take);
+    }
+#endif
+    uint8_t* d = TMD_WIN(S) + S->st.fill;
+    uint32_t from = 0;
+    bool     rd = false;
+    switch (kind) {
+      case TMD_PUT_BYTES:
+        if (delta) {
+          st = tmd_delta_merge(S, d, data, 0, take);
+        } else {
+          memcpy(d, data, take);
+        }
+        data += take;
+        break;
+      case TMD_PUT_FILL:
+        if (delta) {
+          st = tmd_delta_merge(S, d, NULL, (uint8_t)arg, take);
+        } else {
+          memset(d, (uint8_t)arg, take);
+        }
+        break;
+      case TMD_PUT_MATCH:
+        if (at - arg >= S->st.cur) {
+          /* Forward byte copy: overlapping matches replicate, as in LZ4. */
+          const uint8_t* m = TMD_WIN(S) + (at - arg - S->st.cur);
+          for (uint32_t i = 0; i < take; ++i) {
+            d[i] = m[i];
+          }
+          break;
+        }
+        from = S->st.dst->addr + (at - arg);
+        rd = true;
+        break;
+      default: /* TMD_PUT_SOURCE */
+        st = tmd_src_read(S, arg, d, take);
+        arg += take;
+        break;
+    }
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+    if (rd && !tmd_read(S, from, d, take)) {
+      TMD_LOG("TinyMLDelta: flash_read failed @0x%08lx len=%lu\n",
+              (unsigned long)from,
+              (unsigned long)take);
+      return TMD_STATUS_ERR_FLASH;
+    }
+    S->st.fill += take;
+    n -= take;
+    tmd_step_spend(S, take);
+    if (tmd_win_room(S) == 0) {
+      st = tmd_win_flush(S);
+      if (st != TMD_STATUS_OK) {
+        return st;
+      }
+    }
+  }
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Merge @p n decoded chunk bytes into the window at the cursor.
+ *
+ * @param S    Streaming context.
+ * @param kind One of TMD_PUT_*.
+ * @param data Bytes to merge (TMD_PUT_BYTES only, else NULL).
+ * @param arg  TMD_PUT_FILL: fill byte. TMD_PUT_MATCH: distance back into the
+ *             target image; the bytes may be in the window or already in
+ *             the dst slot, and may overlap the ones being produced.
+ *             TMD_PUT_SOURCE: source slot offset of the first byte.
+ * @param n    Number of bytes.
+ *
+ * In a delta chunk (dl_op set) the TMD_PUT_BYTES / TMD_PUT_FILL bytes are
+ * residuals: they are combined with the source bytes at dl_src, which are
+ * read into the window first.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if a tmd_apply_step()
+ *         budget ran out (the rest of the merge is kept and the bytes count
+ *         as taken), error code otherwise.
+ */
+static tmd_status_t tmd_win_put(tmd_stream_impl_t* S, uint8_t kind,
+                                const uint8_t* data, uint32_t arg,
+                                uint32_t n) {
+  uint32_t pos = S->st.out;
+  if (pos > S->st.dst->size || n > S->st.dst->size - pos) {
+    TMD_LOG("TinyMLDelta: chunk out of range (off=%lu,len=%lu,size=%lu)\n",
+            (unsigned long)pos,
+            (unsigned long)n,
+            (unsigned long)S->st.dst->size);
+    return TMD_STATUS_ERR_PARAM;
+  }
+  if (kind == TMD_PUT_MATCH && arg > pos) {
+    TMD_LOG("TinyMLDelta: match distance %lu before slot start (at %lu)\n",
+            (unsigned long)arg,
+            (unsigned long)pos);
+    return TMD_STATUS_ERR_HDR;
+  }
+  if (kind == TMD_PUT_SOURCE &&
+      (arg > S->st.src->size || n > S->st.src->size - arg)) {
+    TMD_LOG("TinyMLDelta: copy out of range (src=%lu,len=%lu,size=%lu)\n",
+            (unsigned long)arg,
+            (unsigned long)n,
+            (unsigned long)S->st.src->size);
+    return TMD_STATUS_ERR_PARAM;
+  }
+#if TMD_FEAT_DELTA
+  bool delta = false;
+  if (S->st.dl_op != 0 && (kind == TMD_PUT_BYTES || kind == TMD_PUT_FILL)) {
+    if (S->st.dl_src > S->st.src->size ||
+        n > S->st.src->size - S->st.dl_src) {
+      TMD_LOG("TinyMLDelta: delta source out of range (src=%lu,len=%lu,size=%lu)\n",
+              (unsigned long)S->st.dl_src,
+              (unsigned long)n,
+              (unsigned long)S->st.src->size);
+      return TMD_STATUS_ERR_PARAM;
+    }
+    delta = true;
+  }
+#endif
+  S->st.out += n;
+
+  /* After a resume, bytes below the cursor are already in flash. */
+  if (pos < S->st.cur) {
+    uint32_t drop = S->st.cur - pos;
+    if (drop > n) {
+      drop = n;
+    }
+    if (kind == TMD_PUT_BYTES) {
+      data += drop;
+    } else if (kind == TMD_PUT_SOURCE) {
+      arg += drop;
+    }
+#if TMD_FEAT_DELTA
+    if (delta) {
+      S->st.dl_src += drop;
+    }
+#endif
+    n -= drop;
+  }
+
+  return tmd_win_merge(S, kind, data, arg, n);
+}
+
+/**
+ * @brief Incremental RLE decode: [count][byte], count==0 => 256.
+ *
+ * Format:
+ *   [c0][v0][c1][v1]...
+ *
+ * Where:
+ *   - c == 0 encodes run length 256.
+ *   - Otherwise, run length == c (1..255).
+ *
+ * Pairs may be split across input fragments. Runs are expanded straight into
+ * the merge window, so a chunk may decode to any length within the slot.
+ *
+ * @param S   Streaming context.
+ * @param in  Next encoded bytes of the current chunk.
+ * @param n   Number of bytes in @p in.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if a tmd_apply_step()
+ *         budget ran out (the undecoded rest is kept), error status otherwise.
+ */
+static tmd_status_t tmd_rle_feed(tmd_stream_impl_t* S,
+                                 const uint8_t* in, uint32_t n) {
+#if !TMD_FEAT_RLE
+  (void)S; (void)in; (void)n;
+  return TMD_STATUS_ERR_UNSUPPORTED;
+#else
+  uint32_t i = 0;
+
+  while (i < n) {
+    if (!S->st.rle_half) {
+      S->st.rle_count = in[i++];
+      S->st.rle_half = 1;
+      continue;
+    }
+    uint8_t  val = in[i++];
+    uint32_t run = (S->st.rle_count == 0) ? 256u : (uint32_t)S->st.rle_count;
+    S->st.rle_half = 0;
+
+    tmd_status_t st = tmd_win_put(S, TMD_PUT_FILL, NULL, val, run);
+    if (st != TMD_STATUS_OK) {
+      return tmd_defer_input(S, in + i, n - i, st);
+    }
+  }
+  return TMD_STATUS_OK;
+#endif
+}
+
+#if TMD_FEAT_LZ4TINY
+/**
+ * @brief LZ4 block parser states (sequence = token, literals, offset, match).
+ */
+enum {
+  TMD_LZ_TOKEN = 0,  /**< Expecting a token (or end of block). */
+  TMD_LZ_LITLEN,     /**< Literal-length extension bytes. */
+  TMD_LZ_LIT,        /**< Literal bytes. */
+  TMD_LZ_OFF_LO,     /**< Offset low byte (or end of block). */
+  TMD_LZ_OFF_HI,     /**< Offset high byte. */
+  TMD_LZ_MATCHLEN    /**< Match-length extension bytes. */
+};
+
+/**
+ * @brief Incremental LZ4 block decode.
+ *
+ * Standard LZ4 block format: each sequence is a token (literal length in the
+ * high nibble, match length - 4 in the low nibble, 15 = extended by 255-run
+ * bytes), the literals, a 16-bit little-endian offset and the match. The
+ * last sequence stops after its literals.
+ *
+ * The decoded bytes are the target image from the chunk offset on, so a
+ * match may reach up to 64 KiB back into anything before it: earlier bytes
+ * of this chunk, previous chunks, or the source bytes carried over in the
+ * gaps. Those come from the merge window or are read back from the dst
+ * slot, so no history buffer is needed and every field may be split across
+ * input fragments.
+ *
+ * @param S   Streaming context.
+ * @param in  Next encoded bytes of the current chunk.
+ * @param n   Number of bytes in @p in.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if a tmd_apply_step()
+ *         budget ran out (the undecoded rest is kept), error status otherwise.
+ */
+static tmd_status_t tmd_lz4_feed(tmd_stream_impl_t* S,
+                                 const uint8_t* in, uint32_t n) {
+  uint32_t i = 0;
+  tmd_status_t st;
+
+  while (i < n) {
+    uint8_t b;
+    switch (S->st.lz_state) {
+      case TMD_LZ_TOKEN:
+        S->st.lz_tok = in[i++];
+        S->st.lz_len = S->st.lz_tok >> 4;
+        S->st.lz_state = (S->st.lz_len == 15) ? TMD_LZ_LITLEN
+                       : (S->st.lz_len > 0)   ? TMD_LZ_LIT
+                                              : TMD_LZ_OFF_LO;
+        break;
+
+      case TMD_LZ_LITLEN:
+        b = in[i++];
+        S->st.lz_len += b;
+        if (b != 255) {
+          S->st.lz_state = (S->st.lz_len > 0) ? TMD_LZ_LIT : TMD_LZ_OFF_LO;
+        }
+        break;
+
+      case TMD_LZ_LIT: {
+        uint32_t k = n - i;
+        if (k > S->st.lz_len) {
+          k = S->st.lz_len;
+        }
+        const uint8_t* lit = in + i;
+        i += k;
+        S->st.lz_len -= k;
+        if (S->st.lz_len == 0) {
+          S->st.lz_state = TMD_LZ_OFF_LO;
+        }
+        st = tmd_win_put(S, TMD_PUT_BYTES, lit, 0, k);
+        if (st != TMD_STATUS_OK) {
+          return tmd_defer_input(S, in + i, n - i, st);
+        }
+        break;
+      }
+
+      case TMD_LZ_OFF_LO:
+        S->st.lz_off = in[i++];
+        S->st.lz_state = TMD_LZ_OFF_HI;
+        break;
+
+      case TMD_LZ_OFF_HI:
+        S->st.lz_off |= (uint16_t)(in[i++] << 8);
+        if (S->st.lz_off == 0) {
+          TMD_LOG("TinyMLDelta: LZ4 offset 0 idx=%u\n",
+                  (unsigned)S->st.chunk_idx);
+          return TMD_STATUS_ERR_HDR;
+        }
+        S->st.lz_len = (uint32_t)(S->st.lz_tok & 0x0Fu) + 4u;
+        if ((S->st.lz_tok & 0x0Fu) == 15u) {
+          S->st.lz_state = TMD_LZ_MATCHLEN;
+          break;
+        }
+        S->st.lz_state = TMD_LZ_TOKEN;
+        st = tmd_win_put(S, TMD_PUT_MATCH, NULL, S->st.lz_off,
+                         S->st.lz_len);
+        if (st != TMD_STATUS_OK) {
+          return tmd_defer_input(S, in + i, n - i, st);
+        }
+        break;
+
+      case TMD_LZ_MATCHLEN:
+        b = in[i++];
+        S->st.lz_len += b;
+        if (b != 255) {
+          S->st.lz_state = TMD_LZ_TOKEN;
+          st = tmd_win_put(S, TMD_PUT_MATCH, NULL, S->st.lz_off,
+                           S->st.lz_len);
+          if (st != TMD_STATUS_OK) {
+            return tmd_defer_input(S, in + i, n - i, st);
+          }
+        }
+        break;
+
+      default:
+        return TMD_STATUS_ERR_INTERNAL;
+    }
+  }
+  return TMD_STATUS_OK;
+}
+#endif
+
+/**
+ * @brief Called once every TLV has been consumed: enforce guardrails and pick
+ *        the source and destination slots.
+ *
+ * Nothing is erased here. Destination sectors are merged lazily as chunks
+ * reach them, and the rest of the image is synced in tmd_stream_finish().
+ */
+static tmd_status_t tmd_stream_begin(tmd_stream_impl_t* S) {
+  const tmd_ports_t*  P = S->st.P;
+  const tmd_layout_t* L = tmd_layout();
+
+  /* Guardrail checks. */
+  TMD_PHASE_ENTER(S, ph, TMD_PHASE_GUARD);
+  tmd_status_t st = tmd_check_guardrails(&S->st.meta);
+  TMD_PHASE_LEAVE(S, ph);
+  if (st != TMD_STATUS_OK) {
+    TMD_LOG("TinyMLDelta: guardrail check failed (%d)\n", (int)st);
+    return st;
+  }
+
+  uint8_t active   = P->get_active_slot();
+  uint8_t inactive = (active == 0) ? 1 : 0;
+  bool    resumed  = false;
+  const tmd_slot_t* slot_src = (active == 0) ? &L->slotA : &L->slotB;
+  const tmd_slot_t* slot_dst = (inactive == 0) ? &L->slotA : &L->slotB;
+
+#if TMD_FEAT_IN_PLACE
+  S->st.inplace = 0;
+  if (L->in_place) {
+    if (!(S->st.hdr.flags & TMD_HDR_F_IN_PLACE)) {
+      TMD_LOG("TinyMLDelta: patch not built for in-place apply\n");
+      return TMD_STATUS_ERR_UNSUPPORTED;
+    }
+    /* The core's log must ping-pong between two sectors: a wrap erase of
+       the only page would lose the swap record. */
+    if (L->meta_size < (uint32_t)TMD_SECTOR_SZ ||
+        (!P->journal_write &&
+         tmd_jlog_size() < 2u * (uint32_t)TMD_SECTOR_SZ)) {
+      TMD_LOG("TinyMLDelta: in-place apply needs a swap sector and a "
+              "two-sector journal log\n");
+      return TMD_STATUS_ERR_PARAM;
+    }
+    inactive = active;
+    slot_dst = slot_src;
+    S->st.inplace = 1;
+    TMD_LOG("TinyMLDelta: in-place apply (swap @0x%08lx)\n",
+            (unsigned long)L->meta_addr);
+  }
+#else
+  if (L->in_place) {
+    TMD_LOG("TinyMLDelta: in-place layout needs TMD_FEAT_IN_PLACE\n");
+    return TMD_STATUS_ERR_UNSUPPORTED;
+  }
+#endif
+#if TMD_FEAT_PREPARE
+  if (S->st.prep && L->in_place) {
+    TMD_LOG("TinyMLDelta: in-place layout has no inactive slot to prepare\n");
+    return TMD_STATUS_ERR_UNSUPPORTED;
+  }
+#endif
+
+  TMD_LOG("TinyMLDelta: active slot=%u inactive=%u\n",
+          (unsigned)active,
+          (unsigned)inactive);
+  TMD_LOG("TinyMLDelta: slotA addr=0x%08lx size=%lu\n",
+          (unsigned long)L->slotA.addr,
+          (unsigned long)L->slotA.size);
+  TMD_LOG("TinyMLDelta: slotB addr=0x%08lx size=%lu\n",
+          (unsigned long)L->slotB.addr,
+          (unsigned long)L->slotB.size);
+
+  if (slot_src->size != slot_dst->size) {
+    TMD_LOG("TinyMLDelta: slot size mismatch (src=%lu dst=%lu)\n",
+            (unsigned long)slot_src->size,
+            (unsigned long)slot_dst->size);
+    return TMD_STATUS_ERR_PARAM;
+  }
+
+  /*
+   * Only the sectors spanned by the target image matter; anything past it in
+   * the slot is left as-is. A header without target_len covers the slot.
+   */
+  uint32_t image = S->st.hdr.target_len ? S->st.hdr.target_len : slot_dst->size;
+  if (image > slot_dst->size) {
+    TMD_LOG("TinyMLDelta: target_len %lu exceeds slot size %lu\n",
+            (unsigned long)image,
+            (unsigned long)slot_dst->size);
+    return TMD_STATUS_ERR_PARAM;
+  }
+
+  S->st.inactive = inactive;
+  S->st.src = slot_src;
+  S->st.dst = slot_dst;
+  S->st.cur = 0;
+  S->st.fill = 0;
+  S->st.out = 0;
+  S->st.img_end = ((image + (uint32_t)TMD_SECTOR_SZ - 1u) / (uint32_t)TMD_SECTOR_SZ) *
+                  (uint32_t)TMD_SECTOR_SZ;
+  if (S->st.img_end > slot_dst->size) {
+    S->st.img_end = slot_dst->size;
+  }
+
+#if TMD_FEAT_JOURNAL
+  /*
+   * A journal left behind by this same patch (same header, same target slot)
+   * means the dst prefix below j->dst_off is already final: start there and
+   * treat chunks before j->next_chunk_idx as applied. Anything else starts
+   * over from the beginning of the slot.
+   */
+  tmd_journal_t* j = &S->st.j;
+  /* patch_id: hash of the header, i.e. of the lengths and both digests. */
+  uint32_t patch_id = tmd_fnv1a(&S->st.hdr, sizeof(S->st.hdr));
+  if (tmd_journal_load(S, j) &&
+      j->magic == TMD_JOURNAL_MAGIC &&
+      j->patch_id == patch_id &&
+      j->target_slot == inactive &&
+      j->next_chunk_idx <= S->st.hdr.chunks_n &&
+      j->dst_off <= S->st.img_end &&
+      (j->dst_off % (uint32_t)TMD_SECTOR_SZ == 0 || j->dst_off == S->st.img_end)) {
+    S->st.cur = j->dst_off;
+    resumed = true;
+    TMD_LOG("TinyMLDelta: journal resume (next_chunk=%lu dst_off=%lu target_slot=%u)\n",
+            (unsigned long)j->next_chunk_idx,
+            (unsigned long)j->dst_off,
+            (unsigned)j->target_slot);
+  } else {
+    if (j->magic == TMD_JOURNAL_MAGIC) {
+      TMD_LOG("TinyMLDelta: stale journal (patch_id=0x%08lx), starting over\n",
+              (unsigned long)j->patch_id);
+    }
+    memset(j, 0, sizeof(*j));
+    j->magic = TMD_JOURNAL_MAGIC;
+    j->patch_id = patch_id;
+    j->next_chunk_idx = 0;
+    j->dst_off = 0;
+    j->target_slot = inactive;
+    TMD_LOG("TinyMLDelta: journal init (patch_id=0x%08lx target_slot=%u)\n",
+            (unsigned long)patch_id,
+            (unsigned)inactive);
+  }
+
+#if TMD_FEAT_PREPARE
+  /*
+   * tmd_prepare_slot() progress past dst_off: the sectors chunks write below
+   * prep_off are erased. tmd_prepare_slot() carries on from there; the apply
+   * skips those erases, but first drops the claim from the journal, since
+   * after an interruption those sectors may hold programmed bytes.
+   */
+  bool prepared = j->prep_off > j->dst_off && j->prep_off <= S->st.img_end &&
+                  (j->prep_off % (uint32_t)TMD_SECTOR_SZ == 0 ||
+                   j->prep_off == S->st.img_end) &&
+                  j->prep_chunk_idx >= j->next_chunk_idx &&
+                  j->prep_chunk_idx <= S->st.hdr.chunks_n;
+  if (S->st.prep) {
+    if (!prepared) {
+      j->prep_off = j->dst_off;
+      j->prep_chunk_idx = j->next_chunk_idx;
+    }
+    S->st.cur = j->prep_off;
+    S->st.prep_idx = j->prep_chunk_idx;
+  } else {
+    if (prepared) {
+      S->st.prep_end = j->prep_off;
+    }
+    j->prep_off = 0;
+    j->prep_chunk_idx = 0;
+    if (prepared) {
+      if (!tmd_journal_store(S, j)) {
+        TMD_LOG("TinyMLDelta: journal_write failed (prepared slot)\n");
+        return TMD_STATUS_ERR_FLASH;
+      }
+      TMD_LOG("TinyMLDelta: slot prepared up to %lu\n",
+              (unsigned long)S->st.prep_end);
+    }
+  }
+#endif
+#endif
+
+#if TMD_FEAT_DIGEST
+#if TMD_FEAT_SHA256
+  if (!P->sha256_init || !P->sha256_update || !P->sha256_final) {
+    TMD_LOG("TinyMLDelta: SHA-256 digests need the port's sha256 hooks\n");
+    return TMD_STATUS_ERR_UNSUPPORTED;
+  }
+#endif
+#if TMD_FEAT_VERIFY_BASE
+  if (S->st.hdr.base_len > slot_src->size) {
+    TMD_LOG("TinyMLDelta: base_len %lu exceeds slot size %lu\n",
+            (unsigned long)S->st.hdr.base_len,
+            (unsigned long)slot_src->size);
+    return TMD_STATUS_ERR_INTEGRITY;
+  }
+#endif
+  tmd_dig_init(P, &S->st.dig_base);
+  tmd_dig_init(P, &S->st.dig_tgt);
+  S->st.base_pos = 0;
+  S->st.tgt_pos = 0;
+  S->st.fold_base = 0;
+  S->st.fold_tgt = 0;
+  S->st.fold_chk = 0;
+
+#if TMD_FEAT_IN_PLACE
+  /*
+   * In place, a wrong base cannot be caught at the end without losing the
+   * model, so it is checked in a read-only pass up front. A resumed apply
+   * passed that check on its first run and its base is partly rewritten.
+   */
+  if (S->st.inplace) {
+    if (TMD_FEAT_VERIFY_BASE && !resumed) {
+      S->st.fold_base = S->st.hdr.base_len;
+      S->st.fold_chk = 1;
+    } else {
+      S->st.base_pos = S->st.hdr.base_len;
+    }
+  }
+#endif
+
+  /* A resumed apply never reads the finished prefix again: fold it first. */
+  if (S->st.cur > 0 && !TMD_PREP(S)) {
+    if (S->st.fold_base < S->st.cur) {
+      S->st.fold_base = S->st.cur;
+    }
+    S->st.fold_tgt = S->st.cur;
+  }
+#endif
+
+#if TMD_FEAT_PREPARE && TMD_FEAT_DIGEST
+  /* tmd_prepare_slot() checks no digests: nothing is folded. */
+  if (S->st.prep) {
+    S->st.base_pos = S->st.hdr.base_len;
+    S->st.tgt_pos = S->st.hdr.target_len;
+  }
+#endif
+
+  (void)resumed;
+  S->st.state = (S->st.hdr.chunks_n > 0) ? TMD_ST_CHUNK_HDR : TMD_ST_DONE;
+  S->st.have = 0;
+#if TMD_FEAT_DIGEST
+  return tmd_begin_fold(S);
+#else
+  return TMD_STATUS_OK;
+#endif
+}
+
+/**
+ * @brief Check that this build can apply a patch with header @p hdr
+ *        (format version and digest algorithm).
+ */
+static tmd_status_t tmd_hdr_check(const tmd_hdr_t* hdr) {
+  if (hdr->v != 1) {
+    TMD_LOG("TinyMLDelta: unsupported patch version %u\n",
+            (unsigned)hdr->v);
+    return TMD_STATUS_ERR_HDR;
+  }
+
+#if TMD_USE_CRC32
+  if (hdr->algo != 1) {
+    TMD_LOG("TinyMLDelta: algo=%u not supported (expected CRC32=1)\n",
+            (unsigned)hdr->algo);
+    return TMD_STATUS_ERR_UNSUPPORTED;
+  }
+#elif TMD_USE_SHA256
+  if (hdr->algo != 2) {
+    TMD_LOG("TinyMLDelta: algo=%u not supported (expected SHA256=2)\n",
+            (unsigned)hdr->algo);
+    return TMD_STATUS_ERR_UNSUPPORTED;
+  }
+#endif
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Validate the accumulated patch header.
+ */
+static tmd_status_t tmd_on_header(tmd_stream_impl_t* S) {
+  const tmd_hdr_t* hdr = &S->st.hdr;
+
+  /* Patch header debug. */
+  TMD_LOG("TinyMLDelta: ---- Patch Header ----\n");
+  TMD_LOG("TinyMLDelta: v=%u algo=%u chunks_n=%u\n",
+          (unsigned)hdr->v,
+          (unsigned)hdr->algo,
+          (unsigned)hdr->chunks_n);
+  TMD_LOG("TinyMLDelta: base_len=%lu target_len=%lu\n",
+          (unsigned long)hdr->base_len,
+          (unsigned long)hdr->target_len);
+  TMD_LOG("TinyMLDelta: meta_len=%u flags=0x%04x\n",
+          (unsigned)hdr->meta_len,
+          (unsigned)hdr->flags);
+
+  tmd_status_t st = tmd_hdr_check(hdr);
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+  if (hdr->flags & TMD_HDR_F_ALIGNED) {
+    TMD_LOG("TinyMLDelta: chunks aligned to program units (zero-copy)\n");
+  }
+
+  TMD_LOG("TinyMLDelta: parsing meta TLVs (meta_len=%u)\n",
+          (unsigned)hdr->meta_len);
+
+#if TMD_FEAT_GUARDRAILS
+  memset(&S->st.meta, 0, sizeof(S->st.meta));
+#endif
+  S->st.meta_rem = hdr->meta_len;
+  S->st.have = 0;
+  if (S->st.meta_rem == 0) {
+    return tmd_stream_begin(S);
+  }
+  S->st.state = TMD_ST_TLV_HDR;
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Finish the current chunk once its payload has been consumed.
+ */
+static tmd_status_t tmd_on_chunk_end(tmd_stream_impl_t* S) {
+  if (S->st.rle_half && !S->st.skip) {
+    TMD_LOG("TinyMLDelta: RLE payload ends mid-pair idx=%u\n",
+            (unsigned)S->st.chunk_idx);
+    return TMD_STATUS_ERR_HDR;
+  }
+#if TMD_FEAT_LZ4TINY
+  /* An LZ4 block ends after the literals of its last sequence. */
+  if (S->st.ch.enc == TMD_ENC_LZ4 && !S->st.skip &&
+      S->st.lz_state != TMD_LZ_OFF_LO &&
+      !(S->st.lz_state == TMD_LZ_TOKEN && S->st.ch.len == 0)) {
+    TMD_LOG("TinyMLDelta: LZ4 payload ends mid-sequence idx=%u\n",
+            (unsigned)S->st.chunk_idx);
+    return TMD_STATUS_ERR_HDR;
+  }
+#endif
+
+  S->st.chunk_idx++;
+  S->st.have = 0;
+  S->st.state = (S->st.chunk_idx < S->st.hdr.chunks_n) ? TMD_ST_CHUNK_HDR
+                                                       : TMD_ST_DONE;
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Decode @p n payload bytes of the current chunk into the window.
+ *
+ * @return TMD_STATUS_OK on success, TMD_STATUS_PENDING if a tmd_apply_step()
+ *         budget ran out (the rest is kept), error code otherwise.
+ */
+static tmd_status_t tmd_decode(tmd_stream_impl_t* S,
+                               const uint8_t* data, uint32_t n) {
+  uint8_t enc = S->st.ch.enc;
+  if ((enc & ~(TMD_ENC_F_XOR | TMD_ENC_F_SUB)) == TMD_ENC_RAW) {
+    return tmd_win_put(S, TMD_PUT_BYTES, data, 0, n);
+  }
+#if TMD_FEAT_LZ4TINY
+  if (enc == TMD_ENC_LZ4) {
+    return tmd_lz4_feed(S, data, n);
+  }
+#endif
+  return tmd_rle_feed(S, data, n);
+}
+
+/**
+ * @brief Consume @p n payload bytes of the current chunk.
+ *
+ * The payload CRC is accumulated as bytes arrive and checked before the final
+ * fragment is decoded. A payload that arrives in one piece (always the case
+ * for tmd_apply_patch_from_memory()) is therefore verified before any of it
+ * reaches flash; for split payloads, earlier fragments are already in the
+ * inactive slot, which is never activated if the check fails.
+ *
+ * If a tmd_apply_step() budget runs out while the bytes are decoded, they
+ * still count as consumed: the rest of the work, and the end of the chunk,
+ * is left to tmd_step_resume().
+ */
+static tmd_status_t tmd_on_payload(tmd_stream_impl_t* S,
+                                   const uint8_t* data, uint32_t n) {
+  const tmd_chunk_hdr_t* ch = &S->st.ch;
+  int last = (n == S->st.pay_rem);
+  (void)ch;
+
+  if (S->st.skip) {
+    S->st.pay_rem -= n;
+    return last ? tmd_on_chunk_end(S) : TMD_STATUS_OK;
+  }
+
+#if TMD_FEAT_CRC32
+  if (ch->has_crc) {
+    TMD_PHASE_ENTER(S, ph, TMD_PHASE_CRC);
+    S->st.crc_run = tmd_crc_update(S->st.P, S->st.crc_run, data, n);
+    TMD_PHASE_LEAVE(S, ph);
+    if (last) {
+      uint32_t got = tmd_crc_final(S->st.P, S->st.crc_run);
+      if (got != S->st.crc_exp) {
+        TMD_LOG("TinyMLDelta: chunk CRC mismatch idx=%u got=0x%08lx exp=0x%08lx\n",
+                (unsigned)S->st.chunk_idx,
+                (unsigned long)got,
+                (unsigned long)S->st.crc_exp);
+        return TMD_STATUS_ERR_INTEGRITY;
+      }
+    }
+  }
+#endif
+
+#if TMD_FEAT_COPY
+  /* COPY runs once its whole (CRC-checked) payload is in. */
+  if (ch->enc == TMD_ENC_COPY) {
+    memcpy(S->st.cp_arg + (ch->len - S->st.pay_rem), data, n);
+    S->st.pay_rem -= n;
+    if (!last) {
+      return TMD_STATUS_OK;
+    }
+    tmd_status_t st = tmd_win_put(S, TMD_PUT_SOURCE, NULL,
+                                  tmd_rd_u32(S->st.cp_arg),
+                                  tmd_rd_u32(S->st.cp_arg + 4));
+    if (st != TMD_STATUS_OK) {
+#if TMD_FEAT_STEP
+      S->st.rs_end = (st == TMD_STATUS_PENDING);
+#endif
+      return st;
+    }
+    return tmd_on_chunk_end(S);
+  }
+#endif
+
+#if TMD_FEAT_DELTA
+  /* A delta payload starts with the u32 source offset of its first byte. */
+  while (S->st.dl_op != 0 && S->st.have < 4u && n > 0) {
+    S->st.dl_src |= (uint32_t)*data++ << (8u * S->st.have++);
+    S->st.pay_rem--;
+    n--;
+  }
+#endif
+
+  S->st.pay_rem -= n;
+
+  if (n > 0) {
+    tmd_status_t st = tmd_decode(S, data, n);
+    if (st != TMD_STATUS_OK) {
+#if TMD_FEAT_STEP
+      S->st.rs_end = (uint8_t)(st == TMD_STATUS_PENDING && last);
+#endif
+      return st;
+    }
+  }
+
+  return last ? tmd_on_chunk_end(S) : TMD_STATUS_OK;
+}
+
+/**
+ * @brief Check a chunk record on its own: an encoding this build decodes,
+ *        a well-formed payload length, and a start inside a destination
+ *        slot of @p size bytes.
+ */
+static tmd_status_t tmd_chunk_check(const tmd_chunk_hdr_t* ch, uint32_t size) {
+  /* Delta chunks take a RAW or RLE body (LZ4 matches address the target). */
+  uint8_t op = ch->enc & (TMD_ENC_F_XOR | TMD_ENC_F_SUB);
+  uint8_t body = ch->enc & (uint8_t)~op;
+  if (op == (TMD_ENC_F_XOR | TMD_ENC_F_SUB) ||
+      (op != 0 && (!TMD_FEAT_DELTA || body > TMD_ENC_RLE)) ||
+      (body != TMD_ENC_RAW &&
+       !(body == TMD_ENC_RLE && TMD_FEAT_RLE) &&
+       !(body == TMD_ENC_LZ4 && TMD_FEAT_LZ4TINY) &&
+       !(body == TMD_ENC_COPY && TMD_FEAT_COPY))) {
+    TMD_LOG("TinyMLDelta: unsupported encoding %u\n", (unsigned)ch->enc);
+    return TMD_STATUS_ERR_UNSUPPORTED;
+  }
+  if (ch->enc == TMD_ENC_COPY && ch->len != 8u) {
+    TMD_LOG("TinyMLDelta: COPY payload len=%u (expected 8)\n",
+            (unsigned)ch->len);
+    return TMD_STATUS_ERR_HDR;
+  }
+  if (op != 0 && ch->len < 4u) {
+    TMD_LOG("TinyMLDelta: delta payload len=%u (no source offset)\n",
+            (unsigned)ch->len);
+    return TMD_STATUS_ERR_HDR;
+  }
+  if (ch->off > size ||
+      (ch->enc == TMD_ENC_RAW && ch->len > size - ch->off)) {
+    TMD_LOG("TinyMLDelta: chunk out of range (off=%lu,len=%u,size=%lu)\n",
+            (unsigned long)ch->off,
+            (unsigned)ch->len,
+            (unsigned long)size);
+    return TMD_STATUS_ERR_PARAM;
+  }
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Validate the accumulated chunk header and prepare for its payload.
+ */
+static tmd_status_t tmd_on_chunk_hdr(tmd_stream_impl_t* S) {
+  const tmd_chunk_hdr_t* ch = &S->st.ch;
+
+  TMD_LOG("TinyMLDelta: chunk[%u]: off=%lu len=%u enc=%u has_crc=%u\n",
+          (unsigned)S->st.chunk_idx,
+          (unsigned long)ch->off,
+          (unsigned)ch->len,
+          (unsigned)ch->enc,
+          (unsigned)ch->has_crc);
+
+  tmd_status_t st = tmd_chunk_check(ch, S->st.dst->size);
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+
+  /*
+   * Chunks arrive in ascending, non-overlapping order, so the dst between the
+   * end of the previous chunk and this one is source data: merge it into the
+   * window first. Chunk bytes then land right behind it.
+   */
+  if (ch->off < S->st.out) {
+    TMD_LOG("TinyMLDelta: chunk[%u] off=%lu overlaps or precedes %lu\n",
+            (unsigned)S->st.chunk_idx,
+            (unsigned long)ch->off,
+            (unsigned long)S->st.out);
+    return TMD_STATUS_ERR_HDR;
+  }
+  st = tmd_fill_source(S, ch->off);
+  if (st != TMD_STATUS_OK) {
+#if TMD_FEAT_STEP
+    S->st.rs_hdr = (st == TMD_STATUS_PENDING); /* run again to finish */
+#endif
+    return st;
+  }
+  S->st.out = ch->off;
+
+  /* Chunks a previous, interrupted run fully committed are not decoded. */
+#if TMD_FEAT_JOURNAL
+  uint32_t done = S->st.j.next_chunk_idx;
+#if TMD_FEAT_PREPARE
+  if (S->st.prep) {
+    done = S->st.j.prep_chunk_idx;
+  }
+#endif
+  S->st.skip = (S->st.chunk_idx < done) ? 1 : 0;
+#endif
+  S->st.rle_half = 0;
+#if TMD_FEAT_LZ4TINY
+  S->st.lz_state = TMD_LZ_TOKEN;
+#endif
+#if TMD_FEAT_DELTA
+  S->st.dl_op = ch->enc & (TMD_ENC_F_XOR | TMD_ENC_F_SUB);
+  S->st.dl_src = 0;
+#endif
+  S->st.pay_rem = ch->len;
+  S->st.crc_exp = 0;
+#if TMD_FEAT_CRC32
+  S->st.crc_run = tmd_crc_init(S->st.P);
+#endif
+  S->st.have = 0;
+
+  if (ch->has_crc) {
+    S->st.state = TMD_ST_CHUNK_CRC;
+    return TMD_STATUS_OK;
+  }
+  S->st.state = TMD_ST_PAYLOAD;
+  return (S->st.pay_rem == 0) ? tmd_on_payload(S, NULL, 0) : TMD_STATUS_OK;
+}
+
+#if TMD_FEAT_STEP
+/**
+ * @brief tmd_apply_step(): finish the work the previous step's budget cut
+ *        short, in the order it was left: the up-front digest passes, a
+ *        chunk header's gap fill, a merge, the payload bytes after it, and
+ *        the end of the chunk.
+ *
+ * @return TMD_STATUS_OK once nothing is left over, TMD_STATUS_PENDING if
+ *         the budget ran out again, error code otherwise.
+ */
+static tmd_status_t tmd_step_resume(tmd_stream_impl_t* S) {
+  tmd_status_t st = TMD_STATUS_OK;
+#if TMD_FEAT_DIGEST
+  st = tmd_begin_fold(S);
+#endif
+  if (st == TMD_STATUS_OK && S->st.rs_hdr) {
+    S->st.rs_hdr = 0;
+    st = tmd_on_chunk_hdr(S);
+  }
+  if (st == TMD_STATUS_OK && S->st.rs_n > 0) {
+    uint32_t n = S->st.rs_n;
+    S->st.rs_n = 0;
+    st = tmd_win_merge(S, S->st.rs_kind, S->st.rs_data, S->st.rs_arg, n);
+  }
+  if (st == TMD_STATUS_OK && S->st.rs_in_n > 0) {
+    uint32_t n = S->st.rs_in_n;
+    S->st.rs_in_n = 0;
+    st = tmd_decode(S, S->st.rs_in, n);
+  }
+  if (st == TMD_STATUS_OK && S->st.rs_end) {
+    S->st.rs_end = 0;
+    st = tmd_on_chunk_end(S);
+  }
+  return st;
+}
+#endif
+
+tmd_status_t tmd_stream_init(tmd_stream_t* s) {
+  const tmd_ports_t*  P = tmd_ports();
+  const tmd_layout_t* L = tmd_layout();
+  if (!s || !P || !L) {
+    TMD_LOG("TinyMLDelta: invalid params (s=%p P=%p L=%p)\n",
+            (void*)s,
+            (const void*)P,
+            (const void*)L);
+    return TMD_STATUS_ERR_PARAM;
+  }
+
+  tmd_stream_impl_t* S = tmd_impl(s);
+  memset(S, 0, sizeof(*S));
+  S->st.P = P;
+  S->st.status = TMD_STATUS_OK;
+  S->st.state = TMD_ST_HDR;
+#if TMD_FEAT_STATS
+  S->st.phase = TMD_PHASE_N;
+#endif
+  return TMD_STATUS_OK;
+}
+
+/**
+ * @brief Run the parser over @p len patch bytes.
+ *
+ * Under tmd_apply_step() it stops early with TMD_STATUS_PENDING once the
+ * budget is spent; @p used tells how many bytes were consumed either way.
+ */
+static tmd_status_t tmd_feed(tmd_stream_impl_t* S, const uint8_t* data,
+                             size_t len, size_t* used) {
+  *used = 0;
+  while (len > 0) {
+    tmd_status_t st = TMD_STATUS_OK;
+    uint32_t n = 0;
+
+    TMD_PHASE_SET(S, (S->st.state == TMD_ST_PAYLOAD) ? TMD_PHASE_DECODE
+                                                     : TMD_PHASE_PARSE);
+    switch (S->st.state) {
+      case TMD_ST_HDR: {
+        uint32_t want = (uint32_t)sizeof(tmd_hdr_t) - S->st.have;
+        n = (len < want) ? (uint32_t)len : want;
+        memcpy((uint8_t*)&S->st.hdr + S->st.have, data, n);
+        S->st.have += n;
+        if (S->st.have == sizeof(tmd_hdr_t)) {
+          st = tmd_on_header(S);
+        }
+        break;
+      }
+
+      case TMD_ST_TLV_HDR: {
+        if (S->st.meta_rem < sizeof(tmd_meta_tlv_t)) {
+          /* Trailing byte too short for a TLV: skip, like the old parser. */
+          n = (len < S->st.meta_rem) ? (uint32_t)len : S->st.meta_rem;
+          S->st.meta_rem = (uint16_t)(S->st.meta_rem - n);
+          if (S->st.meta_rem == 0) {
+            st = tmd_stream_begin(S);
+          }
+          break;
+        }
+        uint32_t want = (uint32_t)sizeof(tmd_meta_tlv_t) - S->st.have;
+        n = (len < want) ? (uint32_t)len : want;
+        memcpy((uint8_t*)&S->st.tlv + S->st.have, data, n);
+        S->st.have += n;
+        S->st.meta_rem = (uint16_t)(S->st.meta_rem - n);
+        if (S->st.have == sizeof(tmd_meta_tlv_t)) {
+          if (S->st.tlv.len > S->st.meta_rem) {
+            TMD_LOG("TinyMLDelta: TLV length exceed (tag=%u len=%u avail=%u)\n",
+                    (unsigned)S->st.tlv.tag,
+                    (unsigned)S->st.tlv.len,
+                    (unsigned)S->st.meta_rem);
+            st = TMD_STATUS_ERR_HDR;
+            break;
+          }
+          S->st.have = 0;
+          S->st.state = TMD_ST_TLV_VAL;
+          if (S->st.tlv.len == 0) {
+            tmd_meta_apply(&S->st.meta, S->st.tlv.tag, 0, S->st.tlv_val);
+            S->st.state = TMD_ST_TLV_HDR;
+            if (S->st.meta_rem == 0) {
+              st = tmd_stream_begin(S);
+            }
+          }
+        }
+        break;
+      }
+
+      case TMD_ST_TLV_VAL: {
+        uint32_t want = (uint32_t)S->st.tlv.len - S->st.have;
+        n = (len < want) ? (uint32_t)len : want;
+        for (uint32_t i = 0; i < n; ++i) {
+          uint32_t k = S->st.have + i;
+          if (k < sizeof(S->st.tlv_val)) {
+            S->st.tlv_val[k] = data[i];
+          }
+        }
+        S->st.have += n;
+        S->st.meta_rem = (uint16_t)(S->st.meta_rem - n);
+        if (S->st.have == S->st.tlv.len) {
+          tmd_meta_apply(&S->st.meta, S->st.tlv.tag, S->st.tlv.len,
+                         S->st.tlv_val);
+          S->st.have = 0;
+          S->st.state = TMD_ST_TLV_HDR;
+          if (S->st.meta_rem == 0) {
+            st = tmd_stream_begin(S);
+          }
+        }
+        break;
+      }
+
+      case TMD_ST_CHUNK_HDR: {
+        uint32_t want = (uint32_t)sizeof(tmd_chunk_hdr_t) - S->st.have;
+        n = (len < want) ? (uint32_t)len : want;
+        memcpy((uint8_t*)&S->st.ch + S->st.have, data, n);
+        S->st.have += n;
+        if (S->st.have == sizeof(tmd_chunk_hdr_t)) {
+          st = tmd_on_chunk_hdr(S);
+        }
+        break;
+      }
+
+      case TMD_ST_CHUNK_CRC: {
+        uint32_t want = 4u - S->st.have;
+        n = (len < want) ? (uint32_t)len : want;
+        for (uint32_t i = 0; i < n; ++i) {
+          S->st.crc_exp |= (uint32_t)data[i] << (8u * (S->st.have + i));
+        }
+        S->st.have += n;
+        if (S->st.have == 4u) {
+          TMD_LOG("TinyMLDelta:  chunk[%u] file_crc=0x%08lx\n",
+                  (unsigned)S->st.chunk_idx,
+                  (unsigned long)S->st.crc_exp);
+          S->st.have = 0;
+          S->st.state = TMD_ST_PAYLOAD;
+          if (S->st.pay_rem == 0) {
+            st = tmd_on_payload(S, NULL, 0);
+          }
+        }
+        break;
+      }
+
+      case TMD_ST_PAYLOAD:
+        n = (len < S->st.pay_rem) ? (uint32_t)len : S->st.pay_rem;
+        st = tmd_on_payload(S, data, n);
+        break;
+
+      case TMD_ST_DONE:
+        /* Trailing bytes after the last chunk are ignored. */
+        n = (uint32_t)((len > 0xFFFFFFFFu) ? 0xFFFFFFFFu : len);
+        break;
+
+      default:
+        st = TMD_STATUS_ERR_INTERNAL;
+        break;
+    }
+
+    if (st != TMD_STATUS_OK) {
+      TMD_PHASE_SET(S, TMD_PHASE_N);
+      if (st == TMD_STATUS_PENDING && TMD_STEP_OUT(S)) {
+        *used += n; /* taken; the rest of its work waits for the next step */
+        return st;
+      }
+      return tmd_fail(S, st);
+    }
+    data  += n;
+    len   -= n;
+    *used += n;
+  }
+  TMD_PHASE_SET(S, TMD_PHASE_N);
+  return TMD_STATUS_OK;
+}
+
+tmd_status_t tmd_stream_feed(tmd_stream_t* s, const uint8_t* data, size_t len) {
+  if (!s || (!data && len > 0)) {
+    return TMD_STATUS_ERR_PARAM;
+  }
+  tmd_stream_impl_t* S = tmd_impl(s);
+  if (S->st.status != TMD_STATUS_OK) {
+    return S->st.status;
+  }
+#if TMD_FEAT_STEP
+  if (S->st.step) {
+    return TMD_STATUS_ERR_PARAM; /* driven by tmd_apply_step() */
+  }
+#endif
+  if (S->st.state == TMD_ST_CLOSED) {
+    return TMD_STATUS_ERR_PARAM;
+  }
+
+  size_t used;
+  tmd_status_t st = tmd_feed(S, data, len, &used);
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+#if TMD_FEAT_ASYNC_WRITE
+  /* A program from the caller's buffer must not outlive this call. */
+  if (S->st.busy_ext && !tmd_flash_wait(S)) {
+    return tmd_fail(S, TMD_STATUS_ERR_FLASH);
+  }
+#endif
+  return TMD_STATUS_OK;
+}
+
+tmd_status_t tmd_stream_finish(tmd_stream_t* s) {
+  if (!s) {
+    return TMD_STATUS_ERR_PARAM;
+  }
+  tmd_stream_impl_t* S = tmd_impl(s);
+  if (S->st.status != TMD_STATUS_OK) {
+    return S->st.status;
+  }
+  if (S->st.state != TMD_ST_DONE) {
+    TMD_LOG("TinyMLDelta: patch truncated (state=%u chunk=%u of %u)\n",
+            (unsigned)S->st.state,
+            (unsigned)S->st.chunk_idx,
+            (unsigned)S->st.hdr.chunks_n);
+    return tmd_fail(S, (S->st.state == TMD_ST_CLOSED) ? TMD_STATUS_ERR_PARAM
+                                                      : TMD_STATUS_ERR_HDR);
+  }
+
+  const tmd_ports_t* P = S->st.P;
+
+  /*
+   * Complete the sector holding the last chunk from the source, sync the
+   * untouched sectors after it and program whatever is left in the window.
+   * Under tmd_apply_step() this and the base tail fold below may take
+   * several calls: both carry on where the budget stopped them.
+   */
+  TMD_PHASE_SET(S, TMD_PHASE_COPY);
+  tmd_status_t st = tmd_fill_source(S, S->st.img_end);
+  if (st == TMD_STATUS_OK) {
+    st = tmd_win_flush(S);
+  }
+  if (st == TMD_STATUS_OK && !tmd_flash_wait(S)) {
+    st = TMD_STATUS_ERR_FLASH;
+  }
+  if (st == TMD_STATUS_OK) {
+    TMD_LOG("TinyMLDelta: image complete, %lu bytes programmed\n",
+            (unsigned long)S->st.cur);
+  }
+
+  TMD_PHASE_SET(S, TMD_PHASE_CRC);
+#if TMD_FEAT_DIGEST
+  /*
+   * Both digests must match before the flip. The base tail past the image
+   * (target shorter than base) is the only part not read by the merge.
+   */
+  if (st == TMD_STATUS_OK) {
+    st = tmd_fold_upto(S, S->st.hdr.base_len, 0);
+  }
+#endif
+  if (st == TMD_STATUS_PENDING && TMD_STEP_OUT(S)) {
+    TMD_PHASE_SET(S, TMD_PHASE_N);
+    return st;
+  }
+  if (st != TMD_STATUS_OK) {
+    return tmd_fail(S, st);
+  }
+#if TMD_FEAT_VERIFY_BASE
+#if TMD_FEAT_IN_PLACE
+  if (!S->st.inplace)  /* checked before the first erase */
+#endif
+  {
+    if (!tmd_dig_match(P, &S->st.dig_base, S->st.hdr.base_chk)) {
+      TMD_LOG("TinyMLDelta: base digest mismatch: patch is for a different model\n");
+      return tmd_fail(S, TMD_STATUS_ERR_INTEGRITY);
+    }
+    TMD_LOG("TinyMLDelta: base digest OK (%lu bytes)\n",
+            (unsigned long)S->st.base_pos);
+  }
+#endif
+#if TMD_FEAT_VERIFY_TARGET
+  if (S->st.tgt_pos != S->st.hdr.target_len ||
+      !tmd_dig_match(P, &S->st.dig_tgt, S->st.hdr.target_chk)) {
+    TMD_LOG("TinyMLDelta: target digest mismatch\n");
+    return tmd_fail(S, TMD_STATUS_ERR_INTEGRITY);
+  }
+  TMD_LOG("TinyMLDelta: target digest OK (%lu bytes)\n",
+          (unsigned long)S->st.tgt_pos);
+#endif
+
+  TMD_PHASE_SET(S, TMD_PHASE_JOURNAL);
+#if TMD_FEAT_JOURNAL
+  TMD_LOG("TinyMLDelta: clearing journal\n");
+  if (!tmd_journal_erase(S)) {
+    /* Not flipped: a retry resumes from the journal and finishes again. */
+    TMD_LOG("TinyMLDelta: journal_clear failed\n");
+    return tmd_fail(S, TMD_STATUS_ERR_FLASH);
+  }
+#endif
+
+#if TMD_FEAT_IN_PLACE
+  if (S->st.inplace) {
+    TMD_LOG("TinyMLDelta: patch applied in place, slot=%u\n",
+            (unsigned)S->st.inactive);
+    TMD_PHASE_SET(S, TMD_PHASE_N);
+    S->st.state = TMD_ST_CLOSED;
+    return TMD_STATUS_OK;
+  }
+#endif
+  if (!P->set_active_slot(S->st.inactive)) {
+    TMD_LOG("TinyMLDelta: set_active_slot(%u) failed\n",
+            (unsigned)S->st.inactive);
+    return tmd_fail(S, TMD_STATUS_ERR_FLASH);
+  }
+
+  TMD_LOG("TinyMLDelta: patch applied OK, new active slot=%u\n",
+          (unsigned)S->st.inactive);
+  TMD_PHASE_SET(S, TMD_PHASE_N);
+  S->st.state = TMD_ST_CLOSED;
+  return TMD_STATUS_OK;
+}
+
+tmd_status_t tmd_stream_stats(const tmd_stream_t* s, tmd_stats_t* out) {
+  if (!s || !out) {
+    return TMD_STATUS_ERR_PARAM;
+  }
+#if TMD_FEAT_STATS
+  *out = ((const tmd_stream_impl_t*)(const void*)s)->st.stats;
+  return TMD_STATUS_OK;
+#else
+  memset(out, 0, sizeof(*out));
+  return TMD_STATUS_ERR_UNSUPPORTED;
+#endif
+}
+
+/**
+ * @brief Apply a TinyMLDelta patch already resident in memory.
+ *
+ * Typical flow:
+ *   1. Parse and validate header.
+ *   2. Parse metadata TLVs and enforce guardrails.
+ *   3. Merge active slot bytes and chunk payloads into the inactive slot,
+ *      one sector at a time; each byte is programmed once.
+ *   4. Flip active slot to the updated one.
+ *
+ * @param patch      Pointer to patch bytes.
+ * @param patch_len  Length of patch in bytes.
+ *
+ * @return TMD_STATUS_OK on success, error code otherwise.
+ */
+tmd_status_t tmd_apply_patch_from_memory(const uint8_t* patch, size_t patch_len) {
+  tmd_stream_t s;
+  return tmd_apply_patch_ctx(&s, patch, patch_len);
+}
+
+tmd_status_t tmd_apply_patch_ctx(tmd_stream_t* s, const uint8_t* patch,
+                                 size_t patch_len) {
+  if (!patch || patch_len < sizeof(tmd_hdr_t)) {
+    TMD_LOG("TinyMLDelta: invalid params (patch=%p len=%lu)\n",
+            (const void*)patch,
+            (unsigned long)patch_len);
+    return TMD_STATUS_ERR_PARAM;
+  }
+
+  tmd_status_t st = tmd_stream_init(s);
+  if (st == TMD_STATUS_OK) {
+    st = tmd_stream_feed(s, patch, patch_len);
+  }
+  if (st == TMD_STATUS_OK) {
+    st = tmd_stream_finish(s);
+  }
+  return st;
+}
+
+size_t tmd_workspace_size(void) {
+  return sizeof(tmd_stream_t);
+}
+
+tmd_status_t tmd_apply_begin(tmd_stream_t* s, const uint8_t* patch,
+                             size_t patch_len) {
+#if !TMD_FEAT_STEP
+  (void)s; (void)patch; (void)patch_len;
+  return TMD_STATUS_ERR_UNSUPPORTED;
+#else
+  if (!patch || patch_len < sizeof(tmd_hdr_t)) {
+    TMD_LOG("TinyMLDelta: invalid params (patch=%p len=%lu)\n",
+            (const void*)patch,
+            (unsigned long)patch_len);
+    return TMD_STATUS_ERR_PARAM;
+  }
+  tmd_status_t st = tmd_stream_init(s);
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+  tmd_stream_impl_t* S = tmd_impl(s);
+  S->st.step = 1;
+  S->st.sp_patch = patch;
+  S->st.sp_len = patch_len;
+  return TMD_STATUS_OK;
+#endif
+}
+
+tmd_status_t tmd_apply_step(tmd_stream_t* s, uint32_t budget) {
+#if !TMD_FEAT_STEP
+  (void)s; (void)budget;
+  return TMD_STATUS_ERR_UNSUPPORTED;
+#else
+  if (!s) {
+    return TMD_STATUS_ERR_PARAM;
+  }
+  tmd_stream_impl_t* S = tmd_impl(s);
+  if (!S->st.step) {
+    return TMD_STATUS_ERR_PARAM; /* not started by tmd_apply_begin() */
+  }
+  if (S->st.status != TMD_STATUS_OK || S->st.state == TMD_ST_CLOSED) {
+    return S->st.status;
+  }
+  S->st.sp_left = budget ? budget : 0xFFFFFFFFu;
+
+  /*
+   * Leftovers of the previous step first, then patch bytes in slices no
+   * larger than the budget left (each byte parsed costs one), then the
+   * finish. Every stop is at a point the parser resumes from.
+   */
+  TMD_PHASE_SET(S, TMD_PHASE_DECODE);
+  tmd_status_t st = tmd_step_resume(S);
+  TMD_PHASE_SET(S, TMD_PHASE_N);
+  if (st != TMD_STATUS_OK) {
+    return (st == TMD_STATUS_PENDING) ? st : tmd_fail(S, st);
+  }
+  while (S->st.sp_off < S->st.sp_len) {
+    if (S->st.sp_left == 0) {
+      return TMD_STATUS_PENDING;
+    }
+    size_t n = S->st.sp_len - S->st.sp_off;
+    if (n > S->st.sp_left) {
+      n = S->st.sp_left;
+    }
+    size_t used;
+    st = tmd_feed(S, S->st.sp_patch + S->st.sp_off, n, &used);
+    S->st.sp_off += used;
+    tmd_step_spend(S, (uint32_t)used);
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+  }
+  if (TMD_STEP_OUT(S)) {
+    return TMD_STATUS_PENDING;
+  }
+  return tmd_stream_finish(s);
+#endif
+}
+
+tmd_status_t tmd_prepare_slot(const uint8_t* patch, size_t patch_len,
+                              uint32_t max_erases) {
+  tmd_stream_t s;
+  return tmd_prepare_slot_ctx(&s, patch, patch_len, max_erases);
+}
+
+tmd_status_t tmd_prepare_slot_ctx(tmd_stream_t* s, const uint8_t* patch,
+                                  size_t patch_len, uint32_t max_erases) {
+#if !TMD_FEAT_PREPARE
+  (void)s; (void)patch; (void)patch_len; (void)max_erases;
+  return TMD_STATUS_ERR_UNSUPPORTED;
+#else
+  if (!patch || patch_len < sizeof(tmd_hdr_t)) {
+    TMD_LOG("TinyMLDelta: invalid params (patch=%p len=%lu)\n",
+            (const void*)patch,
+            (unsigned long)patch_len);
+    return TMD_STATUS_ERR_PARAM;
+  }
+
+  tmd_status_t st = tmd_stream_init(s);
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+  tmd_stream_impl_t* S = tmd_impl(s);
+  S->st.prep = 1;
+  S->st.prep_left = max_erases ? max_erases : 0xFFFFFFFFu;
+
+  /*
+   * The same pass as an apply, minus the programming: every sector a chunk
+   * writes is erased when the merge reaches it, every other sector of the
+   * image is synced with the source. Chunks before the journal's
+   * prep_chunk_idx are not decoded.
+   */
+  st = tmd_stream_feed(s, patch, patch_len);
+  if (st == TMD_STATUS_OK && S->st.state != TMD_ST_DONE) {
+    TMD_LOG("TinyMLDelta: patch truncated (state=%u)\n", (unsigned)S->st.state);
+    st = TMD_STATUS_ERR_HDR;
+  }
+  if (st == TMD_STATUS_OK) {
+    st = tmd_fill_source(S, S->st.img_end);
+    if (st == TMD_STATUS_OK) {
+      st = tmd_win_flush(S);
+    }
+    if (st == TMD_STATUS_OK && !tmd_flash_wait(S)) {
+      st = TMD_STATUS_ERR_FLASH;
+    }
+  }
+
+  /*
+   * Stops happen at a sector base, on the erase of the next sector. The
+   * window it would have programmed may hold the tail of an earlier chunk,
+   * so a stop resumes at the chunk being consumed when that base was reached.
+   */
+  uint32_t idx = (st == TMD_STATUS_PENDING) ? S->st.prep_idx : S->st.chunk_idx;
+  if ((st == TMD_STATUS_OK || st == TMD_STATUS_PENDING) &&
+      (S->st.j.prep_off != S->st.cur || S->st.j.prep_chunk_idx != idx)) {
+    S->st.j.prep_off = S->st.cur;
+    S->st.j.prep_chunk_idx = idx;
+    if (!tmd_journal_store(S, &S->st.j)) {
+      TMD_LOG("TinyMLDelta: journal_write failed (prep_off=%lu)\n",
+              (unsigned long)S->st.cur);
+      st = TMD_STATUS_ERR_FLASH;
+    }
+  }
+  TMD_LOG("TinyMLDelta: slot prepared up to %lu of %lu%s\n",
+          (unsigned long)S->st.j.prep_off,
+          (unsigned long)S->st.img_end,
+          (st == TMD_STATUS_PENDING) ? ", more to do" : "");
+  return st;
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* Patch inspection                                                           */
+/* -------------------------------------------------------------------------- */
+
+#if TMD_FEAT_INSPECT
+#if TMD_FEAT_RLE
+/**
+ * @brief Target bytes an RLE body of @p n bytes expands to.
+ */
+static tmd_status_t tmd_rle_out_len(const uint8_t* p, uint32_t n,
+                                    uint32_t* out) {
+  if (n & 1u) {
+    TMD_LOG("TinyMLDelta: RLE payload ends mid-pair\n");
+    return TMD_STATUS_ERR_HDR;
+  }
+  uint32_t o = 0;
+  for (uint32_t i = 0; i < n; i += 2u) {
+    o += p[i] ? p[i] : 256u;
+  }
+  *out = o;
+  return TMD_STATUS_OK;
+}
+#endif
+
+#if TMD_FEAT_LZ4TINY
+/**
+ * @brief Target bytes an LZ4 block of @p n bytes at image offset @p off
+ *        expands to; checks its sequences and match distances on the way.
+ */
+static tmd_status_t tmd_lz4_out_len(const uint8_t* p, uint32_t n, uint32_t off,
+                                    uint32_t* out) {
+  uint32_t i = 0;
+  uint32_t o = 0;
+  while (i < n) {
+    uint8_t token = p[i++];
+    uint32_t lit = token >> 4;
+    if (lit == 15u) {
+      uint8_t b;
+      do {
+        if (i == n) {
+          goto truncated;
+        }
+        b = p[i++];
+        lit += b;
+      } while (b == 255u);
+    }
+    if (lit > n - i) {
+      goto truncated;
+    }
+    i += lit;
+    o += lit;
+    if (i == n) {
+      break; /* the last sequence has literals only */
+    }
+    if (n - i < 2u) {
+      goto truncated;
+    }
+    uint32_t dist = (uint32_t)p[i] | ((uint32_t)p[i + 1u] << 8);
+    i += 2u;
+    if (dist > off + o) {
+      TMD_LOG("TinyMLDelta: match distance %lu before slot start (at %lu)\n",
+              (unsigned long)dist,
+              (unsigned long)(off + o));
+      return TMD_STATUS_ERR_HDR;
+    }
+    uint32_t ml = token & 15u;
+    if (ml == 15u) {
+      uint8_t b;
+      do {
+        if (i == n) {
+          goto truncated;
+        }
+        b = p[i++];
+        ml += b;
+      } while (b == 255u);
+    }
+    o += ml + 4u;
+  }
+  *out = o;
+  return TMD_STATUS_OK;
+
+truncated:
+  TMD_LOG("TinyMLDelta: LZ4 payload ends mid-sequence\n");
+  return TMD_STATUS_ERR_HDR;
+}
+#endif
+
+/**
+ * @brief Target bytes chunk @p ch with payload @p pay expands to, after
+ *        checking the payload and any source range it reads.
+ */
+static tmd_status_t tmd_chunk_out_len(const tmd_chunk_hdr_t* ch,
+                                      const uint8_t* pay, uint32_t slot,
+                                      uint32_t* out) {
+  uint8_t op = ch->enc & (TMD_ENC_F_XOR | TMD_ENC_F_SUB);
+  uint8_t body = ch->enc & (uint8_t)~op;
+  uint32_t skip = op ? 4u : 0u;
+  tmd_status_t st = TMD_STATUS_OK;
+
+  switch (body) {
+#if TMD_FEAT_RLE
+    case TMD_ENC_RLE:
+      st = tmd_rle_out_len(pay + skip, ch->len - skip, out);
+      break;
+#endif
+#if TMD_FEAT_LZ4TINY
+    case TMD_ENC_LZ4:
+      st = tmd_lz4_out_len(pay, ch->len, ch->off, out);
+      break;
+#endif
+#if TMD_FEAT_COPY
+    case TMD_ENC_COPY: {
+      uint32_t src = tmd_rd_u32(pay);
+      *out = tmd_rd_u32(pay + 4);
+      if (src > slot || *out > slot - src) {
+        TMD_LOG("TinyMLDelta: copy out of range (src=%lu,len=%lu,size=%lu)\n",
+                (unsigned long)src,
+                (unsigned long)*out,
+                (unsigned long)slot);
+        return TMD_STATUS_ERR_PARAM;
+      }
+      break;
+    }
+#endif
+    default:
+      *out = ch->len - skip;
+      break;
+  }
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+  if (*out > slot - ch->off) {
+    TMD_LOG("TinyMLDelta: chunk out of range (off=%lu,len=%lu,size=%lu)\n",
+            (unsigned long)ch->off,
+            (unsigned long)*out,
+            (unsigned long)slot);
+    return TMD_STATUS_ERR_PARAM;
+  }
+  if (op != 0) {
+    uint32_t src = (uint32_t)pay[0] | ((uint32_t)pay[1] << 8) |
+                   ((uint32_t)pay[2] << 16) | ((uint32_t)pay[3] << 24);
+    if (src > slot || *out > slot - src) {
+      TMD_LOG("TinyMLDelta: delta source out of range (src=%lu,len=%lu,size=%lu)\n",
+              (unsigned long)src,
+              (unsigned long)*out,
+              (unsigned long)slot);
+      return TMD_STATUS_ERR_PARAM;
+    }
+  }
+  return TMD_STATUS_OK;
+}
+#endif
+
+tmd_status_t tmd_inspect_patch(const uint8_t* patch, size_t patch_len,
+                               tmd_patch_info_t* info) {
+#if !TMD_FEAT_INSPECT
+  (void)patch; (void)patch_len; (void)info;
+  return TMD_STATUS_ERR_UNSUPPORTED;
+#else
+  const tmd_ports_t*  P = tmd_ports();
+  const tmd_layout_t* L = tmd_layout();
+  if (!patch || !info || !P || !L) {
+    TMD_LOG("TinyMLDelta: invalid params (patch=%p info=%p)\n",
+            (const void*)patch,
+            (void*)info);
+    return TMD_STATUS_ERR_PARAM;
+  }
+  memset(info, 0, sizeof(*info));
+  info->guardrail = TMD_STATUS_PENDING;
+  if (patch_len < sizeof(tmd_hdr_t)) {
+    return TMD_STATUS_PENDING;
+  }
+
+  tmd_hdr_t hdr;
+  memcpy(&hdr, patch, sizeof(hdr));
+  info->base_len = hdr.base_len;
+  info->target_len = hdr.target_len;
+  info->chunks = hdr.chunks_n;
+  info->flags = hdr.flags;
+  tmd_status_t st = tmd_hdr_check(&hdr);
+  if (st != TMD_STATUS_OK) {
+    return st;
+  }
+
+  uint32_t slot;
+  if (L->in_place) {
+#if TMD_FEAT_IN_PLACE
+    if (!(hdr.flags & TMD_HDR_F_IN_PLACE)) {
+      TMD_LOG("TinyMLDelta: patch not built for in-place apply\n");
+      return TMD_STATUS_ERR_UNSUPPORTED;
+    }
+    /* Same layout requirements as tmd_stream_begin(). */
+    if (L->meta_size < (uint32_t)TMD_SECTOR_SZ ||
+        (!P->journal_write &&
+         tmd_jlog_size() < 2u * (uint32_t)TMD_SECTOR_SZ)) {
+      TMD_LOG("TinyMLDelta: in-place apply needs a swap sector and a "
+              "two-sector journal log\n");
+      return TMD_STATUS_ERR_PARAM;
+    }
+    slot = L->slotA.size; /* the only slot */
+#else
+    TMD_LOG("TinyMLDelta: in-place layout needs TMD_FEAT_IN_PLACE\n");
+    return TMD_STATUS_ERR_UNSUPPORTED;
+#endif
+  } else {
+    /* Either slot may be the destination: check against the smaller one. */
+    slot = (L->slotA.size < L->slotB.size) ? L->slotA.size : L->slotB.size;
+  }
+  uint32_t image = hdr.target_len ? hdr.target_len : slot;
+  if (image > slot) {
+    TMD_LOG("TinyMLDelta: target_len %lu exceeds slot size %lu\n",
+            (unsigned long)image,
+            (unsigned long)slot);
+    return TMD_STATUS_ERR_PARAM;
+  }
+#if TMD_FEAT_VERIFY_BASE
+  if (hdr.base_len > slot) {
+    TMD_LOG("TinyMLDelta: base_len %lu exceeds slot size %lu\n",
+            (unsigned long)hdr.base_len,
+            (unsigned long)slot);
+    return TMD_STATUS_ERR_INTEGRITY;
+  }
+#endif
+  uint32_t img_end = ((image + (uint32_t)TMD_SECTOR_SZ - 1u) / (uint32_t)TMD_SECTOR_SZ) *
+                     (uint32_t)TMD_SECTOR_SZ;
+  if (img_end > slot) {
+    img_end = slot;
+  }
+  info->image_sectors = (img_end + (uint32_t)TMD_SECTOR_SZ - 1u) / (uint32_t)TMD_SECTOR_SZ;
+
+  /* TLVs and guardrails. */
+  size_t pos = sizeof(tmd_hdr_t);
+  if (patch_len - pos < hdr.meta_len) {
+    return TMD_STATUS_PENDING;
+  }
+#if TMD_FEAT_GUARDRAILS
+  tmd_meta_state_t meta;
+  memset(&meta, 0, sizeof(meta));
+#endif
+  size_t meta_end = pos + hdr.meta_len;
+  while (meta_end - pos >= sizeof(tmd_meta_tlv_t)) {
+    uint8_t tag = patch[pos];
+    uint8_t len = patch[pos + 1u];
+    pos += sizeof(tmd_meta_tlv_t);
+    if (len > meta_end - pos) {
+      TMD_LOG("TinyMLDelta: TLV length exceed (tag=%u len=%u avail=%u)\n",
+              (unsigned)tag,
+              (unsigned)len,
+              (unsigned)(meta_end - pos));
+      return TMD_STATUS_ERR_HDR;
+    }
+    /* Values shorter than 4 bytes are read from a padded copy. */
+    uint8_t val[4] = {0};
+    memcpy(val, patch + pos, (len < sizeof(val)) ? len : sizeof(val));
+    tmd_meta_apply(&meta, tag, len, val);
+    pos += len;
+  }
+  pos = meta_end;
+  info->guardrail = tmd_check_guardrails(&meta);
+
+  /* Chunk table: the same checks the apply makes, without the flash. */
+  uint32_t out = 0;        /* end of the previous chunk */
+  uint32_t last_sec = 0;   /* 1 + the last sector counted as touched */
+  for (uint32_t i = 0; i < hdr.chunks_n; ++i) {
+    tmd_chunk_hdr_t ch;
+    if (patch_len - pos < sizeof(ch)) {
+      return TMD_STATUS_PENDING;
+    }
+    memcpy(&ch, patch + pos, sizeof(ch));
+    st = tmd_chunk_check(&ch, slot);
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+    if (ch.off < out) {
+      TMD_LOG("TinyMLDelta: chunk[%u] off=%lu overlaps or precedes %lu\n",
+              (unsigned)i,
+              (unsigned long)ch.off,
+              (unsigned long)out);
+      return TMD_STATUS_ERR_HDR;
+    }
+    size_t need = sizeof(ch) + (ch.has_crc ? 4u : 0u) + ch.len;
+    if (patch_len - pos < need) {
+      return TMD_STATUS_PENDING;
+    }
+    const uint8_t* pay = patch + pos + (need - ch.len);
+#if TMD_FEAT_CRC32
+    /* Before the payload is sized, as the apply checks it before decoding
+       the last (for a whole payload, the only) fragment. */
+    if (ch.has_crc) {
+      uint32_t exp = (uint32_t)pay[-4] | ((uint32_t)pay[-3] << 8) |
+                     ((uint32_t)pay[-2] << 16) | ((uint32_t)pay[-1] << 24);
+      uint32_t got = tmd_crc_final(P, tmd_crc_update(P, tmd_crc_init(P), pay,
+                                                     ch.len));
+      if (got != exp) {
+        TMD_LOG("TinyMLDelta: chunk CRC mismatch idx=%u got=0x%08lx exp=0x%08lx\n",
+                (unsigned)i,
+                (unsigned long)got,
+                (unsigned long)exp);
+        return TMD_STATUS_ERR_INTEGRITY;
+      }
+    }
+#endif
+    uint32_t n = 0;
+    st = tmd_chunk_out_len(&ch, pay, slot, &n);
+    if (st != TMD_STATUS_OK) {
+      return st;
+    }
+    pos += need;
+    out = ch.off + n;
+    info->payload_bytes += ch.len;
+    info->write_bytes += n;
+    if (n > 0) {
+      uint32_t sec = ch.off / (uint32_t)TMD_SECTOR_SZ;
+      if (sec < last_sec) {
+        sec = last_sec; /* already counted for the previous chunk */
+      }
+      last_sec = (out - 1u) / (uint32_t)TMD_SECTOR_SZ + 1u;
+      for (; sec < last_sec; ++sec) {
+        uint32_t base = sec * (uint32_t)TMD_SECTOR_SZ;
+        uint32_t span = (slot - base < (uint32_t)TMD_SECTOR_SZ)
+                            ? slot - base : (uint32_t)TMD_SECTOR_SZ;
+        info->touched_sectors++;
+        info->erase_bytes += (uint32_t)TMD_SECTOR_SZ;
+        info->program_bytes += span;
+      }
+    }
+    info->chunks_checked = (uint16_t)(i + 1u);
+  }
+  if (L->in_place) {
+    /* Every rewritten sector is first saved to the swap sector. */
+    info->erase_bytes *= 2u;
+    info->program_bytes *= 2u;
+  }
+  TMD_LOG("TinyMLDelta: inspected %u chunks, %lu sectors touched\n",
+          (unsigned)info->chunks_checked,
+          (unsigned long)info->touched_sectors);
+  return TMD_STATUS_OK;
+#endif
+}